@@ -222,6 +222,38 @@ namespace CPU {
 		return vendor;
 	}
 
+	static inline uint64_t rdtsc(void) {
+		uint32_t lo, hi;
+		asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+		return ((uint64_t)hi << 32) | lo;
+	}
+
+	/************* Model Specific Registers: *************/
+	#define CPUID_FEAT_EDX_SEP (1 << 11) /* SYSENTER/SYSEXIT present */
+
+	#define MSR_SYSENTER_CS  0x174
+	#define MSR_SYSENTER_ESP 0x175
+	#define MSR_SYSENTER_EIP 0x176
+
+	static inline uint64_t rdmsr(uint32_t msr) {
+		uint32_t lo, hi;
+		asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+		return ((uint64_t)hi << 32) | lo;
+	}
+
+	static inline void wrmsr(uint32_t msr, uint64_t value) {
+		asm volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+	}
+
+	/* The Pentium Pro reports SEP but doesn't implement it (family 6, model < 3, stepping < 3): */
+	static inline char cpu_has_sep(void) {
+		cpuid_t id;
+		asm volatile("cpuid" : "=a"(id.eax), "=b"(id.ebx), "=c"(id.ecx), "=d"(id.edx) : "a"(CPUID_GETFEATURES));
+		if(!(id.edx & CPUID_FEAT_EDX_SEP)) return 0;
+		if(((id.eax >> 8) & 0xF) == 6 && ((id.eax >> 4) & 0xF) < 3 && (id.eax & 0xF) < 3) return 0;
+		return 1;
+	}
+
 	#define cpu_is_intel(cpuid_struct) (cpuid_struct.ebx == 0x756e6547)	/* Intel Magic code */
 	#define cpu_is_amd(cpuid_struct)  (cpuid_struct.ebx == 0x68747541) /* AMD Magic code */
 	#define cpu_is_unknown(cpuid_struct) (cpu_is_intel(cpuid_struct) | cpu_is_amd(cpuid_struct))
@@ -97,6 +97,13 @@ namespace TSS {
 		CPU::GDT::gdt.tss.esp0 = stack;
 	}
 
+	uintptr_t tss_kernel_stack_slot(void) {
+		/* Used by SYSENTER, which loads %esp from this slot on entry.
+		   tss_entry_t is packed, so work out the address from the TSS base instead of taking &tss.esp0: */
+		uintptr_t base = (uintptr_t)&CPU::GDT::gdt.tss;
+		return base + __builtin_offsetof(tss_entry_t, esp0);
+	}
+
 	void tss_flush(void) {
 		asm volatile ("mov $0x2B, %ax; ltr %ax");
 	}
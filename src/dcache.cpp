@@ -0,0 +1,174 @@
+/*
+ * dcache.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <fs.h>
+#include <errno.h>
+#include <system.h>
+#include <module.h>
+
+/*
+ * Dentry cache. Remembers what fs_finddir found for a (directory, name) pair, so that kopen
+ * can resolve paths it has already seen without going down to the filesystem.
+ * Directories are identified like the page cache does it, by (device, inode).
+ * Names that weren't found are cached too (negative entries), until something creates them.
+ * Only directories flagged with FS_DCACHE are cached: their finddir must hand out a fresh node every time.
+ *
+ * It's also the inode cache. What comes out of a cached directory is the one in-memory node of its
+ * (device, inode) (flagged FS_INODE), shared by every path walk, open and entry that leads to it, so that
+ * size, link count and the like are the same for everyone. The node is refcounted (entries hold one reference
+ * each) and stays on the inode table until the last fclose, which takes it off with dcache_forget.
+ */
+
+#define DCACHE_MAX_ENTRIES 512
+#define DCACHE_HASH_SIZE   256 /* Must be a power of two */
+
+typedef struct dentry {
+	void * device;    /* The parent directory... */
+	uint32_t inode;
+	char * name;      /* ...and the name looked up in it */
+	FILE * file;      /* The shared node it resolved to. Null if it wasn't found */
+	node_t hash_node; /* On its dc_hash bucket */
+	node_t lru_node;  /* On dc_lru, most recently used at the tail */
+} dentry_t;
+
+static list_t dc_hash[DCACHE_HASH_SIZE];
+static list_t dc_inode_hash[DCACHE_HASH_SIZE]; /* The FS_INODE nodes, by (device, inode) */
+static list_t dc_lru;
+static spin_lock_t dc_lock = { 0 };
+
+/*************************/
+/**** Lookup helpers: ****/
+/*************************/
+static inline uint32_t dc_hash_fn(void * device, uint32_t inode, char * name) {
+	uint32_t hash = ((uintptr_t)device >> 4) * 31 + inode * 2654435761u;
+	while(*name)
+		hash = hash * 31 + *name++;
+	return hash & (DCACHE_HASH_SIZE - 1);
+}
+
+static inline uint32_t dc_inode_hash_fn(void * device, uint32_t inode) {
+	return (((uintptr_t)device >> 4) * 31 + inode * 2654435761u) & (DCACHE_HASH_SIZE - 1);
+}
+
+static char dc_cacheable(FILE * parent) {
+	return parent && (parent->flags & FS_DCACHE) && fs_is_dir(parent) && parent->finddir;
+}
+
+static dentry_t * dc_find(FILE * parent, char * name) {
+	foreach(it, &dc_hash[dc_hash_fn(parent->device, parent->inode, name)]) {
+		dentry_t * dentry = (dentry_t*)it->value;
+		if(dentry->device == parent->device && dentry->inode == parent->inode && !strcmp(dentry->name, name))
+			return dentry;
+	}
+	return 0;
+}
+
+/* Takes a reference, unless the last one is already gone (its fclose is on the way to dcache_forget): */
+static char dc_tryget(FILE * file) {
+	int32_t refs;
+	while((refs = file->refcount) > 0)
+		if(__sync_bool_compare_and_swap(&file->refcount, refs, refs + 1))
+			return 1;
+	return 0;
+}
+
+/* Trades a node fresh out of finddir for the shared one of its inode (with a reference taken). Called with the lock held: */
+static FILE * dc_share(FILE * file) {
+	list_t * bucket = &dc_inode_hash[dc_inode_hash_fn(file->device, file->inode)];
+	foreach(it, bucket) {
+		FILE * shared = (FILE*)it->value;
+		if(shared->device == file->device && shared->inode == file->inode && dc_tryget(shared)) {
+			free(file); /* Never opened */
+			return shared;
+		}
+	}
+	file->flags |= FS_INODE;
+	file->refcount = 1;
+	file->inode_node.value = file;
+	list_append(bucket, &file->inode_node);
+	return file;
+}
+
+/* Returns the entry's reference to its node, for the caller to fclose once it has let go of the lock (the last fclose takes it): */
+static FILE * dc_drop(dentry_t * dentry) {
+	list_delete(&dc_hash[dc_hash_fn(dentry->device, dentry->inode, dentry->name)], &dentry->hash_node);
+	list_delete(&dc_lru, &dentry->lru_node);
+	FILE * file = dentry->file;
+	free(dentry->name);
+	free(dentry);
+	return file;
+}
+
+/*
+ * Same as fs_finddir, through the cache. From a cached directory, it's the shared node with a reference taken,
+ * to be released with fclose. From any other, it's whatever its finddir returned
+ */
+FILE * dcache_get(FILE * parent, char * name) {
+	if(!dc_cacheable(parent))
+		return fs_finddir(parent, name);
+
+	spin_lock(dc_lock);
+	dentry_t * dentry = dc_find(parent, name);
+	if(dentry) {
+		/* Touch it: */
+		list_delete(&dc_lru, &dentry->lru_node);
+		list_append(&dc_lru, &dentry->lru_node);
+		FILE * file = fs_clone(dentry->file);
+		spin_unlock(dc_lock);
+		return file;
+	}
+	spin_unlock(dc_lock);
+
+	/* The filesystem is called without the lock held: */
+	FILE * file = fs_finddir(parent, name);
+
+	FILE * evicted = 0;
+	spin_lock(dc_lock);
+	if(file)
+		file = dc_share(file);
+	if(!dc_find(parent, name)) {
+		if(dc_lru.length >= DCACHE_MAX_ENTRIES)
+			evicted = dc_drop((dentry_t*)dc_lru.head->value);
+
+		dentry = (dentry_t*)malloc(sizeof(dentry_t));
+		memset(dentry, 0, sizeof(dentry_t));
+		dentry->device = parent->device;
+		dentry->inode  = parent->inode;
+		dentry->name   = strdup(name);
+		dentry->file   = fs_clone(file);
+		dentry->hash_node.value = dentry;
+		dentry->lru_node.value  = dentry;
+		list_append(&dc_hash[dc_hash_fn(dentry->device, dentry->inode, name)], &dentry->hash_node);
+		list_append(&dc_lru, &dentry->lru_node);
+	}
+	spin_unlock(dc_lock);
+	if(evicted)
+		fclose(evicted);
+	return file;
+}
+EXPORT_SYMBOL(dcache_get);
+
+/* 'name' inside 'parent' was created or removed: */
+void dcache_invalidate(FILE * parent, char * name) {
+	if(!parent || !name)
+		return;
+	spin_lock(dc_lock);
+	dentry_t * dentry = dc_find(parent, name);
+	FILE * file = dentry ? dc_drop(dentry) : 0;
+	spin_unlock(dc_lock);
+	if(file)
+		fclose(file);
+}
+EXPORT_SYMBOL(dcache_invalidate);
+
+/* The last reference to a shared node is gone. Called by fclose, right before freeing it: */
+void dcache_forget(FILE * node) {
+	spin_lock(dc_lock);
+	list_delete(&dc_inode_hash[dc_inode_hash_fn(node->device, node->inode)], &node->inode_node);
+	spin_unlock(dc_lock);
+}
+EXPORT_SYMBOL(dcache_forget);
@@ -262,8 +262,11 @@ int exec_elf(char * elfpath, FILE * file, int argc, char ** argv, char ** env, c
 	/* The ELF file is completely safe to run.
 	 * Make all the necessary preparations for the execution: */
 	if(execution_mode == EXECM_USER) {
+		/* Ring workers use the old image's memory. Stop them before it goes away: */
+		Kernel::Syscall::ring_task_exit((task_t*)current_task);
 		/* Prepare directory: */
 		set_task_environment((task_t*)current_task, clone_directory(curr_dir));
+		task_close_cloexec((task_t*)current_task);
 		switch_directory(curr_dir);
 		release_directory_for_exec(curr_dir);
 		invalidate_page_tables();
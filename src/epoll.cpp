@@ -0,0 +1,279 @@
+/*
+ * epoll.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <fs.h>
+#include <errno.h>
+#include <system.h>
+#include <module.h>
+#include "poll.h"
+
+/*
+ * Every watched descriptor (epitem) stays registered on its device's wait queues with a WAIT_CBACK entry.
+ * When the device wakes its queue up, epoll_cback moves the item into the ready list,
+ * so epoll_wait only ever looks at the descriptors that did something.
+ * Items are keyed by (open file, fd), and hold no reference to the open file: they're
+ * on its epitems list instead, and go away when the last descriptor to it is closed.
+ */
+
+typedef struct eventpoll {
+	list_t * interest;   /* Every epitem_t */
+	list_t ready;        /* epitem_t's whose device fired (through their ready_node) */
+	list_t * wait_queue; /* Tasks waiting for the ready list to fill up */
+} eventpoll_t;
+
+typedef struct epitem {
+	eventpoll_t * ep;
+	file_t * file;
+	int fd;
+	uint32_t events;    /* Interest, with EPOLLET */
+	uint32_t data;
+	poll_table_t table; /* The device queues it's registered on */
+	node_t ready_node;  /* On ep->ready while owned */
+	node_t file_node;   /* On file->epitems */
+} epitem_t;
+
+static uint32_t epoll_file_close(FILE * node);
+
+/*************************/
+/**** Ready list feed ****/
+/*************************/
+
+/*
+ * Runs from wakeup_queue(), which is never called on an IRQ (IRQ producers hand their wakeups to a tasklet, see spscring.cpp).
+ * It can still preempt a task that is going through the ready list, hence the IRQ_OFF:
+ */
+static void epoll_cback(wait_cback_t * cb) {
+	epitem_t * item = (epitem_t*)cb->data;
+	eventpoll_t * ep = item->ep;
+
+	IRQ_OFF();
+	if(!item->ready_node.owner)
+		list_append(&ep->ready, &item->ready_node);
+	IRQ_RES();
+	wakeup_queue(ep->wait_queue);
+}
+
+/* (Re)register on the device's queues, and check it right away. Must be called with IRQs off: */
+static void epitem_arm(epitem_t * item) {
+	poll_table_reset(&item->table);
+	int mask = fs_poll(item->file->node, &item->table);
+	if((mask & (item->events | POLLERR | POLLHUP)) && !item->ready_node.owner) {
+		list_append(&item->ep->ready, &item->ready_node);
+		wakeup_queue(item->ep->wait_queue);
+	}
+}
+
+/* Leaves it on ep->interest, for the caller to take it off: */
+static void epitem_free(epitem_t * item) {
+	IRQ_OFF();
+	poll_table_free(&item->table);
+	if(item->ready_node.owner)
+		list_delete(&item->ep->ready, &item->ready_node);
+	list_delete(&item->file->epitems, &item->file_node);
+	IRQ_RES();
+	free(item);
+}
+
+static epitem_t * epitem_find(eventpoll_t * ep, file_t * file, int fd) {
+	foreach(node, ep->interest) {
+		epitem_t * item = (epitem_t*)node->value;
+		if(item->fd == fd && item->file == file)
+			return item;
+	}
+	return 0;
+}
+
+/*************************/
+/**** The epoll FILE: ****/
+/*************************/
+
+/* An epoll descriptor is readable while its ready list isn't empty (so it can be polled, or nested): */
+static int epoll_file_poll(FILE * node, poll_table_t * table) {
+	eventpoll_t * ep = (eventpoll_t*)node->device;
+	poll_wait(ep->wait_queue, table);
+	return ep->ready.length ? POLLIN : 0;
+}
+
+static uint32_t epoll_file_close(FILE * node) {
+	eventpoll_t * ep = (eventpoll_t*)node->device;
+	IRQ_OFF(); /* Against the watched files going away meanwhile (epoll_file_release) */
+	foreach(item, ep->interest)
+		epitem_free((epitem_t*)item->value);
+	list_free(ep->interest);
+	IRQ_RES();
+	free(ep->interest);
+	wakeup_queue(ep->wait_queue);
+	free(ep->wait_queue);
+	free(ep);
+	return 0;
+}
+
+static eventpoll_t * epoll_get(int epfd) {
+	FILE * node = task_get_fd((task_t*)current_task, epfd);
+	return node && node->close == epoll_file_close ? (eventpoll_t*)node->device : 0;
+}
+
+/* The last descriptor to 'file' is being closed. Called by file_put: */
+void epoll_file_release(file_t * file) {
+	IRQ_OFF();
+	while(file->epitems.head) {
+		epitem_t * item = (epitem_t*)file->epitems.head->value;
+		list_delete(item->ep->interest, list_find(item->ep->interest, item));
+		epitem_free(item);
+	}
+	IRQ_RES();
+}
+EXPORT_SYMBOL(epoll_file_release);
+
+/*******************************/
+/**** epoll create/ctl/wait ****/
+/*******************************/
+int epoll_create(void) {
+	eventpoll_t * ep = (eventpoll_t*)malloc(sizeof(eventpoll_t));
+	memset(ep, 0, sizeof(eventpoll_t));
+	ep->interest = list_create();
+	ep->wait_queue = list_create();
+
+	FILE * node = (FILE*)malloc(sizeof(FILE));
+	memset(node, 0, sizeof(FILE));
+	sprintf(node->name, "%s", "[epoll]");
+	node->flags = FS_CHARDEV;
+	node->refcount = 1;
+	node->device = ep;
+	node->poll = epoll_file_poll;
+	node->close = epoll_file_close;
+
+	int fd = task_append_fd((task_t*)current_task, node);
+	if(fd < 0)
+		fclose(node); /* Out of descriptors */
+	return fd;
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event * event) {
+	eventpoll_t * ep = epoll_get(epfd);
+	file_t * file = task_get_file((task_t*)current_task, fd);
+	if(!ep || !file) return -EBADF;
+	if(file->node->device == ep) return -EINVAL; /* Watching itself */
+	if(op != EPOLL_CTL_DEL && !event) return -EFAULT;
+
+	epitem_t * item = epitem_find(ep, file, fd);
+
+	switch(op) {
+	case EPOLL_CTL_ADD:
+		if(item) return -EEXIST;
+		item = (epitem_t*)malloc(sizeof(epitem_t));
+		memset(item, 0, sizeof(epitem_t));
+		item->ep = ep;
+		item->file = file;
+		item->fd = fd;
+		item->events = event->events;
+		item->data = event->data;
+		item->ready_node.value = item;
+		item->file_node.value = item;
+		poll_table_init(&item->table, 0, epoll_cback, item);
+		list_insert(ep->interest, item);
+		IRQ_OFF();
+		list_append(&file->epitems, &item->file_node);
+		epitem_arm(item);
+		IRQ_RES();
+		return 0;
+	case EPOLL_CTL_MOD:
+		if(!item) return -ENOENT;
+		IRQ_OFF();
+		item->events = event->events;
+		item->data = event->data;
+		epitem_arm(item);
+		IRQ_RES();
+		return 0;
+	case EPOLL_CTL_DEL:
+		if(!item) return -ENOENT;
+		list_delete(ep->interest, list_find(ep->interest, item));
+		epitem_free(item);
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/* Collects up to 'maxevents' from the ready list. Never looks at the idle descriptors: */
+static int epoll_harvest(eventpoll_t * ep, struct epoll_event * events, int maxevents) {
+	int n = 0;
+	IRQ_OFF();
+	/* Level-triggered items go back to the tail, so stop after one lap: */
+	for(size_t lap = ep->ready.length; lap && n < maxevents; lap--) {
+		epitem_t * item = (epitem_t*)list_dequeue(&ep->ready)->value;
+
+		/* Registering again before reading the state, so that no wakeup can slip in between: */
+		poll_table_reset(&item->table);
+		int mask = fs_poll(item->file->node, &item->table) & (item->events | POLLERR | POLLHUP);
+		if(!mask)
+			continue; /* Not ready anymore. It's armed, and will come back when it is */
+
+		events[n].events = mask;
+		events[n].data = item->data;
+		n++;
+
+		/* Level-triggered items are reported until they're not ready. Edge-triggered ones wait for the next wakeup: */
+		if(!(item->events & EPOLLET))
+			list_append(&ep->ready, &item->ready_node);
+	}
+	IRQ_RES();
+	return n;
+}
+
+/* timeout is in milliseconds, like poll's */
+int epoll_wait(int epfd, struct epoll_event * events, int maxevents, int timeout) {
+	eventpoll_t * ep = epoll_get(epfd);
+	if(!ep) return -EBADF;
+	if(maxevents <= 0) return -EINVAL;
+	if(!events) return -EFAULT;
+
+	/* Items can fire and then turn out not to be ready, so the deadline is set once, for every round: */
+	unsigned long seconds = 0, subseconds = 0;
+	if(timeout > 0) {
+		if(poll_timer_init())
+			poll_deadline(timeout, &seconds, &subseconds);
+		else
+			timeout = 0; /* There's no clock to wake us up */
+	}
+
+	poll_table_t table;
+	poll_table_init(&table, (task_t*)current_task, 0, 0);
+
+	int n;
+	for(;;) {
+		n = epoll_harvest(ep, events, maxevents);
+		if(n || !timeout)
+			break;
+
+		IRQ_OFF();
+		if(ep->ready.length) {
+			IRQ_RES();
+			continue; /* Something fired meanwhile */
+		}
+		if(timeout > 0 && poll_expired(seconds, subseconds)) {
+			IRQ_RES();
+			break;
+		}
+
+		/* Sleep until the ready list fills up (or the timer goes off): */
+		poll_wait(ep->wait_queue, &table);
+		if(timeout > 0)
+			sleep_until(table.task, seconds, subseconds);
+		switch_task(0);
+		sleep_cancel(table.task); /* In case the queue beat the timer */
+		IRQ_RES();
+
+		poll_table_reset(&table);
+		if(current_task->signal_queue->length) {
+			n = -EINTR;
+			break;
+		}
+	}
+
+	poll_table_free(&table);
+	return n;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <libc/list.h>
 
 /***********************************************************/
 /************* VFS Macros / struct definitions *************/
@@ -19,6 +20,12 @@
 #define O_EXCL     0x0800
 #define O_NOFOLLOW 0x1000
 #define O_PATH     0x2000
+#define O_NONBLOCK 0x4000
+
+/* fcntl() commands, and the only descriptor flag there is: */
+#define F_GETFD    1
+#define F_SETFD    2
+#define FD_CLOEXEC 1
 
 enum FS_FLAGS {
 	FS_FILE       = 0x01,
@@ -27,7 +34,9 @@ enum FS_FLAGS {
 	FS_BLOCKDEV   = 0x08,
 	FS_PIPE       = 0x10,
 	FS_SYMLINK    = 0x20,
-	FS_MOUNTPOINT = 0x40
+	FS_MOUNTPOINT = 0x40,
+	FS_DCACHE     = 0x80, /* Directory whose lookups the dentry cache can keep (see dcache.cpp) */
+	FS_INODE      = 0x100 /* The one in-memory node of its (device, inode), shared by everyone using it (see dcache.cpp) */
 };
 
 #define _IFMT   0170000 /* type of file */
@@ -39,6 +48,98 @@ enum FS_FLAGS {
 #define _IFSOCK 0140000 /* socket */
 #define _IFIFO  0010000 /* fifo */
 
+/* poll() events: */
+#define POLLIN   0x001 /* There is data to read */
+#define POLLPRI  0x002 /* There is urgent data to read */
+#define POLLOUT  0x004 /* Writing now will not block */
+#define POLLERR  0x008 /* Error condition (always reported) */
+#define POLLHUP  0x010 /* The other end hung up (always reported) */
+#define POLLNVAL 0x020 /* Invalid file descriptor (always reported) */
+
+struct pollfd {
+	int fd;
+	short events;  /* Requested events */
+	short revents; /* Returned events */
+};
+
+/* epoll events are the POLL* ones, plus: */
+#define EPOLLIN  POLLIN
+#define EPOLLPRI POLLPRI
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLLET  0x80000000 /* Edge-triggered: only report changes, not the state */
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+struct epoll_event {
+	uint32_t events;
+	uint32_t data; /* Handed back as is */
+};
+
+/* splice() flags: */
+#define SPLICE_F_MOVE     1 /* Accepted but ignored, pages are never stolen */
+#define SPLICE_F_NONBLOCK 2 /* Don't block waiting for input */
+#define SPLICE_F_MORE     4 /* Accepted but ignored */
+
+/* The syscall only gets 5 registers, so splice()'s arguments are passed by reference: */
+struct splice_args {
+	int fd_in;
+	uint32_t * off_in;
+	int fd_out;
+	uint32_t * off_out;
+	uint32_t len;
+	unsigned int flags;
+};
+
+/* Scatter/gather element (readv, writev, preadv, pwritev): */
+struct iovec {
+	void * iov_base;
+	uint32_t iov_len;
+};
+#define IOV_MAX 1024
+
+/* select() descriptor sets: */
+#define FD_SETSIZE 64
+typedef struct {
+	uint32_t fds_bits[FD_SETSIZE / 32];
+} fd_set;
+#define FD_ZERO(set)    do { for(int __i = 0; __i < FD_SETSIZE / 32; __i++) (set)->fds_bits[__i] = 0; } while(0)
+#define FD_SET(fd, set)   ((set)->fds_bits[(fd) / 32] |=  (1 << ((fd) % 32)))
+#define FD_CLR(fd, set)   ((set)->fds_bits[(fd) / 32] &= ~(1 << ((fd) % 32)))
+#define FD_ISSET(fd, set) ((set)->fds_bits[(fd) / 32] &   (1 << ((fd) % 32)))
+
+struct timeval {
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+};
+
+/* Opaque. Collects the wait queues a poll callback registers on (see poll.cpp) */
+typedef struct poll_table poll_table_t;
+
+/* Readahead state of a node. All in page indices: */
+typedef struct {
+	uint32_t prev_index; /* Last page read */
+	uint32_t ahead;      /* Readahead has been queued up to here */
+	uint32_t window;     /* Pages per request. 0 while the access isn't sequential */
+} file_ra_t;
+
+/* Page cache counters (/dev/pagecache): */
+typedef struct {
+	uint32_t pages;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t writebacks;
+	uint32_t ra_requests; /* Windows queued up */
+	uint32_t ra_pages;    /* Pages brought in by readahead */
+	uint32_t ra_hits;     /* ...which were read afterwards */
+	uint32_t ra_wasted;   /* ...which were evicted before that */
+	uint32_t ra_shrinks;  /* Windows halved by random access */
+} pagecache_stats_t;
+
 
 
 /************************/
@@ -54,16 +155,17 @@ typedef struct fs_node {
 	uint32_t inode;      /* Inode number */
 	uint32_t size;       /* Size of the file, in bytes */
 	uint32_t impl;       /* Used to keep track which filesystem it belongs to */
-	uint32_t open_flags; /* Flags passed to open (read/write/append, etc.) */
+	uint32_t open_flags; /* Flags passed to the last open. Descriptors keep their own in their file_t */
 
 	uint32_t atime; /* Accessed time */
 	uint32_t mtime; /* Modified time */
 	uint32_t ctime; /* Created time */
 
 	struct fs_node * ptr; /* Alias pointer, for symlinks. */
-	uint32_t offset;
-	int32_t refcount;
+	int32_t refcount;     /* Atomic. -1 for nodes that are never freed (mounts) */
 	uint32_t nlink;
+	file_ra_t ra;         /* Readahead state (pagecache.cpp) */
+	node_t inode_node;    /* On the dentry cache's inode table, while FS_INODE */
 
 	/*********************** Callbacks/file operations**************/
 	/**** CRUD ****/
@@ -82,8 +184,28 @@ typedef struct fs_node {
 	void (*unlink) (struct fs_node *, char *name);
 	void (*symlink) (struct fs_node *, char * name, char * value);
 	int (*readlink) (struct fs_node *, char * buf, size_t size);
+	/* Returns the POLL* events ready right now, and registers on the wait queues that will signal a change (with poll_wait): */
+	int (*poll) (struct fs_node *, poll_table_t * table);
+	/* Memory backed nodes only: points 'addr' straight at the bytes at 'offset' and returns how many of them are contiguous there (read-only): */
+	uint32_t (*peek) (struct fs_node *, uint32_t offset, uint32_t size, uint8_t ** addr);
+	/* Optional. Called after every successful peek, once the bytes it pointed at aren't used anymore: */
+	void (*unpeek) (struct fs_node *);
+	/* Optional. Takes the whole vector at once (from 'offset' on), instead of one read/write per element: */
+	int (*readv) (struct fs_node *, uint32_t offset, const struct iovec * iov, int iovcnt);
+	int (*writev) (struct fs_node *, uint32_t offset, const struct iovec * iov, int iovcnt);
+	/* Optional. Writes back whatever the filesystem still holds in memory for the node: */
+	int (*fsync) (struct fs_node *);
 } FILE;
 
+/* An open file, as a descriptor refers to it. dup and fork share it, every open() gets a new one: */
+typedef struct file_handle {
+	FILE * node;         /* Holds a reference */
+	uint32_t offset;
+	uint32_t open_flags;
+	int32_t refcount;    /* Atomic */
+	list_t epitems;      /* The epoll items watching it (epoll.cpp). They go away with it */
+} file_t;
+
 /** Directory entry **/
 struct dirent {
 	char name[128]; /* Directory name */
@@ -111,8 +233,17 @@ struct stat {
 struct vfs_entry {
 	char * name;
 	FILE * file;
+	uint32_t hash;    /* Of the name (see path_next) */
+	node_t hash_node; /* On the mount table, by (parent, name). Its value is the entry's tree node */
 };
 
+/* One component of a path, as path_next finds it. Points into the path, so it isn't NUL terminated: */
+typedef struct {
+	const char * name;
+	uint32_t len;
+	uint32_t hash;
+} path_comp_t;
+
 
 /****************************************************************/
 /************* VFS Installers/Initializers/Mounters *************/
@@ -134,6 +265,14 @@ extern void map_vfs_directory(char * c);
 /*****************************************/
 extern uint32_t fread(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer);
 extern uint32_t fwrite(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+extern int fs_readv(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt);
+extern int fs_writev(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt);
+extern int readv(int fd, const struct iovec * iov, int iovcnt);
+extern int writev(int fd, const struct iovec * iov, int iovcnt);
+extern int preadv(int fd, const struct iovec * iov, int iovcnt, uint32_t offset);
+extern int pwritev(int fd, const struct iovec * iov, int iovcnt, uint32_t offset);
+extern int fsync(int fd);
+extern int sync(void);
 extern uint32_t fopen(FILE * node, unsigned int flags);
 extern uint32_t fclose(FILE * node);
 extern struct dirent * fs_readdir(FILE * node, uint32_t index);
@@ -144,13 +283,52 @@ extern int fs_mkdir(char * dirname, uint16_t permission);
 extern int fs_create_file(char * filename, uint16_t permission);
 extern FILE * kopen(char * filename, uint32_t flags);
 extern char * canonicalize_path(char * cwd, char * input);
+extern char path_next(const char ** cursor, path_comp_t * comp);
 extern FILE * fs_clone(FILE * source);
+extern file_t * file_create(FILE * node, uint32_t flags);
+extern file_t * file_get(file_t * file);
+extern void file_put(file_t * file);
 extern int fs_ioctl(FILE * node, int request, void * argp);
 extern int fs_chmod(FILE * node, int mode);
 extern int fs_unlink(char * filename);
 extern int fs_symlink(char * target, char * filename);
 extern int fs_readlink(FILE * node, char * buff, size_t size);
+extern int fs_fsync(FILE * node);
+extern void fs_sync(void);
 extern int pty_create(void * size, FILE ** fs_master, FILE ** fs_slave);
 
+/** Readiness (poll.cpp and epoll.cpp): **/
+extern int fs_poll(FILE * node, poll_table_t * table);
+extern void poll_wait(list_t * queue, poll_table_t * table);
+extern int poll(struct pollfd * fds, uint32_t nfds, int timeout);
+extern int select(int nfds, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout);
+extern int epoll_create(void);
+extern int epoll_ctl(int epfd, int op, int fd, struct epoll_event * event);
+extern int epoll_wait(int epfd, struct epoll_event * events, int maxevents, int timeout);
+extern void epoll_file_release(file_t * file);
+
+/** Page cache (pagecache.cpp): **/
+extern char pagecache_cacheable(FILE * node);
+extern uint32_t pagecache_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+extern int pagecache_readv(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt);
+extern int pagecache_write(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+extern uint32_t pagecache_size(FILE * node);
+extern void pagecache_sync(FILE * node);
+extern void pagecache_sync_all(void);
+extern void pagecache_writeback(unsigned long age);
+extern void pagecache_truncate(FILE * node, uint32_t size);
+extern void pagecache_get_stats(pagecache_stats_t * stats);
+extern void pagecache_install(void);
+
+/** Dentry and inode cache (dcache.cpp): **/
+extern FILE * dcache_get(FILE * parent, char * name);
+extern void dcache_invalidate(FILE * parent, char * name);
+extern void dcache_forget(FILE * node);
+
+/** In-kernel transfers (splice.cpp): **/
+extern int fs_splice(FILE * in, uint32_t * in_pos, FILE * out, uint32_t * out_pos, uint32_t len, unsigned int flags);
+extern int splice(int fd_in, uint32_t * off_in, int fd_out, uint32_t * off_out, uint32_t len, unsigned int flags);
+extern int sendfile(int out_fd, int in_fd, uint32_t * offset, uint32_t count);
+
 /** Virtual Filesystem Root: **/
 extern FILE * fs_root;
@@ -34,6 +34,15 @@ static uint32_t initrd_read(FILE * node, uint32_t offset, uint32_t size, uint8_t
 	return size;
 }
 
+/* The whole initrd sits in memory, so splice can write straight out of it: */
+static uint32_t initrd_peek(FILE * node, uint32_t offset, uint32_t size, uint8_t ** addr) {
+	if(offset >= node->size) return 0;
+	if(size > node->size - offset) size = node->size - offset;
+
+	*addr = (uint8_t*)fs_getfile_addr(node) + offset;
+	return size;
+}
+
 static struct dirent * initrd_readdir(FILE * node, uint32_t index) {
 	if (index > initrd_header->file_count) return 0;
 
@@ -67,6 +76,8 @@ FILE * initrd_init(uint32_t location) {
 	initrd_root->write = 0;
 	initrd_root->open = 0;
 	initrd_root->close = 0;
+	initrd_root->poll = 0;
+	initrd_root->peek = 0;
 
 	initrd_root->readdir = &initrd_readdir;
 	initrd_root->finddir = &initrd_finddir;
@@ -89,6 +100,8 @@ FILE * initrd_init(uint32_t location) {
 		root_files[i].finddir = 0;
 		root_files[i].open = 0;
 		root_files[i].close = 0;
+		root_files[i].poll = 0;
+		root_files[i].peek = &initrd_peek;
 
 		if(Log::logging == Log::LOG_SERIAL) {
 			kprintf("\n   * File %d (@0x%x > @0x%x): %s", i+1,
@@ -42,6 +42,8 @@
 #define list_create() FCASTF(SYF("list_create"), list_t *, void)()
 #define list_insert(list, item) FCASTF(SYF("list_insert"), node_t *, list_t *, void *)(list, item)
 #define list_free(list) FCASTF(SYF("list_free"), void, list_t *)(list)
+#define list_append(list, node) FCASTF(SYF("list_append"), void, list_t *, node_t *)(list, node)
+#define list_delete(list, node) FCASTF(SYF("list_delete"), void, list_t *, node_t *)(list, node)
 
 #define hashmap_create(count) FCASTF(SYF("hashmap_create"), hashmap_t *, int)(count)
 #define hashmap_set(map, key, value) FCASTF(SYF("hashmap_set"), void *, hashmap_t *, void *, void *)(map, key, value)
@@ -69,11 +71,17 @@
 #define sprintf(buf, fmt, ...) FCASTF(SYF("sprintf"), int, char *, char *, ...)(buf, fmt, __VA_ARGS__)
 
 #define ring_buffer_unread(ring_buffer) FCASTF(SYF("ring_buffer_unread"), size_t, ring_buffer_t *)(ring_buffer)
+#define ring_buffer_available(ring_buffer) FCASTF(SYF("ring_buffer_available"), size_t, ring_buffer_t *)(ring_buffer)
 #define ring_buffer_read(ring_buffer, size, buffer) FCASTF(SYF("ring_buffer_read"), size_t, ring_buffer_t *, size_t, uint8_t*)(ring_buffer, size, buffer)
 #define ring_buffer_write(ring_buffer, size, buffer) FCASTF(SYF("ring_buffer_write"), size_t, ring_buffer_t *, size_t, uint8_t*)(ring_buffer, size, buffer)
+#define ring_buffer_poll(ring_buffer, table) FCASTF(SYF("ring_buffer_poll"), int, ring_buffer_t *, poll_table_t *)(ring_buffer, table)
 #define ring_buffer_interrupt(ring_buffer) FCASTF(SYF("ring_buffer_interrupt"), void, ring_buffer_t *)(ring_buffer)
 #define ring_buffer_create(size) FCASTF(SYF("ring_buffer_create"), ring_buffer_t *, size_t)(size)
 
+#define spsc_ring_unread(ring) FCASTF(SYF("spsc_ring_unread"), size_t, spsc_ring_t *)(ring)
+#define spsc_ring_push(ring, data, size) FCASTF(SYF("spsc_ring_push"), char, spsc_ring_t *, uint8_t *, size_t)(ring, data, size)
+#define spsc_ring_make_file(size) FCASTF(SYF("spsc_ring_make_file"), FILE *, size_t)(size)
+
 #define IRQ_OFF() SYC("int_disable")
 #define IRQ_RES() SYC("int_resume")
 #define IRQ_ON()  SYC("int_enable")
@@ -95,6 +103,7 @@
 #define fs_readdir(node, index) FCASTF(SYF("fs_readdir"), struct dirent *, FILE *, uint32_t)(node, index)
 #define fs_finddir(node, name) FCASTF(SYF("fs_finddir"), FILE *, FILE *, char *)(node, name)
 #define fs_filesize(node) FCASTF(SYF("fs_filesize"), uint32_t, FILE *)(node)
+#define pagecache_writeback(age) FCASTF(SYF("pagecache_writeback"), void, unsigned long)(age)
 #define fs_is_dir(node) FCASTF(SYF("fs_is_dir"), char, FILE *)(node)
 #define fs_mkdir(dirname, permission) FCASTF(SYF("fs_mkdir"), int, char *, uint16_t)(dirname, permission)
 #define fs_create_file(filename, permission) FCASTF(SYF("fs_create_file"), int, char *, uint16_t)(filename, permission)
@@ -106,6 +115,8 @@
 #define fs_unlink(filename) FCASTF(SYF("fs_unlink"), int, char *)(filename)
 #define fs_symlink(target, filename) FCASTF(SYF("fs_symlink"), int, char *, char *)(target, filename)
 #define fs_readlink(node, buff, size) FCASTF(SYF("fs_readlink"), int, FILE *, char *, size_t)(node, buff, size)
+#define fs_poll(node, table) FCASTF(SYF("fs_poll"), int, FILE *, poll_table_t *)(node, table)
+#define poll_wait(queue, table) FCASTF(SYF("poll_wait"), void, list_t *, poll_table_t *)(queue, table)
 
 /* Tasking library functions: */
 #define switch_task(new_process_state) FCASTF(SYF("switch_task"), void, status_t)(new_process_state)
@@ -113,7 +124,10 @@
 #define task_clone(new_stack, thread_function, arg) FCASTF(SYF("task_clone"), uint32_t, uintptr_t, uintptr_t, uintptr_t)(new_stack, thread_function, arg)
 #define task_create_tasklet(tasklet, name, argp) FCASTF(SYF("task_create_tasklet"), int, tasklet_t, char *, void *)(tasklet, name, argp)
 #define wakeup_queue(queue) FCASTF(SYF("wakeup_queue"), int, list_t *)(queue)
+#define wakeup_queue_one(queue) FCASTF(SYF("wakeup_queue_one"), int, list_t *)(queue)
+#define wakeup_queue_nr(queue, nr_exclusive) FCASTF(SYF("wakeup_queue_nr"), int, list_t *, int)(queue, nr_exclusive)
 #define sleep_on(queue) FCASTF(SYF("sleep_on"), int, list_t *)(queue)
+#define sleep_on_exclusive(queue) FCASTF(SYF("sleep_on_exclusive"), int, list_t *)(queue)
 #define sleep_until(task, seconds, subseconds) FCASTF(SYF("sleep_until"), void, task_t*, unsigned long, unsigned long)(task, seconds, subseconds)
 #define kexit(retval) FCASTF(SYF("kexit"), void, int)(retval)
 #define current_task_get() FCASTF(SYF("current_task_get"), task_t*, void)()
@@ -7,6 +7,7 @@
 #include <fs.h>
 #include <version/version.h>
 #include <elf.h>
+#include <modules/fs/ext2.h>
 
 namespace Kernel {
 	namespace KInit {
@@ -195,6 +196,9 @@ namespace Kernel {
 		kputs("> Mounting EXT2 filesystem into / - ");
 		if(!vfs_mount_type((char*)"ext2", (char*)"/dev/hda", (char*)"/")) { kprintf("\t>> "); DEBUGOK(); }
 		else { DEBUGBAD(); }
+		kputs("> Mounting tmpfs into /tmp - ");
+		if(!vfs_mount_type((char*)"tmpfs", (char*)"size=16M", (char*)"/tmp")) { kprintf("\t>> "); DEBUGOK(); }
+		else { DEBUGBAD(); }
 
 		/* Initialize multitasking: */
 		kputs("> Initializing multitasking - "); tasking_install(); DEBUGOK();
@@ -204,6 +208,8 @@ namespace Kernel {
 
 		/* Initialize shared memory: */
 		kputs("> Initializing shared memory - "); shm_install(); DEBUGOK();
+		kputs("> Initializing page cache - "); pagecache_install(); DEBUGOK();
+		kputs("> Starting EXT2 writeback - "); MOD_IOCTL("ext2_driver", EXT2_IOCTL_WRITEBACK_START); DEBUGOK();
 
 		/* TODO: Finish the usermode code. We will require drivers and more infrastructure,
 		 * such as EXT2, VFS, ATA, ELF, etc, so that we can actually jump into user code  */
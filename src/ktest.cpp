@@ -17,9 +17,49 @@
 #include <elf.h>
 #include <modules/mouse/mouse.h>
 #include <modules/sound/speaker.h>
+#include <modules/fs/pipe.h>
 
 namespace Kernel {
 
+/*********** Pipe bandwidth benchmark: ***********/
+#define PIPE_BENCH_SIZE  (4 * 1024 * 1024) /* Bytes pushed through the pipe */
+#define PIPE_BENCH_CHUNK 4096              /* Size of every read/write, and of the pipe itself */
+
+static void pipe_bench_writer(void * argp, char * name) {
+	FILE * pipe = (FILE*)argp;
+	uint8_t * chunk = (uint8_t*)malloc(PIPE_BENCH_CHUNK);
+	memset(chunk, 0xAA, PIPE_BENCH_CHUNK);
+	for(uint32_t sent = 0; sent < PIPE_BENCH_SIZE; sent += PIPE_BENCH_CHUNK)
+		fwrite(pipe, 0, PIPE_BENCH_CHUNK, chunk);
+	free(chunk);
+	fclose(pipe);
+}
+
+/* A tasklet writes into the pipe while we read it out, and the PIT times it: */
+static void test_pipe_bandwidth(FILE * pit_file) {
+	uint32_t * hz = (uint32_t*)symbol_find((char*)"timer_hz");
+	if(!pit_file || !hz || !*hz) return;
+
+	FILE * pipe = make_pipe(PIPE_BENCH_CHUNK);
+	if(!pipe) return;
+	fopen(pipe, 0);
+	uint8_t * chunk = (uint8_t*)malloc(PIPE_BENCH_CHUNK);
+
+	uint32_t start_ticks    = fs_ioctl(pit_file, 3, 0);
+	uint32_t start_subticks = fs_ioctl(pit_file, 4, 0);
+	task_create_tasklet(pipe_bench_writer, (char*)"[pipe_bench]", fs_clone(pipe)); /* The writer might still be in there when we're done */
+	for(uint32_t received = 0; received < PIPE_BENCH_SIZE;)
+		received += fread(pipe, 0, PIPE_BENCH_CHUNK, chunk);
+	uint32_t ticks    = fs_ioctl(pit_file, 3, 0);
+	uint32_t subticks = fs_ioctl(pit_file, 4, 0);
+
+	int32_t elapsed_ms = (ticks - start_ticks) * 1000 + ((int32_t)subticks - (int32_t)start_subticks) * 1000 / (int32_t)*hz;
+	if(elapsed_ms <= 0) elapsed_ms = 1;
+	kprintf("\nPipe bandwidth: %d KB in %d ms (%d KB/s)\n", PIPE_BENCH_SIZE / 1024, elapsed_ms, (PIPE_BENCH_SIZE / 1024) * 1000 / elapsed_ms);
+	free(chunk);
+	fclose(pipe);
+}
+
 void test_kernel(void) {
 	/***************************************************/
 	/***************************************************/
@@ -51,18 +91,32 @@ void test_kernel(void) {
 	uint8_t * serial_buff;
 	if(serial_file) serial_buff = (uint8_t*)malloc(SERIAL_CBACK_BUFFER_SIZE);
 
+	/*********** Test pipes (only with the "pipe_bench" kernel argument, it pushes megabytes through): ***********/
+	if(args_present((char*)"pipe_bench"))
+		test_pipe_bandwidth(pit_file);
+
+	/* Block on every input device at once instead of spinning on their sizes: */
+	enum { POLL_KBD, POLL_MOUSE, POLL_SERIAL };
+	struct pollfd fds[3];
+	task_t * self = current_task_get();
+	fds[POLL_KBD].fd    = kbd_file    ? (int)task_append_fd(self, kbd_file)    : -1;
+	fds[POLL_MOUSE].fd  = mouse_file  ? (int)task_append_fd(self, mouse_file)  : -1;
+	fds[POLL_SERIAL].fd = serial_file ? (int)task_append_fd(self, serial_file) : -1;
+	for(int i = 0; i < 3; i++)
+		fds[i].events = POLLIN;
+
 	for(;;) {
+		/* Wake up every 100ms anyway to refresh the clocks: */
+		poll(fds, 3, 100);
+
 		/* Echo serial comm back: */
-		if(serial.is_ready() && serial_file) {
+		if(fds[POLL_SERIAL].revents & POLLIN) {
 #if 0
 			/* The normal way to access the serial COM: */
 			kprintf("%c", serial.read_async());
 #else
 			/* Using the VFS: */
-			int size;
-			MOD_IOCTLD("pipe_driver", size, 1, (uintptr_t)serial_file);
-			if(size) {
-				fread(serial_file, 0, size, serial_buff);
+			if(fread(serial_file, 0, SERIAL_CBACK_BUFFER_SIZE, serial_buff)) {
 				kprintf("%c", serial_buff[0]);
 				serial.flush();
 			}
@@ -70,11 +124,8 @@ void test_kernel(void) {
 		}
 
 		/* Echo keyboard back: */
-		if(kbd_file) {
-			int size;
-			MOD_IOCTLD("pipe_driver", size, 1, (uintptr_t)kbd_file);
-			if(size) {
-				fread(kbd_file, 0, size, kbd_buff);
+		if(fds[POLL_KBD].revents & POLLIN) {
+			if(fread(kbd_file, 0, 128, kbd_buff)) {
 				kprintf("%c", kbd_buff[0]);
 
 				if(kbd_buff[0] == 'r') {
@@ -93,11 +144,8 @@ void test_kernel(void) {
 		}
 
 		/* Show Mouse data: */
-		if(mouse_file) {
-			int size;
-			MOD_IOCTLD("pipe_driver", size, 1, (uintptr_t)mouse_file);
-			if(size) {
-				fread(mouse_file, 0, size, mouse_buff);
+		if(fds[POLL_MOUSE].revents & POLLIN) {
+			if(fread(mouse_file, 0, sizeof(mouse_device_packet_t) * MOUSE_PACKETS_IN_PIPE, mouse_buff)) {
 				mouse_device_packet_t * d = (mouse_device_packet_t*)mouse_buff;
 				x += d->x_difference;
 				if(x>80) x=80;
@@ -16,6 +16,12 @@ static inline int strcmp(const char * l, const char * r) {
 	return *(unsigned char *)l - *(unsigned char *)r;
 }
 
+static inline int strncmp(const char * l, const char * r, size_t n) {
+	if (!n) return 0;
+	for (; --n && *l == *r && *l; l++, r++);
+	return *(unsigned char *)l - *(unsigned char *)r;
+}
+
 #ifndef MODULES
 
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
@@ -40,6 +40,7 @@ void list_append(list_t * list, node_t * node) {
 	list->tail = node;
 	list->length++;
 }
+EXPORT_SYMBOL(list_append);
 
 node_t * list_insert(list_t * list, void * item) {
 	/* Insert an item into a list */
@@ -185,6 +186,7 @@ void list_delete(list_t * list, node_t * node) {
 	node->owner = NULL;
 	list->length--;
 }
+EXPORT_SYMBOL(list_delete);
 
 node_t * list_pop(list_t * list) {
 	/* Remove and return the last value in the list
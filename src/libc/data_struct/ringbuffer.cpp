@@ -9,13 +9,7 @@
 #include <module.h>
 
 size_t ring_buffer_unread(ring_buffer_t * ring_buffer) {
-	if (ring_buffer->read_ptr == ring_buffer->write_ptr)
-		return 0;
-	if (ring_buffer->read_ptr > ring_buffer->write_ptr)
-		return (ring_buffer->size - ring_buffer->read_ptr) + ring_buffer->write_ptr;
-	else
-		return (ring_buffer->write_ptr - ring_buffer->read_ptr);
-
+	return ring_buffer->write_ptr - ring_buffer->read_ptr;
 }
 EXPORT_SYMBOL(ring_buffer_unread);
 
@@ -25,50 +19,51 @@ size_t ring_buffer_size(FILE * node) {
 }
 
 size_t ring_buffer_available(ring_buffer_t * ring_buffer) {
-	if (ring_buffer->read_ptr == ring_buffer->write_ptr) {
-		return ring_buffer->size - 1;
-	}
-
-	if (ring_buffer->read_ptr > ring_buffer->write_ptr) {
-		return ring_buffer->read_ptr - ring_buffer->write_ptr - 1;
-	} else {
-		return (ring_buffer->size - ring_buffer->write_ptr) + ring_buffer->read_ptr - 1;
-	}
+	return ring_buffer->size - ring_buffer_unread(ring_buffer);
 }
-
-static inline void ring_buffer_increment_read(ring_buffer_t * ring_buffer) {
-	ring_buffer->read_ptr++;
-	if (ring_buffer->read_ptr == ring_buffer->size) {
-		ring_buffer->read_ptr = 0;
-	}
+EXPORT_SYMBOL(ring_buffer_available);
+
+/* Both copies take at most two memcpy's, one on each side of the wrap around: */
+static inline void ring_buffer_copy_out(ring_buffer_t * ring_buffer, uint8_t * buffer, size_t size) {
+	size_t index = ring_buffer->read_ptr & (ring_buffer->size - 1);
+	size_t first = size < ring_buffer->size - index ? size : ring_buffer->size - index;
+	memcpy(buffer, ring_buffer->buffer + index, first);
+	if (first < size)
+		memcpy(buffer + first, ring_buffer->buffer, size - first);
+	ring_buffer->read_ptr += size;
 }
 
-static inline void ring_buffer_increment_write(ring_buffer_t * ring_buffer) {
-	ring_buffer->write_ptr++;
-	if (ring_buffer->write_ptr == ring_buffer->size) {
-		ring_buffer->write_ptr = 0;
-	}
+static inline void ring_buffer_copy_in(ring_buffer_t * ring_buffer, uint8_t * buffer, size_t size) {
+	size_t index = ring_buffer->write_ptr & (ring_buffer->size - 1);
+	size_t first = size < ring_buffer->size - index ? size : ring_buffer->size - index;
+	memcpy(ring_buffer->buffer + index, buffer, first);
+	if (first < size)
+		memcpy(ring_buffer->buffer, buffer + first, size - first);
+	ring_buffer->write_ptr += size;
 }
 
 size_t ring_buffer_read(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer) {
 	size_t collected = 0;
 	while (collected == 0) {
 		spin_lock(ring_buffer->lock);
-		while (ring_buffer_unread(ring_buffer) > 0 && collected < size) {
-			buffer[collected] = ring_buffer->buffer[ring_buffer->read_ptr];
-			ring_buffer_increment_read(ring_buffer);
-			collected++;
-		}
+		collected = ring_buffer_unread(ring_buffer);
+		if (collected > size)
+			collected = size;
+		ring_buffer_copy_out(ring_buffer, buffer, collected);
+		size_t left = ring_buffer_unread(ring_buffer);
 		spin_unlock(ring_buffer->lock);
-		wakeup_queue(ring_buffer->wait_queue_writers);
 		if (collected == 0) {
-			if (sleep_on(ring_buffer->wait_queue_readers) && ring_buffer->internal_stop) {
+			if (sleep_on_exclusive(ring_buffer->wait_queue_readers) && ring_buffer->internal_stop) {
 				ring_buffer->internal_stop = 0;
 				break;
 			}
+		} else if (left) {
+			/* Pass what we left behind on to the next reader: */
+			wakeup_queue_one(ring_buffer->wait_queue_readers);
 		}
 	}
-	wakeup_queue(ring_buffer->wait_queue_writers);
+	if (collected)
+		wakeup_queue_one(ring_buffer->wait_queue_writers);
 	return collected;
 }
 EXPORT_SYMBOL(ring_buffer_read);
@@ -77,31 +72,52 @@ size_t ring_buffer_write(ring_buffer_t * ring_buffer, size_t size, uint8_t * buf
 	size_t written = 0;
 	while (written < size) {
 		spin_lock(ring_buffer->lock);
-
-		while (ring_buffer_available(ring_buffer) > 0 && written < size) {
-			ring_buffer->buffer[ring_buffer->write_ptr] = buffer[written];
-			ring_buffer_increment_write(ring_buffer);
-			written++;
-		}
-
+		size_t chunk = ring_buffer_available(ring_buffer);
+		if (chunk > size - written)
+			chunk = size - written;
+		ring_buffer_copy_in(ring_buffer, buffer + written, chunk);
+		size_t space = ring_buffer_available(ring_buffer);
 		spin_unlock(ring_buffer->lock);
-		wakeup_queue(ring_buffer->wait_queue_readers);
+
+		written += chunk;
+		if (chunk)
+			wakeup_queue_one(ring_buffer->wait_queue_readers);
 		if (written < size) {
-			if (sleep_on(ring_buffer->wait_queue_writers) && ring_buffer->internal_stop) {
+			if (sleep_on_exclusive(ring_buffer->wait_queue_writers) && ring_buffer->internal_stop) {
 				ring_buffer->internal_stop = 0;
 				break;
 			}
+		} else if (space) {
+			/* Pass the room that's left on to the next writer: */
+			wakeup_queue_one(ring_buffer->wait_queue_writers);
 		}
 	}
-
-	wakeup_queue(ring_buffer->wait_queue_readers);
 	return written;
 }
 EXPORT_SYMBOL(ring_buffer_write);
 
+int ring_buffer_poll(ring_buffer_t * ring_buffer, poll_table_t * table) {
+	poll_wait(ring_buffer->wait_queue_readers, table);
+	poll_wait(ring_buffer->wait_queue_writers, table);
+
+	int mask = 0;
+	if (ring_buffer_unread(ring_buffer) > 0)
+		mask |= POLLIN;
+	if (ring_buffer_available(ring_buffer) > 0)
+		mask |= POLLOUT;
+	return mask;
+}
+EXPORT_SYMBOL(ring_buffer_poll);
+
 ring_buffer_t * ring_buffer_create(size_t size) {
 	ring_buffer_t * out = (ring_buffer_t*)malloc(sizeof(ring_buffer_t));
 
+	/* Round up to a power of two, for the index masks: */
+	size_t pow2 = 1;
+	while (pow2 < size)
+		pow2 <<= 1;
+	size = pow2;
+
 	out->buffer    = (unsigned char *)malloc(size);
 	out->write_ptr = 0;
 	out->read_ptr  = 0;
@@ -0,0 +1,191 @@
+/*
+ * spscring.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+#include <libc/spscring.h>
+#include <system.h>
+#include <module.h>
+#include <errno.h>
+
+/*
+ * x86 doesn't reorder stores with other stores, nor loads with other loads,
+ * so keeping the compiler from doing it is all the ordering we need:
+ */
+#define spsc_barrier() asm volatile("" ::: "memory")
+
+/* Every ring, for the wakeup tasklet to look at: */
+static list_t * spsc_rings = 0;
+static task_t * spsc_wakeup_task = 0;
+static volatile char spsc_pending = 0; /* Some ring got data since the tasklet last looked */
+static volatile char spsc_parked = 0;  /* The tasklet is descheduled, waiting for spsc_pending */
+
+/*************************/
+/**** Deferred wakeup ****/
+/*************************/
+
+/*
+ * The producers run in IRQ context, where wakeup_queue can't be called (it takes locks, and a contended
+ * lock switches tasks, besides running the wait callbacks). So they only flag the ring and make this tasklet
+ * ready, the way the timer readies sleepers, and the tasklet wakes the readers up. It's off every queue in between
+ */
+static void spsc_wakeup_worker(void * arg, char * name) {
+	for(;;) {
+		IRQ_OFF();
+		if(!spsc_pending) {
+			spsc_parked = 1;
+			switch_task(0);
+			spsc_parked = 0;
+		}
+		spsc_pending = 0;
+		IRQ_RES();
+
+		foreach(it, spsc_rings) {
+			spsc_ring_t * ring = (spsc_ring_t*)it->value;
+			if(__sync_lock_test_and_set(&ring->pending, 0) && ring->wait_queue->length)
+				wakeup_queue(ring->wait_queue);
+		}
+	}
+}
+
+/* Producer side: the ring got data. Runs in the IRQ handler (IRQs off), and readies the tasklet at most once per batch */
+static void spsc_wakeup_kick(spsc_ring_t * ring) {
+	ring->pending = 1;
+	if(!spsc_pending) {
+		spsc_pending = 1;
+		if(spsc_parked) {
+			spsc_parked = 0;
+			make_task_ready(spsc_wakeup_task);
+		}
+	}
+}
+
+/* Called by whoever's about to sleep on a ring, before it does so. Must be called with the IRQs off */
+static void spsc_wakeup_arm(void) {
+	if(!spsc_wakeup_task) {
+		int pid = task_create_tasklet(spsc_wakeup_worker, (char*)"[spsc-wakeup]", 0);
+		spsc_wakeup_task = task_from_pid(pid);
+	}
+}
+
+spsc_ring_t * spsc_ring_create(size_t size) {
+	/* Round up to a power of two, for the index masks: */
+	size_t pow2 = 1;
+	while (pow2 < size)
+		pow2 <<= 1;
+
+	spsc_ring_t * ring = (spsc_ring_t*)malloc(sizeof(spsc_ring_t));
+	ring->buffer     = (uint8_t*)malloc(pow2);
+	ring->size       = pow2;
+	ring->head       = 0;
+	ring->tail       = 0;
+	ring->dropped    = 0;
+	ring->pending    = 0;
+	ring->wait_queue = list_create();
+
+	IRQ_OFF();
+	if(!spsc_rings)
+		spsc_rings = list_create();
+	list_insert(spsc_rings, ring);
+	IRQ_RES();
+	return ring;
+}
+EXPORT_SYMBOL(spsc_ring_create);
+
+size_t spsc_ring_unread(spsc_ring_t * ring) {
+	return ring->head - ring->tail;
+}
+EXPORT_SYMBOL(spsc_ring_unread);
+
+/* Producer side. All or nothing, so that fixed size records (mouse packets) never get split: */
+char spsc_ring_push(spsc_ring_t * ring, uint8_t * data, size_t size) {
+	size_t head = ring->head;
+	if (ring->size - (head - ring->tail) < size) {
+		ring->dropped += size;
+		return 0;
+	}
+
+	size_t index = head & (ring->size - 1);
+	size_t first = size < ring->size - index ? size : ring->size - index;
+	memcpy(ring->buffer + index, data, first);
+	if (first < size)
+		memcpy(ring->buffer, data + first, size - first);
+
+	/* Publish the data before the new head. Whoever's sleeping on it gets woken up by the tasklet: */
+	spsc_barrier();
+	ring->head = head + size;
+	spsc_wakeup_kick(ring);
+	return 1;
+}
+EXPORT_SYMBOL(spsc_ring_push);
+
+/* Consumer side. Never blocks: */
+size_t spsc_ring_pop(spsc_ring_t * ring, uint8_t * buffer, size_t size) {
+	size_t tail = ring->tail;
+	size_t unread = ring->head - tail;
+	spsc_barrier(); /* Read the head before the data it covers */
+	if (size > unread)
+		size = unread;
+
+	size_t index = tail & (ring->size - 1);
+	size_t first = size < ring->size - index ? size : ring->size - index;
+	memcpy(buffer, ring->buffer + index, first);
+	if (first < size)
+		memcpy(buffer + first, ring->buffer, size - first);
+
+	/* Done reading before handing the space back: */
+	spsc_barrier();
+	ring->tail = tail + size;
+	return size;
+}
+EXPORT_SYMBOL(spsc_ring_pop);
+
+/*****************************************************************/
+/**** Device file. Read-only, unless its owner sets a ->write ****/
+/*****************************************************************/
+static uint32_t spsc_ring_file_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	spsc_ring_t * ring = (spsc_ring_t*)node->device;
+	for (;;) {
+		size_t collected = spsc_ring_pop(ring, buffer, size);
+		if (collected || !size)
+			return collected;
+		if (node->open_flags & O_NONBLOCK)
+			return -EAGAIN;
+		/* With the IRQs off the producer can't slip in between the check and the sleep: */
+		IRQ_OFF();
+		if (!spsc_ring_unread(ring)) {
+			spsc_wakeup_arm();
+			sleep_on(ring->wait_queue);
+		}
+		IRQ_RES();
+	}
+}
+
+static int spsc_ring_file_poll(FILE * node, poll_table_t * table) {
+	spsc_ring_t * ring = (spsc_ring_t*)node->device;
+	poll_wait(ring->wait_queue, table);
+	if (table) {
+		IRQ_OFF();
+		spsc_wakeup_arm();
+		IRQ_RES();
+	}
+	return (spsc_ring_unread(ring) ? POLLIN : 0) | (node->write ? POLLOUT : 0);
+}
+
+static int spsc_ring_file_size(FILE * node) {
+	return spsc_ring_unread((spsc_ring_t*)node->device);
+}
+
+FILE * spsc_ring_make_file(size_t size) {
+	FILE * fnode = (FILE*)malloc(sizeof(FILE));
+	memset(fnode, 0, sizeof(FILE));
+	sprintf(fnode->name, "%s", "[spsc]");
+	fnode->flags    = FS_CHARDEV;
+	fnode->read     = spsc_ring_file_read;
+	fnode->poll     = spsc_ring_file_poll;
+	fnode->get_size = spsc_ring_file_size;
+	fnode->device   = spsc_ring_create(size);
+	return fnode;
+}
+EXPORT_SYMBOL(spsc_ring_make_file);
@@ -2,6 +2,7 @@ OBJS += \
 $(BOUT)/hashmap.o \
 $(BOUT)/list.o \
 $(BOUT)/ringbuffer.o \
+$(BOUT)/spscring.o \
 $(BOUT)/tree.o
 
 $(BOUT)/hashmap.o: src/libc/data_struct/hashmap.cpp 
@@ -25,6 +26,13 @@ $(BOUT)/ringbuffer.o: src/libc/data_struct/ringbuffer.cpp
 	@echo '>> Finished building: $<'
 	@echo ' '
 
+$(BOUT)/spscring.o: src/libc/data_struct/spscring.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
 $(BOUT)/tree.o: src/libc/data_struct/tree.cpp 
 	@echo '>> Building file $<'
 	@echo '>> Invoking LLVM C++ Clang++'
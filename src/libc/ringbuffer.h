@@ -14,9 +14,9 @@
 
 typedef struct ring_buffer {
 	unsigned char * buffer;
-	size_t write_ptr;
+	size_t write_ptr; /* Free-running, masked with size - 1 */
 	size_t read_ptr;
-	size_t size;
+	size_t size;      /* Power of two */
 	volatile int lock[2];
 	list_t * wait_queue_readers;
 	list_t * wait_queue_writers;
@@ -29,6 +29,7 @@ size_t ring_buffer_size(FILE * node);
 size_t ring_buffer_available(ring_buffer_t * ring_buffer);
 size_t ring_buffer_read(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer);
 size_t ring_buffer_write(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer);
+int ring_buffer_poll(ring_buffer_t * ring_buffer, poll_table_t * table);
 
 ring_buffer_t * ring_buffer_create(size_t size);
 void ring_buffer_destroy(ring_buffer_t * ring_buffer);
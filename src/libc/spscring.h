@@ -0,0 +1,40 @@
+/*
+ * spscring.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_LIBC_SPSCRING_H_
+#define SRC_LIBC_SPSCRING_H_
+
+#include <stdint.h>
+#include <libc/list.h>
+#include <fs.h>
+
+/*
+ * Lock-free single producer, single consumer byte ring.
+ * Meant for input devices: the IRQ handler is the only producer and never blocks nor takes a lock,
+ * it drops whatever doesn't fit. The reader sleeps on wait_queue while it's empty.
+ * Waking it up takes locks, so the producer doesn't: it flags the ring as pending and readies
+ * the [spsc-wakeup] tasklet, which wakes up the readers of every pending ring.
+ */
+typedef struct spsc_ring {
+	uint8_t * buffer;
+	size_t size;            /* Power of two */
+	volatile size_t head;   /* Free-running. Only the producer writes it */
+	volatile size_t tail;   /* Free-running. Only the consumer writes it */
+	list_t * wait_queue;    /* Readers (and pollers) waiting for data */
+	volatile uint32_t dropped; /* Bytes lost because the ring was full */
+	volatile char pending;  /* Got data since the wakeup tasklet last looked */
+} spsc_ring_t;
+
+#ifndef MODULE
+spsc_ring_t * spsc_ring_create(size_t size);
+size_t spsc_ring_unread(spsc_ring_t * ring);
+char spsc_ring_push(spsc_ring_t * ring, uint8_t * data, size_t size);
+size_t spsc_ring_pop(spsc_ring_t * ring, uint8_t * buffer, size_t size);
+FILE * spsc_ring_make_file(size_t size);
+#endif
+
+#endif /* SRC_LIBC_SPSCRING_H_ */
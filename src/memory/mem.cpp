@@ -332,6 +332,25 @@ void dealloc_page(uintptr_t physical_address) {
 	last_known_newpage = ALIGNP(physical_address);
 }
 
+/* Whether every page of [addr, addr + size) is present and accessible from user mode, in the current directory: */
+char user_range_ok(uintptr_t addr, size_t size) {
+	if(!size)
+		return 1;
+	if(addr + size - 1 < addr)
+		return 0; /* Wraps around */
+	for(uintptr_t page = addr & ~(PAGE_SIZE - 1); page <= addr + size - 1; page += PAGE_SIZE) {
+		page_table_entry_t * table = TABLE_ENTRY(curr_dir, page);
+		if(!table->present || !table->user || !curr_dir->tables[INDEX_FROM_BIT(page / PAGE_SIZE, PAGES_PER_TABLE)])
+			return 0;
+		page_t * entry = PAGE(curr_dir, page);
+		if(!entry->present || !entry->user)
+			return 0;
+		if(page + PAGE_SIZE < page)
+			break; /* Last page of the address space */
+	}
+	return 1;
+}
+
 /* Simply remaps physical address to a virtual one: */
 void map_page(uintptr_t physical_address, uintptr_t virtual_address) {
 	PAGE(curr_dir, physical_address)->phys_addr = virtual_address >> 12;
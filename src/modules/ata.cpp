@@ -11,6 +11,7 @@
 #include "ata.h"
 
 #define ATA_SECTOR_SIZE 512
+#define ATA_MAX_SECTORS_PER_CMD 255 /* The 28-bit sector count register is one byte wide (and 0 means 256) */
 
 typedef struct {
 	int io_base;
@@ -28,7 +29,8 @@ static ata_dev_t ata_secondary_slave    = {0x170, 0x376, 1};
 
 /************* Prototypes *************/
 static void ata_device_read_sector(ata_dev_t * dev, uint32_t lba, uint8_t * buff);
-static void ata_device_write_retry(ata_dev_t * dev, uint32_t lba, uint8_t * buff);
+static void ata_device_read_sectors(ata_dev_t * dev, uint32_t lba, uint8_t count, uint8_t * buff);
+static void ata_device_write_retry(ata_dev_t * dev, uint32_t lba, uint8_t count, uint8_t * buff);
 
 /************* ATA Virtual Filesystem Functions *************/
 static char ata_drive_char = 'a';
@@ -80,10 +82,14 @@ static uint32_t read_ata(FILE * node, uint32_t offset, uint32_t size, uint8_t *
 		end_block--;
 	}
 
+	/* The aligned middle goes straight into the buffer, as few commands as possible: */
 	while (start_block <= end_block) {
-		ata_device_read_sector(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
+		unsigned int run = end_block - start_block + 1;
+		if (run > ATA_MAX_SECTORS_PER_CMD)
+			run = ATA_MAX_SECTORS_PER_CMD;
+		ata_device_read_sectors(dev, start_block, run, (uint8_t *)((uintptr_t)buffer + x_offset));
+		x_offset += run * ATA_SECTOR_SIZE;
+		start_block += run;
 	}
 
 	return size;
@@ -111,7 +117,7 @@ static uint32_t write_ata(FILE * node, uint32_t offset, uint32_t size, uint8_t *
 		ata_device_read_sector(dev, start_block, (uint8_t*)tmp);
 
 		memcpy((void *)((uintptr_t)tmp + (offset % ATA_SECTOR_SIZE)), buffer, prefix_size);
-		ata_device_write_retry(dev, start_block, (uint8_t *)tmp);
+		ata_device_write_retry(dev, start_block, 1, (uint8_t *)tmp);
 
 		free(tmp);
 		x_offset += prefix_size;
@@ -126,16 +132,20 @@ static uint32_t write_ata(FILE * node, uint32_t offset, uint32_t size, uint8_t *
 
 		memcpy(tmp, (void *)((uintptr_t)buffer + size - postfix_size), postfix_size);
 
-		ata_device_write_retry(dev, end_block, (uint8_t *)tmp);
+		ata_device_write_retry(dev, end_block, 1, (uint8_t *)tmp);
 
 		free(tmp);
 		end_block--;
 	}
 
+	/* Same for the aligned middle, so a batch of consecutive blocks costs one command (and one cache flush) per run: */
 	while (start_block <= end_block) {
-		ata_device_write_retry(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
+		unsigned int run = end_block - start_block + 1;
+		if (run > ATA_MAX_SECTORS_PER_CMD)
+			run = ATA_MAX_SECTORS_PER_CMD;
+		ata_device_write_retry(dev, start_block, run, (uint8_t *)((uintptr_t)buffer + x_offset));
+		x_offset += run * ATA_SECTOR_SIZE;
+		start_block += run;
 	}
 	return size;
 }
@@ -172,7 +182,8 @@ static FILE * ata_device_create(ata_dev_t * dev) {
 /* Prototype: */
 static int ata_wait(ata_dev_t * dev, int advanced);
 
-static void ata_device_read_sector(ata_dev_t * dev, uint32_t lba, uint8_t * buff) {
+/* Reads 'count' consecutive sectors with a single command. The drive raises DRQ once per sector: */
+static void ata_device_read_sectors(ata_dev_t * dev, uint32_t lba, uint8_t count, uint8_t * buff) {
 	spin_lock(ata_lock);
 
 	int errors = 0;
@@ -183,31 +194,38 @@ try_again:
 
 	outb(dev->io_base + ATA_REG_HDDEVSEL, 0xE0 | dev->slave << 4 | (lba & 0x0F000000) >> 24);
 	outb(dev->io_base + ATA_REG_FEATURES, 0x00);
-	outb(dev->io_base + ATA_REG_SECCOUNT0, 1);
+	outb(dev->io_base + ATA_REG_SECCOUNT0, count);
 	outb(dev->io_base + ATA_REG_LBA0, (lba & 0x000000FF) >>  0);
 	outb(dev->io_base + ATA_REG_LBA1, (lba & 0x0000FF00) >>  8);
 	outb(dev->io_base + ATA_REG_LBA2, (lba & 0x00FF0000) >> 16);
 	outb(dev->io_base + ATA_REG_COMMAND, ATA_CMD_READ_PIO);
 
-	if(ata_wait(dev, 1)) {
-		kprintf("\n\t!Error during ATA read of lba block %d", lba);
-		if(++errors > 4) {
-			kprintf("\n\t!! Too many errors trying to read this block. Bailing. !!");
-			spin_unlock(ata_lock);
-			return;
+	for(unsigned int i = 0; i < count; i++) {
+		if(ata_wait(dev, 1)) {
+			kprintf("\n\t!Error during ATA read of lba block %d", lba + i);
+			if(++errors > 4) {
+				kprintf("\n\t!! Too many errors trying to read this block. Bailing. !!");
+				spin_unlock(ata_lock);
+				return;
+			}
+			goto try_again;
 		}
-		goto try_again;
-	}
 
-	/* Read from sector: */
-	int size = 256;
-	insm(dev->io_base, buff, size);
+		/* Read from sector: */
+		int size = 256;
+		insm(dev->io_base, buff + i * ATA_SECTOR_SIZE, size);
+	}
 	ata_wait(dev, 0);
 
 	spin_unlock(ata_lock);
 }
 
-static void ata_device_write_sector(ata_dev_t * dev, uint32_t lba, uint8_t * buff) {
+static void ata_device_read_sector(ata_dev_t * dev, uint32_t lba, uint8_t * buff) {
+	ata_device_read_sectors(dev, lba, 1, buff);
+}
+
+/* Writes 'count' consecutive sectors with a single command, then flushes the drive's cache once for all of them: */
+static void ata_device_write_sectors(ata_dev_t * dev, uint32_t lba, uint8_t count, uint8_t * buff) {
 	spin_lock(ata_lock);
 
 	outb(dev->io_base + ATA_REG_CONTROL, 0x02);
@@ -217,16 +235,21 @@ static void ata_device_write_sector(ata_dev_t * dev, uint32_t lba, uint8_t * buf
 	ata_wait(dev, 0);
 
 	outb(dev->io_base + ATA_REG_FEATURES, 0x00);
-	outb(dev->io_base + ATA_REG_SECCOUNT0, 0x01);
+	outb(dev->io_base + ATA_REG_SECCOUNT0, count);
 	outb(dev->io_base + ATA_REG_LBA0, (lba & 0x000000FF) >>  0);
 	outb(dev->io_base + ATA_REG_LBA1, (lba & 0x0000FF00) >>  8);
 	outb(dev->io_base + ATA_REG_LBA2, (lba & 0x00FF0000) >> 16);
 	outb(dev->io_base + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
-	ata_wait(dev, 0);
 
-	/* Write into sector: */
-	int size = ATA_SECTOR_SIZE / 2;
-	outsm(dev->io_base, buff, size);
+	for(unsigned int i = 0; i < count; i++) {
+		/* The drive asks for each sector with DRQ: */
+		ata_wait(dev, 0);
+
+		/* Write into sector: */
+		int size = ATA_SECTOR_SIZE / 2;
+		outsm(dev->io_base, buff + i * ATA_SECTOR_SIZE, size);
+	}
+	ata_wait(dev, 0);
 	outb(dev->io_base + 0x07, ATA_CMD_CACHE_FLUSH);
 	ata_wait(dev, 0);
 
@@ -244,13 +267,13 @@ static int buffer_compare(uint32_t * buff1, uint32_t * buff2, size_t size) {
 	return 0;
 }
 
-static void ata_device_write_retry(ata_dev_t * dev, uint32_t lba, uint8_t * buff) {
-	uint8_t * read_buff = (uint8_t*)malloc(ATA_SECTOR_SIZE);
+static void ata_device_write_retry(ata_dev_t * dev, uint32_t lba, uint8_t count, uint8_t * buff) {
+	uint8_t * read_buff = (uint8_t*)malloc(count * ATA_SECTOR_SIZE);
 	IRQ_OFF();
 	do {
-		ata_device_write_sector(dev, lba, buff);
-		ata_device_read_sector(dev, lba, read_buff);
-	} while(buffer_compare((uint32_t *)buff, (uint32_t*)read_buff, ATA_SECTOR_SIZE));
+		ata_device_write_sectors(dev, lba, count, buff);
+		ata_device_read_sectors(dev, lba, count, read_buff);
+	} while(buffer_compare((uint32_t *)buff, (uint32_t*)read_buff, count * ATA_SECTOR_SIZE));
 	IRQ_RES();
 	free(read_buff);
 }
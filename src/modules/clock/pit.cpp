@@ -203,6 +203,7 @@ static int pit_init(void) {
 	hashmap_get = (hashmap_get_t)SYF((char*)"hashmap_get");
 	symbol_add("timer_ticks", (unsigned long int)&ticks);
 	symbol_add("timer_subticks", (unsigned long int)&subticks);
+	symbol_add("timer_hz", (unsigned long int)&current_hz);
 
 	/* Each service has a name, and we use this to iterate the hashmap: */
 	services_names = (char**)malloc(PIT_CALLBACK_SERVICE_MAX * sizeof(char**));
@@ -13,17 +13,28 @@
 /****************************
  ****** MACROS / ENUMS ******
  ****************************/
-#define USE_CACHE 0
+#define EXT2_CACHE_ENTRIES      10240 /* Default size of the block cache (a quarter of it for blocks over 2 KB) */
+#define EXT2_CACHE_SCAN         16 /* Least recently used entries looked through for a clean one to evict */
+
+#define EXT2_WRITEBACK_AGE      5  /* Default seconds a block can stay dirty */
+#define EXT2_WRITEBACK_INTERVAL 1  /* Seconds between two passes of the writeback tasklet */
+#define EXT2_DIRTY_RATIO        40 /* Default percentage of the cache that can be dirty */
+#define EXT2_WRITEBACK_BATCH    64 /* Most blocks handed to the block device in one write */
+
+#define EXT2_EXTENT_MAPS        64 /* Inodes whose block map is kept around */
+#define EXT2_EXTENT_HASH        32 /* Must be a power of two */
+
+#define EXT2_ICACHE_ENTRIES     256 /* Inodes kept around once nobody is using them */
+#define EXT2_ICACHE_HASH        64  /* Must be a power of two */
 
 #define SB (fs->superblock)
 #define DC (fs->disk_cache)
 
 /*
- * These macros deal with the block group descriptor bitmap
+ * These macros deal with the block group bitmaps (kept in memory, and scanned a word at a time)
  */
-#define BLOCKBIT(n)  (bg_buffer[((n) >> 3)] & NTH_BIT((((n) % 8))))
-#define BLOCKBYTE(n) (bg_buffer[((n) >> 3)])
-#define SETBIT(n)    NTH_BIT((((n) % 8)))
+#define BITMAP_TEST(map, n) ((map)[(n) >> 5] & (1u << ((n) & 31)))
+#define BITMAP_SET(map, n)  ((map)[(n) >> 5] |= (1u << ((n) & 31)))
 
 #define GETFS(node) (ext2_fs_t*)node->device
 
@@ -37,6 +48,52 @@ enum E_CODES {
 	E_BADPARENT
 };
 
+/*
+ * Block maps: the inode block -> real block translation of an inode,
+ * learned from its indirect blocks as they get read, with contiguous runs collapsed into extents.
+ */
+typedef struct {
+	uint32_t iblock; /* First block within the inode */
+	uint32_t rblock; /* Real block it's on. 0 for a hole */
+	uint32_t count;
+} ext2_extent_t;
+
+typedef struct {
+	uint32_t        inode;
+	ext2_extent_t * extents; /* Sorted by iblock, never overlapping */
+	uint32_t        count;
+	uint32_t        size;    /* Slots in ->extents */
+	node_t          hash_node;
+	node_t          lru_node;
+} ext2_extent_map_t;
+
+/*
+ * Inode cache: every read_inode() of the same inode gets the same copy, until it's evicted.
+ * Changes to it are written to the inode table later on (by ext2_sync, the writeback tasklet or eviction).
+ */
+typedef struct {
+	uint32_t    inode;    /* Its number */
+	uint32_t    refcount; /* read_inode()s not released yet. It can't be evicted until they are */
+	uint8_t     dirty;    /* Changed since it was last written to the inode table (and on ->icache_dirty) */
+	spin_lock_t lock;     /* Held to change the size, block count and block pointers, and to copy the whole inode */
+	node_t      hash_node;
+	node_t      lru_node;
+	node_t      dirty_node;
+} ext2_icache_entry_t; /* Followed by the inode itself (fs->inode_size bytes) */
+
+#define ICACHE_ENTRY(inode) ((ext2_icache_entry_t*)(inode) - 1)
+#define ICACHE_INODE(ent)   ((ext2_inodetable_t*)((ext2_icache_entry_t*)(ent) + 1))
+#define INODE_LOCK(inode)   spin_lock(ICACHE_ENTRY(inode)->lock)
+#define INODE_UNLOCK(inode) spin_unlock(ICACHE_ENTRY(inode)->lock)
+
+/* In-memory state of a block group: */
+typedef struct {
+	uint32_t * block_bitmap; /* Loaded on first use, then kept */
+	uint32_t * inode_bitmap;
+	uint32_t   block_hint;   /* Where the last block allocation here ended: free space likely follows */
+	uint32_t   inode_hint;
+} ext2_group_t;
+
 /**************************
  * EXT2 Filesystem Object *
  **************************/
@@ -52,13 +109,33 @@ typedef struct ext2_fs {
 	unsigned int              pointer_per_block; /* Number of pointers that fit in a block */
 	unsigned int              inodes_per_group;  /* Number of inodes in a "group" */
 	unsigned int              block_group_count; /* Number of blocks groups */
+	ext2_group_t            * groups;            /* Bitmaps and allocation hints, one per block group */
+	spin_lock_t               alloc_lock;        /* Guards the bitmaps and the free counts */
 
 	/***** CACHE *****/
 	ext2_disk_cache_entry_t * disk_cache;        /* Dynamically allocated array of cache entries */
 	unsigned int              cache_entries;     /* Size of ->disk_cache */
-	unsigned int              cache_time;        /* "timer" that increments with each cache read/write */
+	list_t                  * cache_hash;        /* Entries holding a block, by block number */
+	unsigned int              cache_hash_size;   /* Buckets in ->cache_hash (a power of two) */
+	list_t                    cache_lru;         /* Every entry, the least recently used at the head */
+	unsigned int              dirty_count;       /* Dirty entries in ->disk_cache */
+	unsigned int              writeback_count;   /* Entries being written back */
+	list_t                  * writeback_wait;    /* Syncs waiting for writeback_count to drop to 0 */
+	ext2_cache_stats_t        cache_stats;
 	uint8_t                 * cache_data;
 
+	/***** BLOCK MAPS *****/
+	list_t                    emap_hash[EXT2_EXTENT_HASH]; /* ext2_extent_map_t's, by inode number */
+	list_t                    emap_lru;          /* Every block map, the least recently used at the head */
+	uint32_t                  emap_gen[EXT2_EXTENT_HASH]; /* Bumped by every invalidation in the bucket */
+	spin_lock_t               emap_lock;
+
+	/***** INODE CACHE *****/
+	list_t                    icache_hash[EXT2_ICACHE_HASH]; /* ext2_icache_entry_t's, by inode number */
+	list_t                    icache_lru;        /* Every cached inode, the least recently used at the head */
+	list_t                    icache_dirty;      /* The dirty ones, in the order they were dirtied */
+	spin_lock_t               icache_lock;
+
 	spin_lock_t               lock;              /* Synchronization lock point */
 
 	uint8_t                   bgd_block_span;
@@ -71,22 +148,37 @@ typedef struct ext2_fs {
  *********************************/
 static int read_block(ext2_fs_t * fs, unsigned int block_no, uint8_t * buff);
 static int write_block(ext2_fs_t * fs, unsigned int block_no, uint8_t *buff);
+static int read_blocks(ext2_fs_t * fs, unsigned int block_no, unsigned int count, uint8_t * buff);
+static int write_blocks(ext2_fs_t * fs, unsigned int block_no, unsigned int count, uint8_t * buff);
 static ext2_inodetable_t * read_inode(ext2_fs_t * fs, uint32_t inode);
+static void release_inode(ext2_fs_t * fs, ext2_inodetable_t * inode);
 static int write_inode(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t index);
+static void icache_flush(ext2_fs_t * fs);
 static unsigned int ext2_sync(ext2_fs_t * fs);
-static int cache_flush_dirty(ext2_fs_t * fs, unsigned int ent_no);
+static unsigned int cache_writeback(ext2_fs_t * fs, unsigned long dirtied_before);
 static ext2_dir_t * ext2_direntry(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t no, uint32_t index);
-static void refresh_inode(ext2_fs_t * fs, ext2_inodetable_t * inodet, uint32_t inode);
-static unsigned int inode_read_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int block, uint8_t * buff);
+static unsigned int inode_read_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, uint8_t * buff);
 static unsigned int inode_write_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, uint8_t * buff);
-static unsigned int allocate_block(ext2_fs_t * fs);
+static unsigned int inode_block_run(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, unsigned int max, unsigned int * rblock);
+static unsigned int inode_grow(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, unsigned int full_first, unsigned int full_end);
+static unsigned int allocate_block(ext2_fs_t * fs, unsigned int goal);
+static unsigned int allocate_blocks(ext2_fs_t * fs, unsigned int goal, unsigned int max, unsigned int * first);
+static unsigned int get_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock);
 static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock, unsigned int rblock);
+static void emap_invalidate(ext2_fs_t * fs, uint32_t inode_no);
 static uint32_t node_from_file(ext2_fs_t * fs, ext2_inodetable_t * inode, ext2_dir_t * direntry,  FILE * fnode);
 static uint32_t write_inode_buffer(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t inode_number, uint32_t offset, uint32_t size, uint8_t *buffer);
-static unsigned int allocate_inode(ext2_fs_t * fs);
+static uint32_t read_inode_buffer(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t inode_number, uint32_t offset, uint32_t size, uint8_t *buffer);
+static unsigned int allocate_inode(ext2_fs_t * fs, unsigned int parent);
 static int create_entry(FILE * parent, char * name, uint32_t inode);
 
-static char is_using_cache = 0;
+/* Writeback: */
+static list_t * ext2_mounts = 0; /* Every mounted ext2_fs_t, for the writeback tasklet to go through */
+static char writeback_running = 0;
+static unsigned long writeback_age = EXT2_WRITEBACK_AGE;
+static unsigned int dirty_ratio = EXT2_DIRTY_RATIO;
+static unsigned long * ext2_ticks = 0;
+static unsigned long * ext2_subticks = 0;
 
 /*********************************************/
 /***** EXT2 FILESYSTEM HANDLER FUNCTIONS *****/
@@ -95,8 +187,11 @@ static uint32_t ext2_open(FILE * node, unsigned int flags) {
 	ext2_fs_t * fs = GETFS(node);
 	if(flags & O_TRUNC) {
 		ext2_inodetable_t * inode = read_inode(fs, node->inode);
+		INODE_LOCK(inode);
 		inode->size = 0;
+		INODE_UNLOCK(inode);
 		write_inode(fs, inode, node->inode);
+		release_inode(fs, inode);
 	}
 	return 0;
 }
@@ -111,7 +206,13 @@ static int ext2_chmod(FILE * node, int mode) {
 	ext2_inodetable_t * inode = read_inode(fs, node->inode);
 	inode->mode = (inode->mode & 0xFFFFF000) | mode;
 	write_inode(fs, inode, node->inode);
-	ext2_sync(fs);
+	release_inode(fs, inode);
+	return 0;
+}
+
+/* The cache isn't kept per file, so this writes back the whole filesystem: */
+static int ext2_fsync(FILE * node) {
+	ext2_sync(GETFS(node));
 	return 0;
 }
 
@@ -121,7 +222,7 @@ static struct dirent * ext2_readdir(FILE * node, uint32_t index) {
 	/* Fetch directory entry: */
 	ext2_dir_t * direntry = ext2_direntry(fs, inode, node->inode, index);
 	if(!direntry) {
-		free(inode);
+		release_inode(fs, inode);
 		return 0;
 	}
 
@@ -131,7 +232,7 @@ static struct dirent * ext2_readdir(FILE * node, uint32_t index) {
 	dirent->name[direntry->name_len] = '\0';
 	dirent->ino = direntry->inode;
 	free(direntry);
-	free(inode);
+	release_inode(fs, inode);
 	return dirent;
 }
 
@@ -142,39 +243,30 @@ static FILE * ext2_finddir(FILE * node, char * name) {
 	uint8_t * block = (uint8_t*)malloc(fs->block_size);
 	ext2_dir_t *direntry = 0;
 	uint8_t block_nr = 0;
-	inode_read_block(fs, inode, block_nr, block);
+	inode_read_block(fs, inode, node->inode, block_nr, block);
 	uint32_t dir_offset = 0;
 	uint32_t total_offset = 0;
 
+	size_t name_len = strlen(name);
+
 	while (total_offset < inode->size) {
 		if (dir_offset >= fs->block_size) {
 			block_nr++;
 			dir_offset -= fs->block_size;
-			inode_read_block(fs, inode, block_nr, block);
+			inode_read_block(fs, inode, node->inode, block_nr, block);
 		}
 
+		/* Compared in place. The entry is used straight out of the block, which outlives the lookup: */
 		ext2_dir_t *d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
-		if (d_ent->inode == 0 || strlen(name) != d_ent->name_len) {
-			dir_offset += d_ent->rec_len;
-			total_offset += d_ent->rec_len;
-			continue;
-		}
-
-		char *dname = (char*)malloc(sizeof(char) * (d_ent->name_len + 1));
-		memcpy(dname, &(d_ent->name), d_ent->name_len);
-		dname[d_ent->name_len] = '\0';
-		if (!strcmp(dname, name)) {
-			free(dname);
-			direntry = (ext2_dir_t *)malloc(d_ent->rec_len);
-			memcpy(direntry, d_ent, d_ent->rec_len);
+		if (d_ent->inode && d_ent->name_len == name_len && !strncmp((char*)&d_ent->name, name, name_len)) {
+			direntry = d_ent;
 			break;
 		}
-		free(dname);
 
 		dir_offset   += d_ent->rec_len;
 		total_offset += d_ent->rec_len;
 	}
-	free(inode);
+	release_inode(fs, inode);
 
 	if (!direntry) {
 		free(block);
@@ -187,8 +279,7 @@ static FILE * ext2_finddir(FILE * node, char * name) {
 
 	node_from_file(fs, inode, direntry, outnode);
 
-	free(direntry);
-	free(inode);
+	release_inode(fs, inode);
 	free(block);
 	return outnode;
 }
@@ -207,7 +298,7 @@ static void ext2_create(FILE * parent, char * name, uint16_t permission) {
 	}
 
 	/* Allocate an inode for it */
-	unsigned int inode_no = allocate_inode(fs);
+	unsigned int inode_no = allocate_inode(fs, parent->inode);
 	ext2_inodetable_t * inode = read_inode(fs, inode_no);
 
 	/* Set the access and creation times to now */
@@ -248,8 +339,7 @@ static void ext2_create(FILE * parent, char * name, uint16_t permission) {
 	/* Now append the entry to the parent */
 	create_entry(parent, name, inode_no);
 
-	free(inode);
-	ext2_sync(fs);
+	release_inode(fs, inode);
 }
 
 static void ext2_mkdir(FILE * parent, char * name, uint16_t permission) {
@@ -266,7 +356,7 @@ static void ext2_mkdir(FILE * parent, char * name, uint16_t permission) {
 	}
 
 	/* Allocate an inode for it */
-	unsigned int inode_no = allocate_inode(fs);
+	unsigned int inode_no = allocate_inode(fs, parent->inode);
 	ext2_inodetable_t * inode = read_inode(fs, inode_no);
 
 	/* Set the access and creation times to now */
@@ -326,22 +416,20 @@ static void ext2_mkdir(FILE * parent, char * name, uint16_t permission) {
 
 	inode_write_block(fs, inode, inode_no, 0, tmp);
 
-	free(inode);
+	release_inode(fs, inode);
 	free(tmp);
 
 	/* Update parent link count */
 	ext2_inodetable_t * pinode = read_inode(fs, parent->inode);
 	pinode->links_count++;
 	write_inode(fs, pinode, parent->inode);
-	free(pinode);
+	release_inode(fs, pinode);
 
 	/* Update directory count in block group descriptor */
-	uint32_t group = inode_no / fs->inodes_per_group;
+	uint32_t group = (inode_no - 1) / fs->inodes_per_group;
 	fs->block_groups[group].used_dirs_count++;
 	for (int i = 0; i < fs->bgd_block_span; ++i)
 		write_block(fs, fs->bgd_offset + i, (uint8_t *)((uint32_t)fs->block_groups + fs->block_size * i));
-
-	ext2_sync(fs);
 }
 
 static void ext2_unlink(FILE * node, char * name) {
@@ -351,7 +439,7 @@ static void ext2_unlink(FILE * node, char * name) {
 	uint8_t * block = (uint8_t*)malloc(fs->block_size);
 	ext2_dir_t *direntry = 0;
 	uint8_t block_nr = 0;
-	inode_read_block(fs, inode, block_nr, block);
+	inode_read_block(fs, inode, node->inode, block_nr, block);
 	uint32_t dir_offset = 0;
 	uint32_t total_offset = 0;
 
@@ -359,7 +447,7 @@ static void ext2_unlink(FILE * node, char * name) {
 		if (dir_offset >= fs->block_size) {
 			block_nr++;
 			dir_offset -= fs->block_size;
-			inode_read_block(fs, inode, block_nr, block);
+			inode_read_block(fs, inode, node->inode, block_nr, block);
 		}
 		ext2_dir_t *d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
 
@@ -383,8 +471,8 @@ static void ext2_unlink(FILE * node, char * name) {
 		total_offset += d_ent->rec_len;
 	}
 
-	free(inode);
 	if (!direntry) {
+		release_inode(fs, inode);
 		free(block);
 		return;
 	}
@@ -392,8 +480,8 @@ static void ext2_unlink(FILE * node, char * name) {
 	direntry->inode = 0;
 
 	inode_write_block(fs, inode, node->inode, block_nr, block);
+	release_inode(fs, inode);
 	free(block);
-	ext2_sync(fs);
 }
 
 static uint32_t write_ext2(FILE * node, uint32_t offset, uint32_t size, uint8_t *buffer) {
@@ -401,50 +489,17 @@ static uint32_t write_ext2(FILE * node, uint32_t offset, uint32_t size, uint8_t
 	ext2_inodetable_t * inode = read_inode(fs, node->inode);
 
 	uint32_t rv = write_inode_buffer(fs, inode, node->inode, offset, size, buffer);
-	free(inode);
-	ext2_sync(fs);
+	release_inode(fs, inode);
 	return rv;
 }
 
 static uint32_t ext2_read(FILE * node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	ext2_fs_t * fs = GETFS(node);
 	ext2_inodetable_t * inode = read_inode(fs, node->inode);
-	uint32_t end;
-	if (inode->size == 0) return 0;
-	if (offset + size > inode->size)
-		end = inode->size;
-	else
-		end = offset + size;
-
-	uint32_t start_block  = offset / fs->block_size;
-	uint32_t end_block    = end / fs->block_size;
-	uint32_t end_size     = end - end_block * fs->block_size;
-	uint32_t size_to_read = end - offset;
 
-	uint8_t * buf = (uint8_t*)malloc(fs->block_size);
-	if (start_block == end_block) {
-		inode_read_block(fs, inode, start_block, buf);
-		memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % fs->block_size)), size_to_read);
-	} else {
-		uint32_t block_offset;
-		uint32_t blocks_read = 0;
-		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
-			if (block_offset == start_block) {
-				inode_read_block(fs, inode, block_offset, buf);
-				memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % fs->block_size)), fs->block_size - (offset % fs->block_size));
-			} else {
-				inode_read_block(fs, inode, block_offset, buf);
-				memcpy(buffer + fs->block_size * blocks_read - (offset % fs->block_size), buf, fs->block_size);
-			}
-		}
-		if (end_size) {
-			inode_read_block(fs, inode, end_block, buf);
-			memcpy(buffer + fs->block_size * blocks_read - (offset % fs->block_size), buf, end_size);
-		}
-	}
-	free(inode);
-	free(buf);
-	return size_to_read;
+	uint32_t rv = read_inode_buffer(fs, inode, node->inode, offset, size, buffer);
+	release_inode(fs, inode);
+	return rv;
 }
 
 static int ext2_readlink(FILE * node, char * buf, size_t size) {
@@ -460,7 +515,7 @@ static int ext2_readlink(FILE * node, char * buf, size_t size) {
 	if (read_size < size)
 		buf[read_size] = '\0';
 
-	free(inode);
+	release_inode(fs, inode);
 	return read_size;
 }
 
@@ -478,7 +533,7 @@ static void ext2_symlink(FILE * parent, char * target, char * name) {
 	}
 
 	/* Allocate an inode for it */
-	unsigned int inode_no = allocate_inode(fs);
+	unsigned int inode_no = allocate_inode(fs, parent->inode);
 	ext2_inodetable_t * inode = read_inode(fs, inode_no);
 
 	/* Set the access and creation times to now */
@@ -531,8 +586,7 @@ static void ext2_symlink(FILE * parent, char * target, char * name) {
 	if (!embedded)
 		write_inode_buffer((ext2_fs_t*)parent->device, inode, inode_no, 0, target_len, (uint8_t *)target);
 
-	free(inode);
-	ext2_sync(fs);
+	release_inode(fs, inode);
 }
 
 
@@ -540,50 +594,132 @@ static void ext2_symlink(FILE * parent, char * target, char * name) {
 /***** EXT2 IMPLEMENTATION FUNCTIONS *****/
 /*****************************************/
 
+/*
+ * Only the unaligned head and tail of the request go through a bounce buffer.
+ * The whole blocks in between are moved straight to/from the caller's buffer,
+ * one block device call per run of blocks that are contiguous on the disk.
+ */
+static uint32_t read_inode_buffer(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t inode_number, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	uint32_t end;
+	INODE_LOCK(inode);
+	uint32_t isize = inode->size;
+	INODE_UNLOCK(inode);
+	if (offset >= isize) return 0;
+	if (offset + size > isize)
+		end = isize;
+	else
+		end = offset + size;
+
+	uint32_t size_to_read = end - offset;
+	uint32_t block        = offset / fs->block_size;
+	uint32_t head         = offset % fs->block_size;
+	uint32_t done         = 0;
+	uint8_t * buf         = 0;
+
+	if (head || size_to_read < fs->block_size) {
+		buf = (uint8_t*)malloc(fs->block_size);
+		uint32_t n = fs->block_size - head;
+		if (n > size_to_read)
+			n = size_to_read;
+		inode_read_block(fs, inode, inode_number, block, buf);
+		memcpy(buffer, buf + head, n);
+		done += n;
+		block++;
+	}
+
+	while (size_to_read - done >= fs->block_size) {
+		unsigned int rblock;
+		unsigned int count = inode_block_run(fs, inode, inode_number, block, (size_to_read - done) / fs->block_size, &rblock);
+		if (rblock)
+			read_blocks(fs, rblock, count, buffer + done);
+		else
+			memset(buffer + done, 0, fs->block_size); /* A hole */
+		done += count * fs->block_size;
+		block += count;
+	}
+
+	if (done < size_to_read) {
+		if (!buf)
+			buf = (uint8_t*)malloc(fs->block_size);
+		inode_read_block(fs, inode, inode_number, block, buf);
+		memcpy(buffer + done, buf, size_to_read - done);
+	}
+	if (buf)
+		free(buf);
+	return size_to_read;
+}
+
+/*
+ * The size is only raised once the data is on its blocks, so readers never see the new
+ * blocks before they're written. If the disk fills up, the write stops where the blocks do.
+ */
 static uint32_t write_inode_buffer(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t inode_number, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	uint32_t end = offset + size;
-	if(end > inode->size) {
-		inode->size = end;
-		write_inode(fs, inode, inode_number);
+	if(!size)
+		return 0;
+
+	/* Allocate everything up front, in as few runs as possible, so that the writes can be batched too.
+	 * Blocks readers can already see (below the size) get zeroed even if we'll overwrite them whole: */
+	INODE_LOCK(inode);
+	uint32_t isize = inode->size;
+	INODE_UNLOCK(inode);
+	uint32_t full_first = (offset + fs->block_size - 1) / fs->block_size;
+	uint32_t visible    = (isize + fs->block_size - 1) / fs->block_size;
+	if(full_first < visible)
+		full_first = visible;
+	uint32_t allocated = inode_grow(fs, inode, inode_number, (end - 1) / fs->block_size, full_first, end / fs->block_size);
+	if(end > allocated * fs->block_size)
+		end = allocated * fs->block_size;
+	if(end <= offset)
+		return 0;
+
+	uint32_t size_to_write = end - offset;
+	uint32_t block         = offset / fs->block_size;
+	uint32_t head          = offset % fs->block_size;
+	uint32_t done          = 0;
+	uint8_t * buf          = 0;
+
+	if(head || size_to_write < fs->block_size) {
+		buf = (uint8_t*)malloc(fs->block_size);
+		uint32_t n = fs->block_size - head;
+		if(n > size_to_write)
+			n = size_to_write;
+		inode_read_block(fs, inode, inode_number, block, buf);
+		memcpy(buf + head, buffer, n);
+		inode_write_block(fs, inode, inode_number, block, buf);
+		done += n;
+		block++;
 	}
 
-	uint32_t start_block  = offset / fs->block_size;
-	uint32_t end_block    = end / fs->block_size;
-	uint32_t end_size     = end - end_block * fs->block_size;
-	uint32_t size_to_read = end - offset;
-	uint8_t * buf         = (uint8_t*)malloc(fs->block_size);
-	if(start_block == end_block) {
-		inode_read_block(fs, inode, start_block, buf);
-		memcpy((uint8_t *)(((uint32_t)buf) + (offset % fs->block_size)), buffer, size_to_read);
-		inode_write_block(fs, inode, inode_number, start_block, buf);
-	} else {
-		uint32_t block_offset;
-		uint32_t blocks_read = 0;
-		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
-			if (block_offset == start_block) {
-				int b = inode_read_block(fs, inode, block_offset, buf);
-				memcpy((uint8_t *)(((uint32_t)buf) + (offset % fs->block_size)), buffer, fs->block_size - (offset % fs->block_size));
-				inode_write_block(fs, inode, inode_number, block_offset, buf);
-				if (!b) {
-					refresh_inode(fs, inode, inode_number);
-				}
-			} else {
-				int b = inode_read_block(fs, inode, block_offset, buf);
-				memcpy(buf, buffer + fs->block_size * blocks_read - (offset % fs->block_size), fs->block_size);
-				inode_write_block(fs, inode, inode_number, block_offset, buf);
-				if (!b) {
-					refresh_inode(fs, inode, inode_number);
-				}
-			}
-		}
-		if (end_size) {
-			inode_read_block(fs, inode, end_block, buf);
-			memcpy(buf, buffer + fs->block_size * blocks_read - (offset % fs->block_size), end_size);
-			inode_write_block(fs, inode, inode_number, end_block, buf);
-		}
+	while(size_to_write - done >= fs->block_size) {
+		unsigned int rblock;
+		unsigned int count = inode_block_run(fs, inode, inode_number, block, (size_to_write - done) / fs->block_size, &rblock);
+		if(rblock)
+			write_blocks(fs, rblock, count, buffer + done);
+		else
+			inode_write_block(fs, inode, inode_number, block, buffer + done);
+		done += count * fs->block_size;
+		block += count;
 	}
-	free(buf);
-	return size_to_read;
+
+	if(done < size_to_write) {
+		if(!buf)
+			buf = (uint8_t*)malloc(fs->block_size);
+		inode_read_block(fs, inode, inode_number, block, buf);
+		memcpy(buf, buffer + done, size_to_write - done);
+		inode_write_block(fs, inode, inode_number, block, buf);
+	}
+	if(buf)
+		free(buf);
+
+	INODE_LOCK(inode);
+	char grew = end > inode->size;
+	if(grew)
+		inode->size = end;
+	INODE_UNLOCK(inode);
+	if(grew)
+		write_inode(fs, inode, inode_number);
+	return size_to_write;
 }
 
 static uint32_t node_from_file(ext2_fs_t * fs, ext2_inodetable_t * inode, ext2_dir_t * direntry,  FILE * fnode) {
@@ -614,7 +750,7 @@ static uint32_t node_from_file(ext2_fs_t * fs, ext2_inodetable_t * inode, ext2_d
 		fnode->readlink = 0;
 	}
 	if ((inode->mode & EXT2_S_IFDIR) == EXT2_S_IFDIR) {
-		fnode->flags   |= FS_DIR;
+		fnode->flags   |= FS_DIR | FS_DCACHE;
 		fnode->create   = ext2_create;
 		fnode->mkdir    = ext2_mkdir;
 		fnode->readdir  = ext2_readdir;
@@ -649,6 +785,7 @@ static uint32_t node_from_file(ext2_fs_t * fs, ext2_inodetable_t * inode, ext2_d
 	fnode->chmod = ext2_chmod;
 	fnode->open  = ext2_open;
 	fnode->close = ext2_close;
+	fnode->fsync = ext2_fsync;
 	fnode->ioctl = 0;
 	return 1;
 }
@@ -664,6 +801,7 @@ static int create_entry(FILE * parent, char * name, uint32_t inode) {
 
 	if (((pinode->mode & EXT2_S_IFDIR) == 0) || (name == NULL)) {
 		kprintf("\n\t> ERROR: Attempted to allocate an inode in a parent that was not a directory");
+		release_inode(fs, pinode);
 		return E_BADPARENT;
 	}
 
@@ -678,12 +816,12 @@ static int create_entry(FILE * parent, char * name, uint32_t inode) {
 	int modify_or_replace = 0;
 	ext2_dir_t * previous;
 
-	inode_read_block(fs, pinode, block_nr, block);
+	inode_read_block(fs, pinode, parent->inode, block_nr, block);
 	while(total_offset < pinode->size) {
 		if(dir_offset >= fs->block_size) {
 			block_nr++;
 			dir_offset -= fs->block_size;
-			inode_read_block(fs, pinode, block_nr, block);
+			inode_read_block(fs, pinode, parent->inode, block_nr, block);
 		}
 		ext2_dir_t * d_ent = (ext2_dir_t*)((uintptr_t)block + dir_offset);
 
@@ -727,7 +865,7 @@ static int create_entry(FILE * parent, char * name, uint32_t inode) {
 	inode_write_block(fs, pinode, parent->inode, block_nr, block);
 
 	free(block);
-	free(pinode);
+	release_inode(fs, pinode);
 	return E_NOSPACE;
 }
 
@@ -743,101 +881,374 @@ static int rewrite_superblock(ext2_fs_t * fs) {
 	return E_SUCCESS;
 }
 
-static unsigned int allocate_inode(ext2_fs_t * fs) {
-	uint32_t node_no = 0;
-	uint32_t node_offset = 0;
-	uint32_t group = 0;
-	uint8_t * bg_buffer = (uint8_t*)malloc(fs->block_size);
+/****** BITMAPS ******/
+static void write_group_descriptors(ext2_fs_t * fs) {
+	for(int i = 0; i < fs->bgd_block_span; i++)
+		write_block(fs, fs->bgd_offset + i, (uint8_t*)((uint32_t)fs->block_groups + fs->block_size * i));
+}
 
-	for(unsigned int i = 0; i < fs->block_group_count; i++) {
-		if(fs->block_groups[i].free_blocks_count > 0) {
-			read_block(fs, fs->block_groups[i].inode_bitmap, (uint8_t*)bg_buffer);
-			while(BLOCKBIT(node_offset))
-				node_offset++;
-			node_no = node_offset + i * fs->inodes_per_group + 1;
-			group = i;
-			break;
+/* A group's block (or inode) bitmap, read in the first time it's needed: */
+static uint32_t * group_bitmap(ext2_fs_t * fs, uint32_t group, char inodes) {
+	uint32_t ** slot = inodes ? &fs->groups[group].inode_bitmap : &fs->groups[group].block_bitmap;
+	if(!*slot) {
+		uint32_t * map = (uint32_t*)malloc(fs->block_size);
+		read_block(fs, inodes ? fs->block_groups[group].inode_bitmap : fs->block_groups[group].block_bitmap, (uint8_t*)map);
+		spin_lock(fs->alloc_lock);
+		if(!*slot) {
+			*slot = map;
+			map = 0;
 		}
+		spin_unlock(fs->alloc_lock);
+		if(map)
+			free(map); /* Someone else read it in meanwhile */
 	}
+	return *slot;
+}
 
-	if(!node_no) {
-		kprintf("\n\tERROR: Ran out of inodes!");
-		return 0;
+/* Blocks in a group (the last one might be short): */
+static uint32_t group_block_count(ext2_fs_t * fs, uint32_t group) {
+	uint32_t first = SB->first_data_block + group * SB->blocks_per_group;
+	uint32_t left = SB->blocks_count - first;
+	return left < SB->blocks_per_group ? left : SB->blocks_per_group;
+}
+
+/* First clear bit at or after 'start', wrapping around to the beginning. Returns 'nbits' if they're all set: */
+static uint32_t bitmap_find_free(uint32_t * map, uint32_t nbits, uint32_t start) {
+	if(start >= nbits)
+		start = 0;
+	for(int pass = 0; pass < 2; pass++) {
+		uint32_t bit = pass ? 0 : start;
+		uint32_t end = pass ? start : nbits;
+		while(bit < end) {
+			/* Treat the bits before 'bit' in its word as used: */
+			uint32_t word = map[bit >> 5] | ((1u << (bit & 31)) - 1);
+			if(word != 0xFFFFFFFF) {
+				uint32_t found = (bit & ~31u) + __builtin_ctz(~word);
+				if(found < end)
+					return found;
+				break;
+			}
+			bit = (bit & ~31u) + 32;
+		}
 	}
+	return nbits;
+}
 
-	BLOCKBYTE(node_offset) |= SETBIT(node_offset);
+/**
+ * ext2->allocate_inode Allocate an inode.
+ *
+ * The parent directory's group is tried first, so that its files end up next to it (and to their blocks).
+ *
+ * @param parent Number of the parent directory's inode
+ * @returns Number of the new inode, 0 if there's none left
+ */
+static unsigned int allocate_inode(ext2_fs_t * fs, unsigned int parent) {
+	uint32_t goal_group = parent ? (parent - 1) / fs->inodes_per_group : 0;
+	if(goal_group >= fs->block_group_count)
+		goal_group = 0;
+
+	for(unsigned int n = 0; n < fs->block_group_count; n++) {
+		uint32_t group = (goal_group + n) % fs->block_group_count;
+		if(!fs->block_groups[group].free_inodes_count)
+			continue;
+		uint32_t * map = group_bitmap(fs, group, 1);
 
-	write_block(fs, fs->block_groups[group].inode_bitmap, (uint8_t*)bg_buffer);
-	free(bg_buffer);
+		spin_lock(fs->alloc_lock);
+		uint32_t bit = bitmap_find_free(map, fs->inodes_per_group, fs->groups[group].inode_hint);
+		if(bit == fs->inodes_per_group || !fs->block_groups[group].free_inodes_count) {
+			spin_unlock(fs->alloc_lock);
+			continue;
+		}
+		BITMAP_SET(map, bit);
+		fs->groups[group].inode_hint = bit + 1;
+		fs->block_groups[group].free_inodes_count--;
+		SB->free_inodes_count--;
+		spin_unlock(fs->alloc_lock);
+
+		write_block(fs, fs->block_groups[group].inode_bitmap, (uint8_t*)map);
+		write_group_descriptors(fs);
+		rewrite_superblock(fs);
+
+		unsigned int node_no = group * fs->inodes_per_group + bit + 1;
+		emap_invalidate(fs, node_no); /* In case the number was used before */
+		return node_no;
+	}
 
-	fs->block_groups[group].free_inodes_count--;
-	for(int i = 0; i < fs->bgd_block_span; i++)
-		write_block(fs, fs->bgd_offset + i, (uint8_t*)((uint32_t)fs->block_groups + fs->block_size * i));
-	SB->free_inodes_count--;
-	rewrite_superblock(fs);
-	return node_no;
+	kprintf("\n\tERROR: Ran out of inodes!");
+	return 0;
+}
+
+/* Where the inode's block 'block' would best go: right after the one before it, or else at the start of the inode's group */
+static unsigned int inode_block_goal(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block) {
+	if(block) {
+		unsigned int prev = get_block_number(fs, inode, inode_no, block - 1);
+		if(prev)
+			return prev + 1;
+	}
+	return SB->first_data_block + ((inode_no - 1) / fs->inodes_per_group) * SB->blocks_per_group;
 }
 
 /**
- * ext2->allocate_inode_block Allocate a block in an inode.
+ * ext2->allocate_inode_blocks Allocate blocks in an inode, as one contiguous run if there's room for it.
+ *
+ * New blocks are zeroed, except the ones in [full_first, full_end), which the caller is about to overwrite whole.
  *
- * @param inode Inode to operate on
+ * @param inode    Inode to operate on
  * @param inode_no Number of the inode (this is not part of the struct)
- * @param block Block within inode to allocate
- * @returns Error code or E_SUCCESS
+ * @param block    First block within inode to allocate
+ * @param count    Blocks wanted
+ * @returns Number of blocks allocated (maybe fewer than 'count'). 0 if the disk is full
  */
-static int allocate_inode_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block) {
-	unsigned int block_no = allocate_block(fs);
-	if(!block_no) return E_NOSPACE;
+static unsigned int allocate_inode_blocks(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block,
+		unsigned int count, unsigned int full_first, unsigned int full_end)
+{
+	unsigned int first;
+	count = allocate_blocks(fs, inode_block_goal(fs, inode, inode_no, block), count, &first);
+	if(!count) return 0;
+
+	uint8_t * zero = 0;
+	for(unsigned int i = 0; i < count; i++) {
+		if(block + i < full_first || block + i >= full_end) {
+			if(!zero) {
+				zero = (uint8_t*)malloc(fs->block_size);
+				memset(zero, 0, fs->block_size);
+			}
+			write_block(fs, first + i, zero);
+		}
+		set_block_number(fs, inode, inode_no, block + i, first + i);
+	}
+	if(zero)
+		free(zero);
 
-	set_block_number(fs, inode, inode_no, block, block_no);
-	unsigned int t = (block + 1) * (fs->block_size / 512);
+	unsigned int t = (block + count) * (fs->block_size / 512);
+	INODE_LOCK(inode);
 	if(inode->blocks < t) {
 		inode->blocks = t;
 	}
+	INODE_UNLOCK(inode);
 	write_inode(fs, inode, inode_no);
-	return E_SUCCESS;
+	return count;
+}
+
+/****** BLOCK MAPS ******/
+static inline list_t * emap_bucket(ext2_fs_t * fs, uint32_t inode_no) {
+	return &fs->emap_hash[inode_no & (EXT2_EXTENT_HASH - 1)];
+}
+
+static ext2_extent_map_t * emap_find(ext2_fs_t * fs, uint32_t inode_no) {
+	foreach(it, emap_bucket(fs, inode_no)) {
+		ext2_extent_map_t * map = (ext2_extent_map_t*)it->value;
+		if(map->inode == inode_no)
+			return map;
+	}
+	return 0;
+}
+
+/* Called with the lock held: */
+static void emap_drop(ext2_fs_t * fs, ext2_extent_map_t * map) {
+	list_delete(emap_bucket(fs, map->inode), &map->hash_node);
+	list_delete(&fs->emap_lru, &map->lru_node);
+	free(map->extents);
+	free(map);
+}
+
+/* The inode's blocks were moved around: forget what we knew about them */
+static void emap_invalidate(ext2_fs_t * fs, uint32_t inode_no) {
+	spin_lock(fs->emap_lock);
+	fs->emap_gen[inode_no & (EXT2_EXTENT_HASH - 1)]++;
+	ext2_extent_map_t * map = emap_find(fs, inode_no);
+	if(map)
+		emap_drop(fs, map);
+	spin_unlock(fs->emap_lock);
+}
+
+/* First extent that doesn't end at or before 'iblock' (->count if there's none): */
+static uint32_t emap_search(ext2_extent_map_t * map, uint32_t iblock) {
+	uint32_t lo = 0, hi = map->count;
+	while(lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if(map->extents[mid].iblock + map->extents[mid].count <= iblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * ext2->emap_lookup Translate an inode block through the inode's block map
+ *
+ * @param rblock Real block number (0 for a hole) if it was there
+ * @param gen    Generation of the map, to hand to emap_insert
+ * @returns 1 if it was there, 0 if the indirect blocks need to be read
+ */
+static char emap_lookup(ext2_fs_t * fs, uint32_t inode_no, uint32_t iblock, uint32_t * rblock, uint32_t * gen) {
+	char found = 0;
+	spin_lock(fs->emap_lock);
+	*gen = fs->emap_gen[inode_no & (EXT2_EXTENT_HASH - 1)];
+	ext2_extent_map_t * map = emap_find(fs, inode_no);
+	if(map) {
+		uint32_t i = emap_search(map, iblock);
+		if(i < map->count && map->extents[i].iblock <= iblock) {
+			ext2_extent_t * ext = &map->extents[i];
+			*rblock = ext->rblock ? ext->rblock + (iblock - ext->iblock) : 0;
+			found = 1;
+		}
+		list_delete(&fs->emap_lru, &map->lru_node);
+		list_append(&fs->emap_lru, &map->lru_node);
+	}
+	spin_unlock(fs->emap_lock);
+	return found;
+}
+
+/* Adds one extent to the map, merging it into the one before when they're contiguous: */
+static void emap_add(ext2_extent_map_t * map, uint32_t iblock, uint32_t rblock, uint32_t count) {
+	uint32_t pos = emap_search(map, iblock);
+	if(pos < map->count && map->extents[pos].iblock < iblock + count)
+		return; /* Someone else got there first */
+
+	if(pos) {
+		ext2_extent_t * prev = &map->extents[pos - 1];
+		if(prev->iblock + prev->count == iblock && (rblock ? prev->rblock && prev->rblock + prev->count == rblock : !prev->rblock)) {
+			prev->count += count;
+			return;
+		}
+	}
+
+	if(map->count == map->size) {
+		map->size = map->size ? map->size * 2 : 8;
+		map->extents = (ext2_extent_t*)realloc(map->extents, sizeof(ext2_extent_t) * map->size);
+	}
+	for(uint32_t i = map->count; i > pos; i--)
+		map->extents[i] = map->extents[i - 1];
+	map->extents[pos].iblock = iblock;
+	map->extents[pos].rblock = rblock;
+	map->extents[pos].count  = count;
+	map->count++;
+}
+
+/* The one block at 'iblock' maps to 'rblock' now. Blocks the map doesn't know about yet are left to be read: */
+static void emap_set(ext2_extent_map_t * map, uint32_t iblock, uint32_t rblock) {
+	uint32_t i = emap_search(map, iblock);
+	if(i == map->count || map->extents[i].iblock > iblock)
+		return;
+	ext2_extent_t ext = map->extents[i];
+	uint32_t at = iblock - ext.iblock;
+	if((ext.rblock ? ext.rblock + at : 0) == rblock)
+		return;
+
+	/* Cut the block out of its extent, and put it back on its own (next to the part before it, if they're contiguous): */
+	map->count--;
+	for(uint32_t j = i; j < map->count; j++)
+		map->extents[j] = map->extents[j + 1];
+	if(at)
+		emap_add(map, ext.iblock, ext.rblock, at);
+	emap_add(map, iblock, rblock, 1);
+	if(at + 1 < ext.count)
+		emap_add(map, iblock + 1, ext.rblock ? ext.rblock + at + 1 : 0, ext.count - at - 1);
+}
+
+/*
+ * One of the inode's pointers was written. The generation goes up, so that whoever read the indirect
+ * block before that doesn't get to insert what it saw (see emap_insert), and the map is fixed in place:
+ */
+static void emap_update(ext2_fs_t * fs, uint32_t inode_no, uint32_t iblock, uint32_t rblock) {
+	spin_lock(fs->emap_lock);
+	fs->emap_gen[inode_no & (EXT2_EXTENT_HASH - 1)]++;
+	ext2_extent_map_t * map = emap_find(fs, inode_no);
+	if(map)
+		emap_set(map, iblock, rblock);
+	spin_unlock(fs->emap_lock);
+}
+
+/**
+ * ext2->emap_insert Learn a whole indirect block worth of pointers.
+ *
+ * @param iblock   Inode block the first pointer maps
+ * @param pointers The indirect block
+ * @param count    Pointers in it
+ * @param gen      What emap_lookup said before the block was read. If the inode
+ *                 was invalidated since, the pointers may be stale and get dropped
+ */
+static void emap_insert(ext2_fs_t * fs, uint32_t inode_no, uint32_t iblock, uint32_t * pointers, uint32_t count, uint32_t gen) {
+	spin_lock(fs->emap_lock);
+	if(fs->emap_gen[inode_no & (EXT2_EXTENT_HASH - 1)] != gen) {
+		spin_unlock(fs->emap_lock);
+		return;
+	}
+	ext2_extent_map_t * map = emap_find(fs, inode_no);
+	if(!map) {
+		if(fs->emap_lru.length >= EXT2_EXTENT_MAPS)
+			emap_drop(fs, (ext2_extent_map_t*)fs->emap_lru.head->value);
+		map = (ext2_extent_map_t*)malloc(sizeof(ext2_extent_map_t));
+		memset(map, 0, sizeof(ext2_extent_map_t));
+		map->inode = inode_no;
+		map->hash_node.value = map;
+		map->lru_node.value = map;
+		list_append(emap_bucket(fs, inode_no), &map->hash_node);
+		list_append(&fs->emap_lru, &map->lru_node);
+	}
+
+	/* Collapse the runs of consecutive blocks (or of holes): */
+	for(uint32_t first = 0; first < count;) {
+		uint32_t run = 1;
+		if(pointers[first])
+			while(first + run < count && pointers[first + run] == pointers[first] + run)
+				run++;
+		else
+			while(first + run < count && !pointers[first + run])
+				run++;
+		emap_add(map, iblock + first, pointers[first], run);
+		first += run;
+	}
+	spin_unlock(fs->emap_lock);
 }
 
 /**
  * ext2->get_block_number Given an inode block number, get the real block number.
  *
- * @param inode   Inode to operate on
- * @param iblock  Block offset within the inode
+ * Indirect blocks only get read when the inode's block map doesn't know the block yet,
+ * and then the whole (last level) indirect block goes into the map.
+ *
+ * @param inode    Inode to operate on
+ * @param inode_no Number of the inode, for its block map. 0 bypasses it
+ * @param iblock   Block offset within the inode
  * @returns Real block number
  */
-static unsigned int get_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int iblock) {
+static unsigned int get_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock) {
 	unsigned int p = fs->pointer_per_block;
 
 	/* We're going to do some crazy math in a bit... */
 	unsigned int a, b, c, d, e, f, g;
 
-	uint8_t * tmp;
-	if(iblock < EXT2_DIRECT_BLOCKS) {
+	if(iblock < EXT2_DIRECT_BLOCKS)
 		return inode->block[iblock];
-	} else if(iblock < EXT2_DIRECT_BLOCKS + p) {
-		tmp = (uint8_t*)malloc(fs->block_size);
-		read_block(fs, inode->block[EXT2_DIRECT_BLOCKS], (uint8_t*)tmp);
 
-		unsigned int out = ((uint32_t *)tmp)[iblock - EXT2_DIRECT_BLOCKS];
-		free(tmp);
+	uint32_t out, gen = 0;
+	if(inode_no && emap_lookup(fs, inode_no, iblock, &out, &gen))
 		return out;
+
+	uint32_t nblock;
+	unsigned int index; /* Of iblock within the last level indirect block */
+	if(iblock < EXT2_DIRECT_BLOCKS + p) {
+		nblock = inode->block[EXT2_DIRECT_BLOCKS];
+		index = iblock - EXT2_DIRECT_BLOCKS;
+		if(!nblock) return 0;
 	} else if(iblock < EXT2_DIRECT_BLOCKS + p + p * p) {
 		a = iblock - EXT2_DIRECT_BLOCKS;
 		b = a - p;
 		c = b / p;
 		d = b - c * p;
 
-		tmp = (uint8_t*)malloc(fs->block_size);
-		read_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 1], (uint8_t *)tmp);
-
-		uint32_t nblock = ((uint32_t*)tmp)[c];
-		read_block(fs, nblock, (uint8_t*)tmp);
-
-		unsigned int out = ((uint32_t  *)tmp)[d];
+		nblock = inode->block[EXT2_DIRECT_BLOCKS + 1];
+		if(!nblock) return 0;
+		uint32_t * tmp = (uint32_t*)malloc(fs->block_size);
+		read_block(fs, nblock, (uint8_t *)tmp);
+		nblock = tmp[c];
 		free(tmp);
-		return out;
-	} else if(iblock < EXT2_DIRECT_BLOCKS + p + p * p + p) {
+		index = d;
+		if(!nblock) return 0;
+	} else if(iblock < EXT2_DIRECT_BLOCKS + p + p * p + p * p * p) {
 		a = iblock - EXT2_DIRECT_BLOCKS;
 		b = a - p;
 		c = b - p * p;
@@ -846,45 +1257,51 @@ static unsigned int get_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		f = e / p;
 		g = e - f * p;
 
-		tmp = (uint8_t*)malloc(fs->block_size);
-		read_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 2], (uint8_t *)tmp);
-
-		uint32_t nblock = ((uint32_t*)tmp)[d];
-		read_block(fs, nblock, (uint8_t*)tmp);
-
-		nblock = ((uint32_t*)tmp)[f];
-		read_block(fs, nblock, (uint8_t*)tmp);
-
-		unsigned int out = ((uint32_t  *)tmp)[g];
+		nblock = inode->block[EXT2_DIRECT_BLOCKS + 2];
+		if(!nblock) return 0;
+		uint32_t * tmp = (uint32_t*)malloc(fs->block_size);
+		read_block(fs, nblock, (uint8_t *)tmp);
+		nblock = tmp[d];
+		if(nblock) {
+			read_block(fs, nblock, (uint8_t *)tmp);
+			nblock = tmp[f];
+		}
 		free(tmp);
-		return out;
+		index = g;
+		if(!nblock) return 0;
+	} else {
+		/* EXT2 driver tried to read to a block number that was too high */
+		return 0;
 	}
-	/* EXT2 driver tried to read to a block number that was too high */
-	return 0;
+
+	/* Read the last level, and remember all of it: */
+	uint32_t * tmp = (uint32_t*)malloc(fs->block_size);
+	read_block(fs, nblock, (uint8_t *)tmp);
+	out = tmp[index];
+	if(inode_no)
+		emap_insert(fs, inode_no, iblock - index, tmp, p, gen);
+	free(tmp);
+	return out;
 }
 
-/**
- * ext2->set_block_number Set the "real" block number for a given "inode" block number.
- *
- * @param inode   Inode to operate on
- * @param iblock  Block offset within the inode
- * @param rblock  Real block number
- * @returns Error code or E_SUCCESS
- */
-static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock, unsigned int rblock) {
+static unsigned int set_block_pointer(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock, unsigned int rblock) {
 	unsigned int p = fs->pointer_per_block;
 	/* We're going to do some crazy math in a bit... */
 	unsigned int a, b, c, d, e, f, g;
 
 	uint8_t * tmp;
 	if (iblock < EXT2_DIRECT_BLOCKS) {
+		INODE_LOCK(inode);
 		inode->block[iblock] = rblock;
+		INODE_UNLOCK(inode);
 		return E_SUCCESS;
 	} else if (iblock < EXT2_DIRECT_BLOCKS + p) {
 		if (!inode->block[EXT2_DIRECT_BLOCKS]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) return E_NOSPACE;
+			INODE_LOCK(inode);
 			inode->block[EXT2_DIRECT_BLOCKS] = block_no;
+			INODE_UNLOCK(inode);
 			write_inode(fs, inode, inode_no);
 		}
 		tmp = (uint8_t*)malloc(fs->block_size);
@@ -902,9 +1319,11 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		d = b - c * p;
 
 		if (!inode->block[EXT2_DIRECT_BLOCKS+1]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) return E_NOSPACE;
+			INODE_LOCK(inode);
 			inode->block[EXT2_DIRECT_BLOCKS+1] = block_no;
+			INODE_UNLOCK(inode);
 			write_inode(fs, inode, inode_no);
 		}
 
@@ -912,7 +1331,7 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		read_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 1], (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[c]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[c] = block_no;
 			write_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 1], (uint8_t *)tmp);
@@ -926,7 +1345,7 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 
 		free(tmp);
 		return E_SUCCESS;
-	} else if (iblock < EXT2_DIRECT_BLOCKS + p + p * p + p) {
+	} else if (iblock < EXT2_DIRECT_BLOCKS + p + p * p + p * p * p) {
 		a = iblock - EXT2_DIRECT_BLOCKS;
 		b = a - p;
 		c = b - p * p;
@@ -936,9 +1355,11 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		g = e - f * p;
 
 		if (!inode->block[EXT2_DIRECT_BLOCKS+2]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) return E_NOSPACE;
+			INODE_LOCK(inode);
 			inode->block[EXT2_DIRECT_BLOCKS+2] = block_no;
+			INODE_UNLOCK(inode);
 			write_inode(fs, inode, inode_no);
 		}
 
@@ -946,7 +1367,7 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		read_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 2], (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[d]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[d] = block_no;
 			write_block(fs, inode->block[EXT2_DIRECT_BLOCKS + 2], (uint8_t *)tmp);
@@ -956,7 +1377,7 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		read_block(fs, nblock, (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[f]) {
-			unsigned int block_no = allocate_block(fs);
+			unsigned int block_no = allocate_block(fs, rblock + 1);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[f] = block_no;
 			write_block(fs, nblock, (uint8_t *)tmp);
@@ -966,7 +1387,7 @@ static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		nblock = ((uint32_t *)tmp)[f];
 		read_block(fs, nblock, (uint8_t *)tmp);
 
-		((uint32_t *)tmp)[g] = nblock;
+		((uint32_t *)tmp)[g] = rblock;
 		write_block(fs, nblock, (uint8_t *)tmp);
 
 		free(tmp);
@@ -979,11 +1400,34 @@ no_space_free:
 	return E_NOSPACE;
 }
 
+/**
+ * ext2->set_block_number Set the "real" block number for a given "inode" block number.
+ *
+ * The block map is updated once the pointer is written: the one block is changed in place,
+ * and a concurrent get_block_number still reading the old pointers gets turned away (emap_update).
+ * If the write failed halfway, the map is just dropped.
+ *
+ * @param inode   Inode to operate on
+ * @param iblock  Block offset within the inode
+ * @param rblock  Real block number
+ * @returns Error code or E_SUCCESS
+ */
+static unsigned int set_block_number(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock, unsigned int rblock) {
+	unsigned int ret = set_block_pointer(fs, inode, inode_no, iblock, rblock);
+	if(iblock >= EXT2_DIRECT_BLOCKS) {
+		if(ret == E_SUCCESS)
+			emap_update(fs, inode_no, iblock, rblock);
+		else
+			emap_invalidate(fs, inode_no);
+	}
+	return ret;
+}
+
 
 static ext2_dir_t * ext2_direntry(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t no, uint32_t index) {
 	uint8_t * block = (uint8_t*)malloc(fs->block_size);
 	uint8_t block_nr = 0;
-	inode_read_block(fs, inode, block_nr, block);
+	inode_read_block(fs, inode, no, block_nr, block);
 
 	uint32_t dir_offset = 0;
 	uint32_t total_offset = 0;
@@ -1007,7 +1451,7 @@ static ext2_dir_t * ext2_direntry(ext2_fs_t * fs, ext2_inodetable_t * inode, uin
 		if(dir_offset >= fs->block_size) {
 			block_nr++;
 			dir_offset -= fs->block_size;
-			inode_read_block(fs, inode, block_nr, block);
+			inode_read_block(fs, inode, no, block_nr, block);
 		}
 	}
 
@@ -1016,77 +1460,315 @@ static ext2_dir_t * ext2_direntry(ext2_fs_t * fs, ext2_inodetable_t * inode, uin
 }
 
 static unsigned int ext2_sync(ext2_fs_t * fs) {
-	if(!is_using_cache) return 0;
-	spin_lock(fs->lock);
-	/* Flush each cache entry: */
-	for(unsigned int i = 0; i < fs->cache_entries; i++)
-		if(DC[i].dirty)
-			cache_flush_dirty(fs, i);
-	spin_unlock(fs->lock);
-	return 0;
+	icache_flush(fs);
+	if(!DC) return 0;
+	/* Every dirty entry, no matter how young: */
+	cache_writeback(fs, UINT32_MAX);
+	/* And whatever the writeback tasklet was already on: */
+	for(;;) {
+		IRQ_OFF();
+		spin_lock(fs->lock);
+		char busy = fs->writeback_count != 0;
+		spin_unlock(fs->lock);
+		if(busy)
+			sleep_on(fs->writeback_wait);
+		IRQ_RES();
+		if(!busy)
+			return 0;
+	}
 }
 
 /****** CACHE FUNCTIONS ******/
+/*
+ * The cache index (the hash, the LRU list and the entries' flags) is guarded by fs->lock,
+ * which is never held across disk I/O. An entry that is being read in, or flushed out before being evicted,
+ * has 'io' set: that's the block's own lock, and whoever else wants the block waits for it to clear.
+ */
+static inline list_t * cache_bucket(ext2_fs_t * fs, unsigned int block_no) {
+	return &fs->cache_hash[(block_no * 2654435761u) & (fs->cache_hash_size - 1)];
+}
+
+static ext2_disk_cache_entry_t * cache_find(ext2_fs_t * fs, unsigned int block_no) {
+	foreach(it, cache_bucket(fs, block_no)) {
+		ext2_disk_cache_entry_t * ent = (ext2_disk_cache_entry_t*)it->value;
+		if(ent->block_no == block_no)
+			return ent;
+	}
+	return 0;
+}
+
+/* Most recently used goes to the tail: */
+static inline void cache_touch(ext2_fs_t * fs, ext2_disk_cache_entry_t * ent) {
+	list_delete(&fs->cache_lru, &ent->lru_node);
+	list_append(&fs->cache_lru, &ent->lru_node);
+}
+
+/* Waits for the block's I/O to be over. Called, and returns, with the lock held. The entry might hold another block by then: */
+static void cache_wait_io(ext2_fs_t * fs, ext2_disk_cache_entry_t * ent) {
+	while(ent->io) {
+		spin_unlock(fs->lock);
+		switch_task(TASKST_READY);
+		spin_lock(fs->lock);
+	}
+}
+
+/*
+ * The entry to evict: the least recently used clean one among the first EXT2_CACHE_SCAN,
+ * or failing that, the least recently used one. Entries with I/O or a writeback going on can't be picked.
+ */
+static ext2_disk_cache_entry_t * cache_victim(ext2_fs_t * fs) {
+	ext2_disk_cache_entry_t * victim = 0;
+	unsigned int scanned = 0;
+	for(node_t * it = fs->cache_lru.head; it && scanned < EXT2_CACHE_SCAN; it = it->next) {
+		ext2_disk_cache_entry_t * ent = (ext2_disk_cache_entry_t*)it->value;
+		if(ent->io || ent->writeback)
+			continue;
+		if(!ent->dirty)
+			return ent;
+		if(!victim)
+			victim = ent;
+		scanned++;
+	}
+	return victim;
+}
+
+/*
+ * Writes a dirty victim back before it gets reused. Its block stays in the hash (under I/O) until
+ * it's on the disk, so nobody reads a stale copy from the disk meanwhile. Called, and returns, with the lock held.
+ */
+static void cache_flush_victim(ext2_fs_t * fs, ext2_disk_cache_entry_t * ent) {
+	ent->io = 1;
+	spin_unlock(fs->lock);
+	fwrite(fs->block_device, ent->block_no * fs->block_size, fs->block_size, ent->block);
+	spin_lock(fs->lock);
+	ent->io = 0;
+	ent->dirty = 0;
+	fs->dirty_count--;
+	fs->cache_stats.writebacks++;
+}
+
+/* Hands a (clean) victim over to 'block_no'. Called with the lock held: */
+static void cache_reuse(ext2_fs_t * fs, ext2_disk_cache_entry_t * ent, unsigned int block_no) {
+	if(ent->block_no) {
+		list_delete(cache_bucket(fs, ent->block_no), &ent->hash_node);
+		fs->cache_stats.evictions++;
+	}
+	ent->block_no = block_no;
+	list_append(cache_bucket(fs, block_no), &ent->hash_node);
+	cache_touch(fs, ent);
+	fs->cache_stats.misses++;
+}
+
+static char cache_timer_init(void) {
+	if(!ext2_ticks) {
+		ext2_ticks    = (unsigned long*)symbol_find((char*)"timer_ticks");
+		ext2_subticks = (unsigned long*)symbol_find((char*)"timer_subticks");
+	}
+	return ext2_ticks && ext2_subticks;
+}
+
 /**
- * ext2->get_cache_time Increment and return the current cache time
+ * ext2->cache_mark_dirty Mark a cache entry as dirty. Must be called with the lock held.
  *
- * @returns Current cache time
+ * The entry ages from the moment it first got dirty: writing to it again doesn't hold its writeback back.
  */
-static unsigned int get_cache_time(ext2_fs_t * fs) {
-	return fs->cache_time++;
+static void cache_mark_dirty(ext2_fs_t * fs, ext2_disk_cache_entry_t * ent) {
+	if(ent->dirty)
+		return;
+	ent->dirty = 1;
+	ent->dirtied = cache_timer_init() ? *ext2_ticks : 0;
+	fs->dirty_count++;
+}
+
+/* Shell sort of cache entry numbers, by the block they hold: */
+static void cache_sort(ext2_fs_t * fs, uint32_t * ents, unsigned int count) {
+	for(unsigned int gap = count / 2; gap; gap /= 2) {
+		for(unsigned int i = gap; i < count; i++) {
+			uint32_t ent = ents[i];
+			unsigned int j = i;
+			for(; j >= gap && DC[ents[j - gap]].block_no > DC[ent].block_no; j -= gap)
+				ents[j] = ents[j - gap];
+			ents[j] = ent;
+		}
+	}
 }
 
 /**
- * ext2->cache_flush_dirty Flush dirty cache entry to the disk.
+ * ext2->cache_writeback Write back the entries that got dirty at tick 'dirtied_before' or earlier.
  *
- * @param ent_no Cache entry to dump
- * @returns Error code or E_SUCCESS
+ * They go out in ascending block order, and every run of consecutive blocks is handed
+ * to the block device as a single write. The lock is only held to pick the entries and to copy them out,
+ * so readers and writers aren't kept waiting on the disk. The entries can't be evicted while they're
+ * being written back, so nobody reads a stale copy of them from the disk in the meantime.
+ * (An entry under I/O is left alone: it's either being read in, or already being written out.)
+ *
+ * @param dirtied_before Oldest tick to leave alone. UINT32_MAX writes back everything
+ * @returns Number of blocks written back
  */
-static int cache_flush_dirty(ext2_fs_t * fs, unsigned int ent_no) {
-	fwrite(fs->block_device, (DC[ent_no].block_no) * fs->block_size, fs->block_size, (uint8_t *)(DC[ent_no].block));
-	DC[ent_no].dirty = 0;
-	return E_SUCCESS;
+static unsigned int cache_writeback(ext2_fs_t * fs, unsigned long dirtied_before) {
+	if(!DC) return 0;
+
+	spin_lock(fs->lock);
+	if(!fs->dirty_count) {
+		spin_unlock(fs->lock);
+		return 0;
+	}
+	/* Claim the entries (the ones claimed by someone else already are theirs): */
+	uint32_t * ents = (uint32_t*)malloc(sizeof(uint32_t) * fs->dirty_count);
+	unsigned int count = 0;
+	for(unsigned int i = 0; i < fs->cache_entries && count < fs->dirty_count; i++) {
+		if(DC[i].dirty && !DC[i].writeback && !DC[i].io && DC[i].dirtied <= dirtied_before) {
+			DC[i].writeback = 1;
+			ents[count++] = i;
+		}
+	}
+	fs->writeback_count += count;
+	spin_unlock(fs->lock);
+
+	cache_sort(fs, ents, count);
+
+	uint8_t * batch = (uint8_t*)malloc(EXT2_WRITEBACK_BATCH * fs->block_size);
+	for(unsigned int first = 0; first < count;) {
+		/* Gather a run of consecutive blocks: */
+		unsigned int run = 1;
+		while(first + run < count && run < EXT2_WRITEBACK_BATCH && DC[ents[first + run]].block_no == DC[ents[first]].block_no + run)
+			run++;
+
+		/* Copy them out as they are now. Writing to them from here on dirties them again: */
+		spin_lock(fs->lock);
+		for(unsigned int i = 0; i < run; i++) {
+			memcpy(batch + i * fs->block_size, DC[ents[first + i]].block, fs->block_size);
+			DC[ents[first + i]].dirty = 0;
+			fs->dirty_count--;
+		}
+		fs->cache_stats.writebacks += run;
+		spin_unlock(fs->lock);
+
+		fwrite(fs->block_device, DC[ents[first]].block_no * fs->block_size, run * fs->block_size, batch);
+
+		spin_lock(fs->lock);
+		for(unsigned int i = 0; i < run; i++)
+			DC[ents[first + i]].writeback = 0;
+		fs->writeback_count -= run;
+		char done = !fs->writeback_count;
+		spin_unlock(fs->lock);
+		if(done && fs->writeback_wait->length)
+			wakeup_queue(fs->writeback_wait);
+		first += run;
+	}
+	free(batch);
+	free(ents);
+	return count;
 }
 
-/****** BLOCK / INODE READERS / WRITERS ******/
+/* Writers that find too much of the cache dirty write it back themselves, instead of letting it grow further: */
+static void cache_throttle(ext2_fs_t * fs) {
+	if(fs->dirty_count > fs->cache_entries * dirty_ratio / 100)
+		cache_writeback(fs, UINT32_MAX);
+}
 
-static unsigned int allocate_block(ext2_fs_t * fs) {
-	unsigned int block_no = 0;
-	unsigned int block_offset = 0;
-	unsigned int group = 0;
-	uint8_t * bg_buffer = (uint8_t*)malloc(fs->block_size);
-
-	for(unsigned int i = 0; i < fs->block_group_count; i++) {
-		if(fs->block_groups[i].free_blocks_count > 0) {
-			read_block(fs, fs->block_groups[i].block_bitmap, (uint8_t*)bg_buffer);
-			while(BLOCKBIT(block_offset))
-				block_offset++;
-			block_no = block_offset + SB->blocks_per_group * i;
-			group = i;
-			break;
+/**
+ * ext2->ext2_writeback The writeback tasklet.
+ *
+ * Wakes up every EXT2_WRITEBACK_INTERVAL seconds and writes back, on every mounted filesystem,
+ * whatever has been dirty for longer than 'writeback_age' seconds.
+ */
+static void ext2_writeback(void * arg, char * name) {
+	for(;;) {
+		IRQ_OFF();
+		sleep_until(current_task_get(), *ext2_ticks + EXT2_WRITEBACK_INTERVAL, *ext2_subticks);
+		switch_task(0);
+		IRQ_RES();
+
+		unsigned long now = *ext2_ticks;
+		if(now < writeback_age)
+			continue;
+		/* The page cache's old enough pages first, so that they make it to the disk in this same pass: */
+		pagecache_writeback(writeback_age);
+		foreach(it, ext2_mounts) {
+			/* The inodes go to the inode table first, so their blocks get to age like any other: */
+			icache_flush((ext2_fs_t*)it->value);
+			cache_writeback((ext2_fs_t*)it->value, now - writeback_age);
 		}
 	}
+}
 
-	if(!block_no) {
-		kprintf("\n\t> ERROR: No available blocks. Disk is out of space!");
-		free(bg_buffer);
+static uintptr_t writeback_start(void) {
+	if(writeback_running)
 		return 0;
-	}
+	if(!cache_timer_init())
+		return IOCTL_NULL; /* Nothing to wake it up. The cache is written back by sync and by throttled writers alone */
+	writeback_running = 1;
+	task_create_tasklet(ext2_writeback, (char*)"[ext2-writeback]", 0);
+	return 0;
+}
 
-	BLOCKBYTE(block_offset) |= SETBIT(block_offset);
-	write_block(fs, fs->block_groups[group].block_bitmap, (uint8_t*)bg_buffer);
+/****** BLOCK / INODE READERS / WRITERS ******/
 
-	fs->block_groups[group].free_blocks_count--;
-	for(int i = 0; i <fs->bgd_block_span; i++)
-		write_block(fs, fs->bgd_offset + i, (uint8_t *)((uint32_t)fs->block_groups + fs->block_size * i));
+/**
+ * ext2->allocate_blocks Allocate a run of consecutive blocks.
+ *
+ * The search starts at 'goal' (in its group), else where the last allocation in the group ended,
+ * and then goes on to the groups after it. The run ends at the first block that's in use.
+ *
+ * @param goal  Block we'd like to get. 0 for no preference
+ * @param max   Most blocks wanted
+ * @param first First block of the run
+ * @returns Number of blocks in the run. 0 if the disk is full
+ */
+static unsigned int allocate_blocks(ext2_fs_t * fs, unsigned int goal, unsigned int max, unsigned int * first) {
+	uint32_t goal_group = 0;
+	char has_goal = goal >= SB->first_data_block && goal < SB->blocks_count;
+	if(has_goal)
+		goal_group = (goal - SB->first_data_block) / SB->blocks_per_group;
+
+	for(unsigned int n = 0; n < fs->block_group_count; n++) {
+		uint32_t group = (goal_group + n) % fs->block_group_count;
+		if(!fs->block_groups[group].free_blocks_count)
+			continue;
+		uint32_t * map = group_bitmap(fs, group, 0);
+		uint32_t nbits = group_block_count(fs, group);
+		uint32_t start = has_goal && !n ? (goal - SB->first_data_block) % SB->blocks_per_group : fs->groups[group].block_hint;
+
+		spin_lock(fs->alloc_lock);
+		uint32_t bit = bitmap_find_free(map, nbits, start);
+		unsigned int count = 0;
+		if(bit < nbits)
+			while(count < max && bit + count < nbits && count < fs->block_groups[group].free_blocks_count && !BITMAP_TEST(map, bit + count)) {
+				BITMAP_SET(map, bit + count);
+				count++;
+			}
+		if(!count) {
+			spin_unlock(fs->alloc_lock);
+			continue;
+		}
+		fs->groups[group].block_hint = bit + count;
+		fs->block_groups[group].free_blocks_count -= count;
+		SB->free_blocks_count -= count;
+		spin_unlock(fs->alloc_lock);
 
-	SB->free_blocks_count--;
-	rewrite_superblock(fs);
+		write_block(fs, fs->block_groups[group].block_bitmap, (uint8_t*)map);
+		write_group_descriptors(fs);
+		rewrite_superblock(fs);
 
-	memset(bg_buffer, 0, fs->block_size);
-	write_block(fs, block_no, bg_buffer);
+		*first = SB->first_data_block + group * SB->blocks_per_group + bit;
+		return count;
+	}
 
-	free(bg_buffer);
+	kprintf("\n\t> ERROR: No available blocks. Disk is out of space!");
+	return 0;
+}
+
+/* A single, zeroed, block. For the indirect blocks: */
+static unsigned int allocate_block(ext2_fs_t * fs, unsigned int goal) {
+	unsigned int block_no;
+	if(!allocate_blocks(fs, goal, 1, &block_no))
+		return 0;
+
+	uint8_t * zero = (uint8_t*)malloc(fs->block_size);
+	memset(zero, 0, fs->block_size);
+	write_block(fs, block_no, zero);
+	free(zero);
 	return block_no;
 }
 
@@ -1094,18 +1776,18 @@ static unsigned int allocate_block(ext2_fs_t * fs) {
  * ext2->inode_read_block
  *
  * @param inode
- * @param no
+ * @param inode_no Number of the inode, for its block map. 0 bypasses it
  * @param block
  * @parma buf
  * @returns Real block number for reference.
  */
-static unsigned int inode_read_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int block, uint8_t * buff) {
+static unsigned int inode_read_block(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, uint8_t * buff) {
 	if(block >= inode->blocks / (fs->block_size / 512)) {
 		memset(buff, 0, fs->block_size);
 		/* ERROR: Tried to read an invalid block. */
 		return 0;
 	}
-	unsigned int real_block = get_block_number(fs, inode, block);
+	unsigned int real_block = get_block_number(fs, inode, inode_no, block);
 	read_block(fs, real_block, buff);
 	return real_block;
 }
@@ -1119,62 +1801,242 @@ static unsigned int inode_write_block(ext2_fs_t * fs, ext2_inodetable_t * inode,
 		//kprintf(" (Inode %d, Block %d)", inode_no, block);
 	}
 
-	char * empty = 0;
-	while(block >= inode->blocks / (fs->block_size / 512)) {
-		allocate_inode_block(fs, inode, inode_no, inode->blocks / (fs->block_size / 512));
-		refresh_inode(fs, inode, inode_no);
-	}
-
-	if(empty) free(empty);
+	inode_grow(fs, inode, inode_no, block, 0, 0);
 
-	unsigned int real_block = get_block_number(fs, inode, block);
+	unsigned int real_block = get_block_number(fs, inode, inode_no, block);
 	write_block(fs, real_block, buff);
 	return real_block;
 }
 
-static void refresh_inode(ext2_fs_t * fs, ext2_inodetable_t * inodet, uint32_t inode) {
-	uint32_t group = inode / fs->inodes_per_group;
-	if(group > fs->block_group_count)
-		return;
+/**
+ * ext2->inode_grow Allocate the inode's blocks up to 'block' (included), if they aren't already.
+ * They're allocated in as few runs as the free space allows.
+ *
+ * @param full_first First block the caller is going to overwrite whole (no need to zero it)
+ * @param full_end   Block after the last one
+ * @returns Number of blocks the inode has now. At most 'block' if the disk filled up
+ */
+static unsigned int inode_grow(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, unsigned int full_first, unsigned int full_end) {
+	unsigned int have;
+	while(block >= (have = inode->blocks / (fs->block_size / 512))) {
+		if(!allocate_inode_blocks(fs, inode, inode_no, have, block + 1 - have, full_first, full_end))
+			break;
+	}
+	return inode->blocks / (fs->block_size / 512);
+}
+
+/**
+ * ext2->inode_block_run Map a run of inode blocks that are also consecutive on the disk.
+ *
+ * @param block  First inode block
+ * @param max    Most blocks wanted
+ * @param rblock Real block of the first one. 0 if it's a hole (or isn't allocated), and then the run is just that block
+ * @returns Number of blocks in the run
+ */
+static unsigned int inode_block_run(ext2_fs_t * fs, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, unsigned int max, unsigned int * rblock) {
+	unsigned int allocated = inode->blocks / (fs->block_size / 512);
+	*rblock = block < allocated ? get_block_number(fs, inode, inode_no, block) : 0;
+	if(!*rblock)
+		return 1;
+
+	unsigned int count = 1;
+	while(count < max && block + count < allocated && get_block_number(fs, inode, inode_no, block + count) == *rblock + count)
+		count++;
+	return count;
+}
+
+/* Where inode 'inode' is in the inode table. Returns the block (0 if there's no such inode): */
+static uint32_t inode_table_block(ext2_fs_t * fs, uint32_t inode, uint32_t * offset) {
+	uint32_t group = (inode - 1) / fs->inodes_per_group;
+	if(!inode || group >= fs->block_group_count)
+		return 0;
 
 	/* Calculate inode location: */
-	uint32_t inode_table_block = fs->block_groups[group].inode_table;
+	uint32_t table_block = fs->block_groups[group].inode_table;
 	inode -= group * fs->inodes_per_group; /* Adjust index within group */
 	uint32_t block_offset = ((inode - 1) * fs->inode_size) / fs->block_size;
-	uint32_t offset_in_block = (inode - 1) - block_offset * (fs->block_size / fs->inode_size);
+	*offset = ((inode - 1) - block_offset * (fs->block_size / fs->inode_size)) * fs->inode_size;
+	return table_block + block_offset;
+}
+
+static void read_inode_table(ext2_fs_t * fs, ext2_inodetable_t * inodet, uint32_t inode) {
+	uint32_t offset;
+	uint32_t block_no = inode_table_block(fs, inode, &offset);
+	if(!block_no)
+		return;
 
 	/* Read the inode (from ATA) and cast into inode structure: */
 	uint8_t * buff = (uint8_t*)malloc(fs->block_size);
-	read_block(fs, inode_table_block + block_offset, buff);
+	read_block(fs, block_no, buff);
+	memcpy(inodet, buff + offset, fs->inode_size);
+	free(buff);
+}
+
+static int write_inode_table(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t index) {
+	uint32_t offset;
+	uint32_t block_no = inode_table_block(fs, index, &offset);
+	if(!block_no)
+		return E_BADBLOCK;
 
-	/* Prepare inodet: */
-	ext2_inodetable_t * inodes = (ext2_inodetable_t*)buff;
-	memcpy(inodet, (uint8_t*)((uint32_t)inodes + offset_in_block * fs->inode_size), fs->inode_size);
+	uint8_t * buff = (uint8_t*)malloc(fs->block_size);
+	/* Read the current table block: */
+	read_block(fs, block_no, buff);
+	memcpy(buff + offset, inode, fs->inode_size);
+	write_block(fs, block_no, buff);
 	free(buff);
+	return E_SUCCESS;
 }
 
-static ext2_inodetable_t * read_inode(ext2_fs_t * fs, uint32_t inode) {
-	ext2_inodetable_t * inodet = (ext2_inodetable_t*)malloc(fs->inode_size);
-	refresh_inode(fs, inodet, inode);
-	return inodet;
+/****** INODE CACHE ******/
+static inline list_t * icache_bucket(ext2_fs_t * fs, uint32_t inode) {
+	return &fs->icache_hash[inode & (EXT2_ICACHE_HASH - 1)];
 }
 
-static int write_inode(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t index) {
-	uint32_t group = index / fs->inodes_per_group;
-	if(group > fs->block_group_count)
-		return E_BADBLOCK;
+static ext2_icache_entry_t * icache_find(ext2_fs_t * fs, uint32_t inode) {
+	foreach(it, icache_bucket(fs, inode)) {
+		ext2_icache_entry_t * ent = (ext2_icache_entry_t*)it->value;
+		if(ent->inode == inode)
+			return ent;
+	}
+	return 0;
+}
 
-	uint32_t inode_table_block = fs->block_groups[group].inode_table;
-	index -= group * fs->inodes_per_group;
-	uint32_t block_offset = ((index - 1) * fs->inode_size) / fs->block_size;
-	uint32_t offset_in_block = (index - 1) - block_offset * (fs->block_size / fs->inode_size);
+/* Takes a reference on a cached inode. Called with the lock held: */
+static ext2_inodetable_t * icache_get(ext2_fs_t * fs, ext2_icache_entry_t * ent) {
+	ent->refcount++;
+	list_delete(&fs->icache_lru, &ent->lru_node);
+	list_append(&fs->icache_lru, &ent->lru_node);
+	return ICACHE_INODE(ent);
+}
 
-	ext2_inodetable_t * inodet = (ext2_inodetable_t*)malloc(fs->block_size);
-	/* Read the current table block: */
-	read_block(fs, inode_table_block + block_offset, (uint8_t*)inodet);
-	memcpy((uint8_t *)((uint32_t)inodet + offset_in_block * fs->inode_size), inode, fs->inode_size);
-	write_block(fs, inode_table_block + block_offset, (uint8_t*)inodet);
-	free(inodet);
+/*
+ * Writes a dirty inode to the inode table. Called, and returns, with the lock held.
+ * The reference keeps it cached meanwhile, so nobody reads the old copy from the table.
+ * What gets written is a copy taken under the inode's lock, so it's never half updated:
+ */
+static void icache_writeback(ext2_fs_t * fs, ext2_icache_entry_t * ent) {
+	ent->refcount++;
+	ent->dirty = 0; /* Changes from here on dirty it again */
+	list_delete(&fs->icache_dirty, &ent->dirty_node);
+	spin_unlock(fs->icache_lock);
+
+	ext2_inodetable_t * copy = (ext2_inodetable_t*)malloc(fs->inode_size);
+	spin_lock(ent->lock);
+	memcpy(copy, ICACHE_INODE(ent), fs->inode_size);
+	spin_unlock(ent->lock);
+	write_inode_table(fs, copy, ent->inode);
+	free(copy);
+
+	spin_lock(fs->icache_lock);
+	ent->refcount--;
+}
+
+/*
+ * Writes every dirty inode to the inode table (which is in the block cache).
+ * Each one leaves the dirty list before the lock is dropped, so the list can't change under us.
+ * Only the ones dirty on entry: those dirtied meanwhile are left for the next flush.
+ */
+static void icache_flush(ext2_fs_t * fs) {
+	spin_lock(fs->icache_lock);
+	size_t count = fs->icache_dirty.length;
+	while(count-- && fs->icache_dirty.head)
+		icache_writeback(fs, (ext2_icache_entry_t*)fs->icache_dirty.head->value);
+	spin_unlock(fs->icache_lock);
+}
+
+/* Evicts the least recently used inodes nobody is using, until the cache is back to its size: */
+static void icache_shrink(ext2_fs_t * fs) {
+	spin_lock(fs->icache_lock);
+	node_t * it = fs->icache_lru.head;
+	while(it && fs->icache_lru.length > EXT2_ICACHE_ENTRIES) {
+		ext2_icache_entry_t * ent = (ext2_icache_entry_t*)it->value;
+		if(ent->refcount) {
+			it = it->next;
+			continue;
+		}
+		if(ent->dirty) {
+			icache_writeback(fs, ent);
+			continue; /* Look at it again: it might have been used meanwhile */
+		}
+		it = it->next;
+		list_delete(icache_bucket(fs, ent->inode), &ent->hash_node);
+		list_delete(&fs->icache_lru, &ent->lru_node);
+		free(ent);
+	}
+	spin_unlock(fs->icache_lock);
+}
+
+/**
+ * ext2->read_inode Get an inode, through the inode cache.
+ *
+ * Everyone reading the same inode shares the same copy: changes made to it are seen by everyone right away,
+ * and get written out after write_inode() is called. Give it back with release_inode().
+ *
+ * @param inode Number of the inode
+ * @returns The inode
+ */
+static ext2_inodetable_t * read_inode(ext2_fs_t * fs, uint32_t inode) {
+	spin_lock(fs->icache_lock);
+	ext2_icache_entry_t * ent = icache_find(fs, inode);
+	if(ent) {
+		ext2_inodetable_t * inodet = icache_get(fs, ent);
+		spin_unlock(fs->icache_lock);
+		return inodet;
+	}
+	spin_unlock(fs->icache_lock);
+
+	/* It's not cached. Read it from the inode table without holding the lock: */
+	ext2_icache_entry_t * fresh = (ext2_icache_entry_t*)malloc(sizeof(ext2_icache_entry_t) + fs->inode_size);
+	memset(fresh, 0, sizeof(ext2_icache_entry_t) + fs->inode_size);
+	fresh->inode = inode;
+	fresh->hash_node.value = fresh;
+	fresh->lru_node.value = fresh;
+	fresh->dirty_node.value = fresh;
+	read_inode_table(fs, ICACHE_INODE(fresh), inode);
+
+	spin_lock(fs->icache_lock);
+	ent = icache_find(fs, inode);
+	if(ent) {
+		/* Someone else read it in meanwhile. Theirs might have been changed already: */
+		ext2_inodetable_t * inodet = icache_get(fs, ent);
+		spin_unlock(fs->icache_lock);
+		free(fresh);
+		return inodet;
+	}
+	list_append(icache_bucket(fs, inode), &fresh->hash_node);
+	list_append(&fs->icache_lru, &fresh->lru_node);
+	fresh->refcount = 1;
+	char full = fs->icache_lru.length > EXT2_ICACHE_ENTRIES;
+	spin_unlock(fs->icache_lock);
+
+	if(full)
+		icache_shrink(fs);
+	return ICACHE_INODE(fresh);
+}
+
+/* Gives back an inode from read_inode(): */
+static void release_inode(ext2_fs_t * fs, ext2_inodetable_t * inode) {
+	spin_lock(fs->icache_lock);
+	ICACHE_ENTRY(inode)->refcount--;
+	spin_unlock(fs->icache_lock);
+}
+
+/**
+ * ext2->write_inode The inode (from read_inode()) was changed. It only gets marked dirty here:
+ * it goes to the inode table on the next ext2_sync, writeback tasklet pass, or when it gets evicted.
+ *
+ * @param inode Inode that was changed
+ * @param index Its number
+ * @returns Error code or E_SUCCESS
+ */
+static int write_inode(ext2_fs_t * fs, ext2_inodetable_t * inode, uint32_t index) {
+	spin_lock(fs->icache_lock);
+	ext2_icache_entry_t * ent = ICACHE_ENTRY(inode);
+	if(!ent->dirty) {
+		ent->dirty = 1;
+		list_append(&fs->icache_dirty, &ent->dirty_node);
+	}
+	spin_unlock(fs->icache_lock);
 	return E_SUCCESS;
 }
 
@@ -1191,47 +2053,47 @@ static int write_block(ext2_fs_t * fs, unsigned int block_no, uint8_t *buff) {
 		return E_BADBLOCK;
 	}
 
-	spin_lock(fs->lock);
 	if(!DC) {
 		/* Write to block device (such as ATA): */
 		fwrite(fs->block_device, block_no * fs->block_size, fs->block_size, buff);
-		spin_unlock(fs->lock);
 		return E_SUCCESS;
 	}
 
-	/* Else: Find the entry in the cache: */
-	int oldest = -1;
-	unsigned int oldest_age = UINT32_MAX;
-	for(unsigned int i = 0; i < fs->cache_entries; i++) {
-		if(DC[i].block_no == block_no) {
+	spin_lock(fs->lock);
+	for(;;) {
+		/* Else: Find the entry in the cache: */
+		ext2_disk_cache_entry_t * ent = cache_find(fs, block_no);
+		if(ent) {
+			if(ent->io) {
+				cache_wait_io(fs, ent);
+				continue;
+			}
 			/* We found it. Update the cache entry */
-			DC[i].last_use = get_cache_time(fs);
-			DC[i].dirty = 1;
-			memcpy(DC[i].block, buff, fs->block_size);
-			spin_unlock(fs->lock);
-			return E_SUCCESS;
-		}
-		if(DC[i].last_use < oldest_age) {
-			/* Keep track of the oldest entry */
-			oldest = i;
-			oldest_age = DC[i].last_use;
+			fs->cache_stats.hits++;
+			cache_touch(fs, ent);
+		} else {
+			/* We did not find this element in the cache, so make room */
+			ent = cache_victim(fs);
+			if(!ent) {
+				/* Everything is busy. Go around the cache: */
+				spin_unlock(fs->lock);
+				fwrite(fs->block_device, block_no * fs->block_size, fs->block_size, buff);
+				return E_SUCCESS;
+			}
+			if(ent->dirty) {
+				cache_flush_victim(fs, ent);
+				continue; /* The lock was let go of, so the block might be in by now */
+			}
+			/* The whole block is overwritten, so there's nothing to read in: */
+			cache_reuse(fs, ent, block_no);
 		}
-	}
-
-	/* We did not find this element in the cache, so make room */
-	if(DC[oldest].dirty)
-		/* Flush the oldest entry */
-		cache_flush_dirty(fs, oldest);
 
-	/* Update the entry: */
-	memcpy(DC[oldest].block, buff, fs->block_size);
-	DC[oldest].block_no = block_no;
-	DC[oldest].last_use = get_cache_time(fs);
-	DC[oldest].dirty = 1;
-
-	/* Done: */
-	spin_unlock(fs->lock);
-	return E_SUCCESS;
+		memcpy(ent->block, buff, fs->block_size);
+		cache_mark_dirty(fs, ent);
+		spin_unlock(fs->lock);
+		cache_throttle(fs);
+		return E_SUCCESS;
+	}
 }
 
 /**
@@ -1247,63 +2109,149 @@ static int read_block(ext2_fs_t * fs, unsigned int block_no, uint8_t * buff) {
 	/* 0 is an invalid block number. So is anything beyond the total block count, but we can't check that. */
 	if(!block_no) return E_BADBLOCK;
 
-	/* This operation requires the filesystem lock to be obtained */
-	spin_lock(fs->lock);
-
 	/* Read directory from the block device (e.g.: ATA): */
 	if(!DC) {
 		fread(fs->block_device, block_no * fs->block_size, fs->block_size, (uint8_t*)buff);
-		/* Done reading: */
-		spin_unlock(fs->lock);
 		return E_SUCCESS;
 	}
+
 	/* Otherwise read from cache */
+	spin_lock(fs->lock);
+	for(;;) {
+		ext2_disk_cache_entry_t * ent = cache_find(fs, block_no);
+		if(ent) {
+			if(ent->io) {
+				/* Someone else is reading it in (or flushing it out). Wait for them and look again: */
+				cache_wait_io(fs, ent);
+				continue;
+			}
+			/* We found it! Read the block: */
+			fs->cache_stats.hits++;
+			cache_touch(fs, ent);
+			memcpy(buff, ent->block, fs->block_size);
+			spin_unlock(fs->lock);
+			return E_SUCCESS;
+		}
 
-	/*
-	 * Search the cache for this entry
-	 * We'll look for the oldest entry, too.
-	 */
-	int oldest = -1;
-	unsigned int oldest_age = UINT32_MAX;
-	for(unsigned int i = 0; i < fs->cache_entries; i++) {
-		if(DC[i].block_no == block_no) {
-			/* We found it! Update usage times */
-			DC[i].last_use = get_cache_time(fs);
-			/* Read the block: */
-			memcpy(buff, DC[i].block, fs->block_size);
-			/* Done reading: */
+		/*
+		 * At this point, we did not find this block in the cache.
+		 * We are going to replace the least recently used entry with this new one.
+		 */
+		ent = cache_victim(fs);
+		if(!ent) {
+			/* Everything is busy. Go around the cache: */
 			spin_unlock(fs->lock);
+			fread(fs->block_device, block_no * fs->block_size, fs->block_size, (uint8_t*)buff);
 			return E_SUCCESS;
 		}
-		if(DC[i].last_use < oldest_age) {
-			/* We found an older block, remember this */
-			oldest = i;
-			oldest_age = DC[i].last_use;
+		if(ent->dirty) {
+			cache_flush_victim(fs, ent);
+			continue; /* The lock was let go of, so the block might be in by now */
 		}
+
+		/* Then we'll read the new one, with only this entry locked: */
+		cache_reuse(fs, ent, block_no);
+		ent->io = 1;
+		spin_unlock(fs->lock);
+		fread(fs->block_device, block_no * fs->block_size, fs->block_size, ent->block);
+		memcpy(buff, ent->block, fs->block_size);
+
+		spin_lock(fs->lock);
+		ent->io = 0;
+		spin_unlock(fs->lock);
+		return E_SUCCESS;
 	}
+}
 
-	/*
-	 * At this point, we did not find this block in the cache.
-	 * We are going to replace the oldest entry with this new one.
-	 */
+/**
+ * ext2->read_blocks Read a run of consecutive blocks.
+ *
+ * Blocks that are in the cache come from it. Each run of blocks that aren't is read
+ * from the block device with a single call, straight into 'buff' (without filling the cache).
+ *
+ * @param block_no First block to read
+ * @param count    Blocks to read
+ * @param buff     Where to put them
+ * @returns Error code or E_SUCCESS
+ */
+static int read_blocks(ext2_fs_t * fs, unsigned int block_no, unsigned int count, uint8_t * buff) {
+	if(!block_no) return E_BADBLOCK;
 
-	/* We'll start by flushing the block if it was dirty */
-	if(DC[oldest].dirty)
-		cache_flush_dirty(fs, oldest);
+	if(!DC) {
+		fread(fs->block_device, block_no * fs->block_size, count * fs->block_size, buff);
+		return E_SUCCESS;
+	}
 
-	/* Then we'll read the new one */
-	fread(fs->block_device, block_no * fs->block_size, fs->block_size, (uint8_t *)DC[oldest].block);
+	for(unsigned int i = 0; i < count;) {
+		spin_lock(fs->lock);
+		unsigned int run = 0;
+		while(i + run < count && !cache_find(fs, block_no + i + run))
+			run++;
+		spin_unlock(fs->lock);
 
-	/* And copy the results to the output buffer */
-	memcpy(buff, DC[oldest].block, fs->block_size);
+		if(!run) {
+			/* Cached (its copy might be newer than the disk's) */
+			read_block(fs, block_no + i, buff + i * fs->block_size);
+			i++;
+			continue;
+		}
+		fread(fs->block_device, (block_no + i) * fs->block_size, run * fs->block_size, buff + i * fs->block_size);
+		i += run;
+	}
+	return E_SUCCESS;
+}
 
-	/* And update the cache entry to point to the new block */
-	DC[oldest].block_no = block_no;
-	DC[oldest].last_use = get_cache_time(fs);
-	DC[oldest].dirty = 0;
+/**
+ * ext2->write_blocks Write a run of consecutive blocks.
+ *
+ * Blocks that are in the cache get written there. Each run of blocks that aren't is written
+ * to the block device with a single call, straight from 'buff'.
+ *
+ * @param block_no First block to write
+ * @param count    Blocks to write
+ * @param buff     Data in the blocks
+ * @returns Error code or E_SUCCESS
+ */
+static int write_blocks(ext2_fs_t * fs, unsigned int block_no, unsigned int count, uint8_t * buff) {
+	if(block_no == 0) {
+		kprintf("\n\t> ERROR: Attempted to write to block #0. Aborting");
+		return E_BADBLOCK;
+	}
 
-	/* Done reading: */
-	spin_unlock(fs->lock);
+	if(!DC) {
+		fwrite(fs->block_device, block_no * fs->block_size, count * fs->block_size, buff);
+		return E_SUCCESS;
+	}
+
+	for(unsigned int i = 0; i < count;) {
+		spin_lock(fs->lock);
+		unsigned int run = 0;
+		while(i + run < count && !cache_find(fs, block_no + i + run))
+			run++;
+		spin_unlock(fs->lock);
+
+		if(!run) {
+			write_block(fs, block_no + i, buff + i * fs->block_size);
+			i++;
+			continue;
+		}
+		fwrite(fs->block_device, (block_no + i) * fs->block_size, run * fs->block_size, buff + i * fs->block_size);
+
+		/*
+		 * Someone might have read one of them into the cache while we were writing, and gotten what was there before.
+		 * Clean copies are brought up to date. Dirty ones (and ones being written back) were written after us, so they stay:
+		 */
+		spin_lock(fs->lock);
+		for(unsigned int k = 0; k < run; k++) {
+			ext2_disk_cache_entry_t * ent;
+			while((ent = cache_find(fs, block_no + i + k)) && ent->io)
+				cache_wait_io(fs, ent);
+			if(ent && !ent->dirty && !ent->writeback)
+				memcpy(ent->block, buff + (i + k) * fs->block_size, fs->block_size);
+		}
+		spin_unlock(fs->lock);
+		i += run;
+	}
 	return E_SUCCESS;
 }
 
@@ -1353,7 +2301,7 @@ static uint32_t ext2_make_rootfile(ext2_fs_t * fs, ext2_inodetable_t * inode, FI
 	file_node->mtime = inode->mtime;
 	file_node->ctime = inode->ctime;
 
-	file_node->flags |= FS_DIR;
+	file_node->flags |= FS_DIR | FS_DCACHE;
 	file_node->read = 0;
 	file_node->write = 0;
 	file_node->chmod = ext2_chmod;
@@ -1365,10 +2313,11 @@ static uint32_t ext2_make_rootfile(ext2_fs_t * fs, ext2_inodetable_t * inode, FI
 	file_node->create = ext2_create;
 	file_node->mkdir = ext2_mkdir;
 	file_node->unlink = ext2_unlink;
+	file_node->fsync = ext2_fsync;
 	return 1;
 }
 
-static FILE * mount_ext2(FILE * blockdev) {
+static FILE * mount_ext2(FILE * blockdev, int cache_entries) {
 	ext2_fs_t * fs = (ext2_fs_t*)malloc(sizeof(ext2_fs_t));
 	memset(fs, 0, sizeof(ext2_fs_t));
 	fs->block_device = blockdev;
@@ -1392,9 +2341,11 @@ static FILE * mount_ext2(FILE * blockdev) {
 		fs->inode_size = 128;
 
 	fs->block_size = 1024 << SB->log_block_size;
-	fs->cache_entries = 10240;
-	if(fs->block_size > 2048)
-		fs->cache_entries /= 4;
+	if(cache_entries < 0) {
+		cache_entries = EXT2_CACHE_ENTRIES;
+		if(fs->block_size > 2048)
+			cache_entries /= 4;
+	}
 
 	fs->pointer_per_block = fs->block_size / 4;
 
@@ -1404,22 +2355,34 @@ static FILE * mount_ext2(FILE * blockdev) {
 
 	fs->inodes_per_group = SB->inodes_count / fs->block_group_count;
 
-#if USE_CACHE == 1
-	is_using_cache = 1;
-	/* Allocating cache: */
-	DC = (ext2_disk_cache_entry_t*)malloc(sizeof(ext2_disk_cache_entry_t));
-
-	uint32_t cache_size = fs->block_size * fs->cache_entries;
-	kprintf("\n\t> Allocating Disk Cache (Size: %d MB / %d KB / %d)\n", (cache_size / 1000) / 1000, cache_size / 1000, cache_size);
-	fs->cache_data = (uint8_t*)malloc(cache_size);
-	memset(fs->cache_data, 0, cache_size);
-	for(uint32_t i = 0; i < fs->cache_entries; i++) {
-		DC[i].block_no = 0;
-		DC[i].dirty = 0;
-		DC[i].last_use = 0;
-		DC[i].block = fs->cache_data + i * fs->block_size;
+	fs->writeback_wait = list_create();
+
+	if(cache_entries) {
+		/* Allocating cache: */
+		fs->cache_entries = cache_entries;
+		DC = (ext2_disk_cache_entry_t*)malloc(sizeof(ext2_disk_cache_entry_t) * fs->cache_entries);
+		memset(DC, 0, sizeof(ext2_disk_cache_entry_t) * fs->cache_entries);
+
+		uint32_t cache_size = fs->block_size * fs->cache_entries;
+		kprintf("\n\t> Allocating Disk Cache (Size: %d MB / %d KB / %d)\n", (cache_size / 1000) / 1000, cache_size / 1000, cache_size);
+		fs->cache_data = (uint8_t*)malloc(cache_size);
+		memset(fs->cache_data, 0, cache_size);
+
+		/* About two entries per bucket: */
+		fs->cache_hash_size = 16;
+		while(fs->cache_hash_size < fs->cache_entries / 2)
+			fs->cache_hash_size *= 2;
+		fs->cache_hash = (list_t*)malloc(sizeof(list_t) * fs->cache_hash_size);
+		memset(fs->cache_hash, 0, sizeof(list_t) * fs->cache_hash_size);
+
+		/* Empty entries (block 0) aren't hashed, they're just first in line to be evicted: */
+		for(uint32_t i = 0; i < fs->cache_entries; i++) {
+			DC[i].block = fs->cache_data + i * fs->block_size;
+			DC[i].hash_node.value = &DC[i];
+			DC[i].lru_node.value = &DC[i];
+			list_append(&fs->cache_lru, &DC[i].lru_node);
+		}
 	}
-#endif
 
 	/* Load Block Group Descriptors: */
 	fs->bgd_block_span = sizeof(ext2_bgdescriptor_t) * fs->block_group_count / fs->block_size + 1;
@@ -1433,29 +2396,51 @@ static FILE * mount_ext2(FILE * blockdev) {
 	for(int i = 0;i < fs->bgd_block_span; i++)
 		read_block(fs, fs->bgd_offset + i, (uint8_t*)((uint32_t)fs->block_groups + fs->block_size * i));
 
+	fs->groups = (ext2_group_t*)malloc(sizeof(ext2_group_t) * fs->block_group_count);
+	memset(fs->groups, 0, sizeof(ext2_group_t) * fs->block_group_count);
+
 	ext2_inodetable_t * root_inode = read_inode(fs, 2);
 	fs->root_node = (FILE*)malloc(sizeof(FILE));
-	if(!ext2_make_rootfile(fs, root_inode, fs->root_node))
+	char made = ext2_make_rootfile(fs, root_inode, fs->root_node);
+	release_inode(fs, root_inode);
+	if(!made)
 		return 0;
+	list_insert(ext2_mounts, fs);
 	/* Success */
 	return fs->root_node;
 }
 
 /* EXT2 mount callback registered by 'vfs_register' and called by 'vfs_mount_type': */
+/* Options may follow the device path, like in "/dev/hda,cache=4096" (size of the block cache, in blocks. 0 disables it): */
 static FILE * ext2_fs_mount(char * devpath, char * mountpath) {
-	FILE * device = kopen(devpath, 0); /* Open block device, for example ATA */
+	char * path = strdup(devpath);
+	int cache_entries = -1; /* Default */
+	char * opt = strchr(path, ',');
+	if(opt) {
+		*opt++ = '\0';
+		if(!strncmp(opt, "cache=", 6) && isdigit(opt[6])) {
+			cache_entries = 0;
+			for(opt += 6; isdigit(*opt); opt++)
+				cache_entries = cache_entries * 10 + (*opt - '0');
+		}
+	}
+
+	FILE * device = kopen(path, 0); /* Open block device, for example ATA */
 	if(!device) {
-		kprintf("\n\t> !ERROR!: Could not open '%s'", devpath);
+		kprintf("\n\t> !ERROR!: Could not open '%s'", path);
+		free(path);
 		return 0;
 	}
+	free(path);
 	/* Return ext2 filesystem: */
-	return mount_ext2(device);
+	return mount_ext2(device, cache_entries);
 }
 
 /****************************************************/
 /***** MODULE INITIALIZERS/DEINITIALIZERS/IOCTL *****/
 /****************************************************/
 static int ext2_init(void) {
+	ext2_mounts = list_create();
 	vfs_register((char*)"ext2", (vfs_mount_callback)ext2_fs_mount);
 	return 0;
 }
@@ -1465,6 +2450,33 @@ static int ext2_finit(void) {
 }
 
 static uintptr_t ext2_ioctl(void * ioctl_packet) {
+	uintptr_t * d = (uintptr_t*)ioctl_packet;
+	SWITCH_IOCTL(ioctl_packet) {
+		case EXT2_IOCTL_WRITEBACK_START: return writeback_start();
+		case EXT2_IOCTL_WRITEBACK_AGE:   writeback_age = d[1]; return 0;
+		case EXT2_IOCTL_DIRTY_RATIO:
+			if(d[1] > 100) return IOCTL_NULL;
+			dirty_ratio = d[1];
+			return 0;
+		case EXT2_IOCTL_SYNC:
+			foreach(it, ext2_mounts)
+				ext2_sync((ext2_fs_t*)it->value);
+			return 0;
+		case EXT2_IOCTL_CACHE_STATS:
+			/* d[1]: any node of the filesystem, d[2]: ext2_cache_stats_t to fill in */
+			foreach(it, ext2_mounts) {
+				ext2_fs_t * fs = (ext2_fs_t*)it->value;
+				if(!d[1] || fs != ((FILE*)d[1])->device)
+					continue;
+				spin_lock(fs->lock);
+				fs->cache_stats.entries = fs->cache_entries;
+				fs->cache_stats.dirty = fs->dirty_count;
+				memcpy((void*)d[2], &fs->cache_stats, sizeof(ext2_cache_stats_t));
+				spin_unlock(fs->lock);
+				return 0;
+			}
+			return IOCTL_NULL;
+	}
 	return 0;
 }
 
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <attr.h>
+#include <libc/list.h>
 
 /*****************************************/
 /**************** Macros: ****************/
@@ -168,12 +169,34 @@ struct ext2_dir {
 typedef struct ext2_dir ext2_dir_t;
 
 typedef struct {
-	uint32_t block_no;
-	uint32_t last_use;
+	uint32_t block_no;     /* 0 if the entry is empty */
 	uint8_t  dirty;
+	uint8_t  writeback; /* Being written back right now: it can't be evicted until it's done */
+	uint8_t  io;        /* Being read in (or flushed out to be evicted). Whoever else wants the block waits */
+	unsigned long dirtied; /* Timer tick it went from clean to dirty at */
 	uint8_t * block;
+	node_t hash_node; /* On its block's hash bucket */
+	node_t lru_node;  /* On the LRU list, most recently used at the tail */
 } ext2_disk_cache_entry_t;
 
+typedef struct {
+	uint32_t entries;
+	uint32_t dirty;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t writebacks; /* Blocks written back, by the tasklet, sync or eviction */
+} ext2_cache_stats_t;
+
+/* Module ioctls (ext2_driver): */
+enum EXT2_IOCTL {
+	EXT2_IOCTL_WRITEBACK_START, /* Starts the writeback tasklet. Needs tasking */
+	EXT2_IOCTL_WRITEBACK_AGE,   /* Seconds a block stays dirty before the tasklet writes it back */
+	EXT2_IOCTL_DIRTY_RATIO,     /* Percentage of the cache that can be dirty before writers get throttled */
+	EXT2_IOCTL_SYNC,            /* Writes back every mounted filesystem */
+	EXT2_IOCTL_CACHE_STATS      /* Fills in an ext2_cache_stats_t for the filesystem a node belongs to */
+};
+
 typedef int (*ext2_block_io_t) (void *, uint32_t, uint8_t *);
 
 #endif /* SRC_MODULES_FS_EXT2_H_ */
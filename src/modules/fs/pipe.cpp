@@ -8,6 +8,7 @@
 #include <kernel_headers/kheaders.h>
 #include <module.h>
 #include <time.h>
+#include <errno.h>
 #include "pipe.h"
 
 /******************************/
@@ -17,17 +18,17 @@ static uint32_t read_pipe(FILE * node, uint32_t offset, uint32_t size, uint8_t *
 static uint32_t write_pipe(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer);
 static uint32_t open_pipe(FILE * node, unsigned int flags);
 static uint32_t close_pipe(FILE * node);
+static int poll_pipe(FILE * node, poll_table_t * table);
 
 /****************************************/
 /**** Pipe implementation functions: ****/
 /****************************************/
+/*
+ * read_ptr and write_ptr are free-running counters. The size is a power of two,
+ * so their difference is the unread amount even after they wrap around, and masking gives the index
+ */
 static inline size_t pipe_unread(pipe_device_t * pipe) {
-	if (pipe->read_ptr == pipe->write_ptr)
-		return 0;
-	if (pipe->read_ptr > pipe->write_ptr)
-		return (pipe->size - pipe->read_ptr) + pipe->write_ptr;
-	else
-		return (pipe->write_ptr - pipe->read_ptr);
+	return pipe->write_ptr - pipe->read_ptr;
 }
 
 static int pipe_size_(FILE * node) {
@@ -35,27 +36,30 @@ static int pipe_size_(FILE * node) {
 }
 
 static inline size_t pipe_available(pipe_device_t * pipe) {
-	if (pipe->read_ptr == pipe->write_ptr)
-		return pipe->size - 1;
-
-	if (pipe->read_ptr > pipe->write_ptr)
-		return pipe->read_ptr - pipe->write_ptr - 1;
-	else
-		return (pipe->size - pipe->write_ptr) + pipe->read_ptr - 1;
+	return pipe->size - pipe_unread(pipe);
 }
 
 static int pipe_unsize_(FILE * node) {
 	return pipe_available((pipe_device_t *)node->device);
 }
 
-static inline void pipe_increment_read(pipe_device_t * pipe) {
-	if (++pipe->read_ptr == pipe->size)
-		pipe->read_ptr = 0;
+/* Copy 'size' bytes out of the pipe. Wrapping around takes at most two memcpy's: */
+static inline void pipe_copy_out(pipe_device_t * pipe, uint8_t * buffer, size_t size) {
+	size_t index = pipe->read_ptr & (pipe->size - 1);
+	size_t first = size < pipe->size - index ? size : pipe->size - index;
+	memcpy(buffer, pipe->buffer + index, first);
+	if (first < size)
+		memcpy(buffer + first, pipe->buffer, size - first);
+	pipe->read_ptr += size;
 }
 
-static inline void pipe_increment_write(pipe_device_t * pipe) {
-	if (++pipe->write_ptr == pipe->size)
-		pipe->write_ptr = 0;
+static inline void pipe_copy_in(pipe_device_t * pipe, uint8_t * buffer, size_t size) {
+	size_t index = pipe->write_ptr & (pipe->size - 1);
+	size_t first = size < pipe->size - index ? size : pipe->size - index;
+	memcpy(pipe->buffer + index, buffer, first);
+	if (first < size)
+		memcpy(pipe->buffer, buffer + first, size - first);
+	pipe->write_ptr += size;
 }
 
 /******************************/
@@ -73,16 +77,23 @@ static uint32_t read_pipe(FILE * node, uint32_t offset, uint32_t size, uint8_t *
 	size_t collected = 0;
 	while (collected == 0) {
 		spin_lock(pipe->lock_read);
-		while (pipe_unread(pipe) > 0 && collected < size) {
-			buffer[collected] = pipe->buffer[pipe->read_ptr];
-			pipe_increment_read(pipe);
-			collected++;
-		}
+		collected = pipe_unread(pipe);
+		if (collected > size)
+			collected = size;
+		pipe_copy_out(pipe, buffer, collected);
+		size_t left = pipe_unread(pipe);
 		spin_unlock(pipe->lock_read);
-		wakeup_queue(pipe->wait_queue_writers);
-		/* Deschedule and switch */
-		if (collected == 0)
-			sleep_on(pipe->wait_queue_readers);
+		if (collected) {
+			/* One writer is enough to fill the space back up. And if we left data behind, pass it on to the next reader: */
+			wakeup_queue_one(pipe->wait_queue_writers);
+			if (left)
+				wakeup_queue_one(pipe->wait_queue_readers);
+			break;
+		}
+		if (node->open_flags & O_NONBLOCK)
+			return -EAGAIN;
+		/* Deschedule and switch. Only one reader gets woken up per write: */
+		sleep_on_exclusive(pipe->wait_queue_readers);
 	}
 	return collected;
 }
@@ -99,21 +110,46 @@ static uint32_t write_pipe(FILE * node, uint32_t offset, uint32_t size, uint8_t
 	size_t written = 0;
 	while (written < size) {
 		spin_lock(pipe->lock_write);
+		size_t chunk = pipe_available(pipe);
+		if (chunk > size - written)
+			chunk = size - written;
+		pipe_copy_in(pipe, buffer + written, chunk);
+		size_t space = pipe_available(pipe);
+		spin_unlock(pipe->lock_write);
 
-		while (pipe_available(pipe) > 0 && written < size) {
-			pipe->buffer[pipe->write_ptr] = buffer[written];
-			pipe_increment_write(pipe);
-			written++;
+		written += chunk;
+		if (chunk)
+			wakeup_queue_one(pipe->wait_queue_readers);
+		if (written < size) {
+			if (node->open_flags & O_NONBLOCK)
+				return written ? written : -EAGAIN;
+			sleep_on_exclusive(pipe->wait_queue_writers);
+		} else if (space) {
+			/* Done, and there's still room for the next writer: */
+			wakeup_queue_one(pipe->wait_queue_writers);
 		}
-
-		spin_unlock(pipe->lock_write);
-		wakeup_queue(pipe->wait_queue_readers);
-		if (written < size)
-			sleep_on(pipe->wait_queue_writers);
 	}
 	return written;
 }
 
+static int poll_pipe(FILE * node, poll_table_t * table) {
+	/* Retrieve the pipe object associated with this file node */
+	pipe_device_t * pipe = (pipe_device_t *)node->device;
+
+	if (pipe->dead)
+		return POLLERR | POLLHUP;
+
+	poll_wait(pipe->wait_queue_readers, table);
+	poll_wait(pipe->wait_queue_writers, table);
+
+	int mask = 0;
+	if (pipe_unread(pipe) > 0)
+		mask |= POLLIN;
+	if (pipe_available(pipe) > 0)
+		mask |= POLLOUT;
+	return mask;
+}
+
 /******************************/
 /**** Pipe open and close: ****/
 /******************************/
@@ -136,6 +172,12 @@ static uint32_t close_pipe(FILE * node) {
 }
 
 static FILE * make_pipe_(size_t size) {
+	/* Round up to a power of two, for the index masks: */
+	size_t pow2 = 1;
+	while (pow2 < size)
+		pow2 <<= 1;
+	size = pow2;
+
 	FILE * fnode = (FILE*)malloc(sizeof(FILE));
 	pipe_device_t * pipe = (pipe_device_t*)malloc(sizeof(pipe_device_t));
 	memset(fnode, 0, sizeof(FILE));
@@ -149,6 +191,7 @@ static FILE * make_pipe_(size_t size) {
 	fnode->write = write_pipe;
 	fnode->open  = open_pipe;
 	fnode->close = close_pipe;
+	fnode->poll  = poll_pipe;
 	fnode->readdir = 0;
 	fnode->finddir = 0;
 	fnode->ioctl   = 0;
@@ -18,9 +18,9 @@
 
 typedef struct _pipe_device {
 	uint8_t * buffer;
-	size_t write_ptr;
+	size_t write_ptr; /* Free-running, masked with size - 1 */
 	size_t read_ptr;
-	size_t size;
+	size_t size;      /* Power of two */
 	size_t refcount;
 	volatile int lock_read[2];
 	volatile int lock_write[2];
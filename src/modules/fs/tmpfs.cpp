@@ -0,0 +1,650 @@
+/*
+ * tmpfs.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+#include <system.h>
+#include <kernel_headers/kheaders.h>
+#include <module.h>
+#include <errno.h>
+#include <fs.h>
+
+/*
+ * In-memory filesystem, for /tmp and scratch data. Regular files keep their data in pages of their own,
+ * allocated as they're written to (holes cost nothing), and directories hash their entries by name.
+ * Nothing ever reaches a device. The nodes have a peek callback, so the page cache leaves them alone
+ * and splice/sendfile read straight out of their pages.
+ *
+ * The mount argument holds the options, comma separated:
+ *   size=<bytes>[k|m|g]  Most file data the instance can hold, rounded up to whole pages
+ *   nr_inodes=<count>    Most files, directories and symlinks it can hold
+ * 0 means no limit. Anything else in the argument (like "none") is ignored.
+ *
+ * Pages handed out by peek stay valid until the matching unpeek: the ones truncated away meanwhile
+ * are only retired, and freed when the last peeker is done.
+ */
+
+#define TMPFS_DEFAULT_SIZE   (16 * 1024 * 1024)
+#define TMPFS_DEFAULT_INODES 4096
+#define TMPFS_INODE_HASH     64 /* Must be a power of two */
+#define TMPFS_DIR_HASH       16 /* Must be a power of two */
+#define TMPFS_ROOT_INO       2
+#define TMPFS_OPENED         1 /* node->impl, once the node went through tmpfs_open */
+
+typedef struct tmpfs_sb {
+	uint32_t max_pages;   /* Size limit (0: none) */
+	uint32_t used_pages;
+	uint32_t max_inodes;  /* Inode limit (0: none) */
+	uint32_t used_inodes;
+	uint32_t next_ino;
+	uint32_t peeks;       /* Peeks not unpeeked yet */
+	list_t retired;       /* Pages truncated away while there were peeks */
+	list_t inodes[TMPFS_INODE_HASH]; /* Every tmpfs_inode_t, by number */
+	spin_lock_t lock;
+} tmpfs_sb_t;
+
+typedef struct tmpfs_inode {
+	uint32_t ino;
+	uint32_t flags;      /* FS_FILE, FS_DIR or FS_SYMLINK */
+	uint32_t mask;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t nlink;
+	uint32_t opens;      /* Nodes opened (and not closed yet). An unlinked inode is kept until the last of them is closed */
+	uint32_t size;
+	uint32_t atime;
+	uint32_t mtime;
+	uint32_t ctime;
+	node_t hash_node;    /* On sb->inodes */
+
+	/* Regular files: */
+	uint8_t ** pages;    /* Page index -> page (null in holes) */
+	uint32_t page_slots; /* Length of ->pages */
+
+	/* Directories: */
+	list_t * buckets;    /* TMPFS_DIR_HASH lists of tmpfs_dirent_t, by name */
+	list_t entries;      /* The same entries, in creation order */
+	uint32_t parent;     /* ".." */
+	node_t * rd_cursor;  /* Where the last readdir stopped, so that going through the directory in order is linear */
+	uint32_t rd_index;
+
+	/* Symlinks: */
+	char * target;
+} tmpfs_inode_t;
+
+typedef struct tmpfs_dirent {
+	char * name;
+	uint32_t hash;
+	tmpfs_inode_t * inode;
+	node_t hash_node;  /* On the directory's bucket */
+	node_t order_node; /* On the directory's entries */
+} tmpfs_dirent_t;
+
+#define GETSB(node) ((tmpfs_sb_t*)(node)->device)
+
+static uint8_t tmpfs_zero_page[PAGE_SIZE]; /* What peek hands out for holes */
+
+/******************************/
+/**** Function prototypes: ****/
+/******************************/
+static void tmpfs_make_node(tmpfs_sb_t * sb, tmpfs_inode_t * inode, char * name, FILE * fnode);
+
+/**************************/
+/**** Inode management ****/
+/**************************/
+/* The CMOS is read once. From then on the clock runs on the timer's ticks, which are much cheaper to read: */
+static uint32_t tmpfs_now(void) {
+	static uint32_t cmos_time = 0;
+	static unsigned long * ticks = 0;
+	static unsigned long cmos_ticks = 0;
+	if(!ticks) {
+		ticks = (unsigned long*)symbol_find((char*)"timer_ticks");
+		MOD_IOCTLD("cmos_driver", cmos_time, 4);
+		if(!ticks)
+			return cmos_time;
+		cmos_ticks = *ticks;
+	}
+	return cmos_time + (*ticks - cmos_ticks);
+}
+
+static inline uint32_t tmpfs_name_hash(char * name) {
+	uint32_t hash = 0;
+	while(*name)
+		hash = hash * 31 + *name++;
+	return hash;
+}
+
+/* All of these are called with the lock held: */
+static tmpfs_inode_t * tmpfs_inode_get(tmpfs_sb_t * sb, uint32_t ino) {
+	foreach(it, &sb->inodes[ino & (TMPFS_INODE_HASH - 1)]) {
+		tmpfs_inode_t * inode = (tmpfs_inode_t*)it->value;
+		if(inode->ino == ino)
+			return inode;
+	}
+	return 0;
+}
+
+static tmpfs_inode_t * tmpfs_inode_new(tmpfs_sb_t * sb, uint32_t flags, uint16_t permission) {
+	if(sb->max_inodes && sb->used_inodes >= sb->max_inodes)
+		return 0;
+	sb->used_inodes++;
+
+	tmpfs_inode_t * inode = (tmpfs_inode_t*)malloc(sizeof(tmpfs_inode_t));
+	memset(inode, 0, sizeof(tmpfs_inode_t));
+	inode->ino = sb->next_ino++;
+	inode->flags = flags;
+	inode->mask = permission & 0xFFF;
+	inode->atime = inode->mtime = inode->ctime = tmpfs_now();
+	if(flags & FS_DIR) {
+		inode->buckets = (list_t*)malloc(sizeof(list_t) * TMPFS_DIR_HASH);
+		memset(inode->buckets, 0, sizeof(list_t) * TMPFS_DIR_HASH);
+	}
+	inode->hash_node.value = inode;
+	list_append(&sb->inodes[inode->ino & (TMPFS_INODE_HASH - 1)], &inode->hash_node);
+	return inode;
+}
+
+/* Frees every page from 'size' on: */
+static void tmpfs_truncate_pages(tmpfs_sb_t * sb, tmpfs_inode_t * inode, uint32_t size) {
+	for(uint32_t i = (size + PAGE_SIZE - 1) / PAGE_SIZE; i < inode->page_slots; i++) {
+		if(inode->pages[i]) {
+			if(sb->peeks)
+				list_insert(&sb->retired, inode->pages[i]); /* Somebody might still be reading it */
+			else
+				free(inode->pages[i]);
+			inode->pages[i] = 0;
+			sb->used_pages--;
+		}
+	}
+	/* The page the new end falls in keeps its head, but what's past the end must read back as zeroes if the file grows again: */
+	if(size % PAGE_SIZE && size / PAGE_SIZE < inode->page_slots && inode->pages[size / PAGE_SIZE])
+		memset(inode->pages[size / PAGE_SIZE] + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+	if(inode->size > size)
+		inode->size = size;
+}
+
+/* Once it has no links and nobody has it open: */
+static void tmpfs_inode_put(tmpfs_sb_t * sb, tmpfs_inode_t * inode) {
+	if(inode->nlink || inode->opens)
+		return;
+	tmpfs_truncate_pages(sb, inode, 0);
+	list_delete(&sb->inodes[inode->ino & (TMPFS_INODE_HASH - 1)], &inode->hash_node);
+	if(inode->pages)
+		free(inode->pages);
+	if(inode->buckets)
+		free(inode->buckets);
+	if(inode->target)
+		free(inode->target);
+	free(inode);
+	sb->used_inodes--;
+}
+
+/* The inode behind a node. Null if it's gone (the node outlived its file): */
+static tmpfs_inode_t * tmpfs_inode_of(FILE * node) {
+	return tmpfs_inode_get(GETSB(node), node->inode);
+}
+
+/*****************************/
+/**** Directory functions ****/
+/*****************************/
+static tmpfs_dirent_t * tmpfs_dir_find(tmpfs_inode_t * dir, char * name) {
+	uint32_t hash = tmpfs_name_hash(name);
+	foreach(it, &dir->buckets[hash & (TMPFS_DIR_HASH - 1)]) {
+		tmpfs_dirent_t * dirent = (tmpfs_dirent_t*)it->value;
+		if(dirent->hash == hash && !strcmp(dirent->name, name))
+			return dirent;
+	}
+	return 0;
+}
+
+static void tmpfs_dir_add(tmpfs_inode_t * dir, char * name, tmpfs_inode_t * inode) {
+	tmpfs_dirent_t * dirent = (tmpfs_dirent_t*)malloc(sizeof(tmpfs_dirent_t));
+	memset(dirent, 0, sizeof(tmpfs_dirent_t));
+	dirent->name = strdup(name);
+	dirent->hash = tmpfs_name_hash(name);
+	dirent->inode = inode;
+	dirent->hash_node.value = dirent;
+	dirent->order_node.value = dirent;
+	list_append(&dir->buckets[dirent->hash & (TMPFS_DIR_HASH - 1)], &dirent->hash_node);
+	list_append(&dir->entries, &dirent->order_node);
+	dir->mtime = tmpfs_now();
+	inode->nlink++;
+}
+
+static void tmpfs_dir_remove(tmpfs_inode_t * dir, tmpfs_dirent_t * dirent) {
+	if(dir->rd_cursor == &dirent->order_node)
+		dir->rd_cursor = 0;
+	list_delete(&dir->buckets[dirent->hash & (TMPFS_DIR_HASH - 1)], &dirent->hash_node);
+	list_delete(&dir->entries, &dirent->order_node);
+	dir->mtime = tmpfs_now();
+	dirent->inode->nlink--;
+	free(dirent->name);
+	free(dirent);
+}
+
+/* Common part of create, mkdir and symlink. Returns the new inode, with the lock held: */
+static tmpfs_inode_t * tmpfs_new_entry(FILE * parent, char * name, uint32_t flags, uint16_t permission) {
+	tmpfs_sb_t * sb = GETSB(parent);
+	if(!name || !*name)
+		return 0;
+	spin_lock(sb->lock);
+	tmpfs_inode_t * dir = tmpfs_inode_of(parent);
+	if(!dir || !(dir->flags & FS_DIR) || !dir->nlink || tmpfs_dir_find(dir, name)) {
+		spin_unlock(sb->lock);
+		return 0;
+	}
+	tmpfs_inode_t * inode = tmpfs_inode_new(sb, flags, permission);
+	if(!inode) {
+		spin_unlock(sb->lock);
+		return 0;
+	}
+	tmpfs_dir_add(dir, name, inode);
+	return inode;
+}
+
+static void tmpfs_create(FILE * parent, char * name, uint16_t permission) {
+	tmpfs_inode_t * inode = tmpfs_new_entry(parent, name, FS_FILE, permission);
+	if(inode)
+		spin_unlock(GETSB(parent)->lock);
+}
+
+static void tmpfs_mkdir(FILE * parent, char * name, uint16_t permission) {
+	tmpfs_inode_t * inode = tmpfs_new_entry(parent, name, FS_DIR, permission);
+	if(!inode)
+		return;
+	inode->parent = parent->inode;
+	inode->nlink++; /* Its own "." */
+	tmpfs_inode_of(parent)->nlink++; /* Its ".." */
+	spin_unlock(GETSB(parent)->lock);
+}
+
+static void tmpfs_symlink(FILE * parent, char * target, char * name) {
+	if(!target)
+		return;
+	tmpfs_inode_t * inode = tmpfs_new_entry(parent, name, FS_SYMLINK, 0777);
+	if(!inode)
+		return;
+	inode->target = strdup(target);
+	inode->size = strlen(target);
+	spin_unlock(GETSB(parent)->lock);
+}
+
+static void tmpfs_unlink(FILE * parent, char * name) {
+	tmpfs_sb_t * sb = GETSB(parent);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * dir = tmpfs_inode_of(parent);
+	tmpfs_dirent_t * dirent = dir ? tmpfs_dir_find(dir, name) : 0;
+	if(!dirent) {
+		spin_unlock(sb->lock);
+		return;
+	}
+	tmpfs_inode_t * inode = dirent->inode;
+	if(inode->flags & FS_DIR) {
+		if(inode->entries.length) {
+			spin_unlock(sb->lock);
+			return; /* Not empty */
+		}
+		inode->nlink--; /* Its "." */
+		dir->nlink--;   /* Its ".." */
+	}
+	tmpfs_dir_remove(dir, dirent);
+	tmpfs_inode_put(sb, inode);
+	spin_unlock(sb->lock);
+}
+
+static FILE * tmpfs_finddir(FILE * node, char * name) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * dir = tmpfs_inode_of(node);
+	tmpfs_dirent_t * dirent = dir ? tmpfs_dir_find(dir, name) : 0;
+	FILE * fnode = 0;
+	if(dirent) {
+		fnode = (FILE*)malloc(sizeof(FILE));
+		tmpfs_make_node(sb, dirent->inode, dirent->name, fnode);
+	}
+	spin_unlock(sb->lock);
+	return fnode;
+}
+
+static struct dirent * tmpfs_readdir(FILE * node, uint32_t index) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * dir = tmpfs_inode_of(node);
+	if(!dir) {
+		spin_unlock(sb->lock);
+		return 0;
+	}
+
+	struct dirent * dirent = 0;
+	if(index < 2) {
+		dirent = (struct dirent*)malloc(sizeof(struct dirent));
+		strcpy(dirent->name, (char*)(index ? ".." : "."));
+		dirent->ino = index ? dir->parent : dir->ino;
+	} else {
+		/* Pick up from where the last call left off, if it can: */
+		uint32_t target = index - 2;
+		node_t * it = dir->entries.head;
+		uint32_t i = 0;
+		if(dir->rd_cursor && dir->rd_index <= target) {
+			it = dir->rd_cursor;
+			i = dir->rd_index;
+		}
+		for(; it && i < target; i++)
+			it = it->next;
+		if(it) {
+			tmpfs_dirent_t * entry = (tmpfs_dirent_t*)it->value;
+			dirent = (struct dirent*)malloc(sizeof(struct dirent));
+			size_t len = strlen(entry->name);
+			if(len > sizeof(dirent->name) - 1)
+				len = sizeof(dirent->name) - 1;
+			memcpy(dirent->name, entry->name, len);
+			dirent->name[len] = '\0';
+			dirent->ino = entry->inode->ino;
+			dir->rd_cursor = it;
+			dir->rd_index = target;
+		}
+	}
+	spin_unlock(sb->lock);
+	return dirent;
+}
+
+/************************/
+/**** File functions ****/
+/************************/
+static uint32_t tmpfs_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(!inode || offset >= inode->size) {
+		spin_unlock(sb->lock);
+		return 0;
+	}
+	if(size > inode->size - offset)
+		size = inode->size - offset;
+
+	for(uint32_t done = 0; done < size;) {
+		uint32_t index = (offset + done) / PAGE_SIZE;
+		uint32_t in_page = (offset + done) % PAGE_SIZE;
+		uint32_t chunk = PAGE_SIZE - in_page < size - done ? PAGE_SIZE - in_page : size - done;
+		if(index < inode->page_slots && inode->pages[index])
+			memcpy(buffer + done, inode->pages[index] + in_page, chunk);
+		else
+			memset(buffer + done, 0, chunk); /* Hole */
+		done += chunk;
+	}
+	spin_unlock(sb->lock);
+	return size;
+}
+
+static uint32_t tmpfs_write(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(!inode) {
+		spin_unlock(sb->lock);
+		return -EBADF;
+	}
+
+	/* Past the end of the offsets, or of the pages the instance may ever hold: */
+	if(offset + size < offset || (sb->max_pages && size && offset / PAGE_SIZE >= sb->max_pages)) {
+		spin_unlock(sb->lock);
+		return -EFBIG;
+	}
+	if(sb->max_pages && size && (offset + size - 1) / PAGE_SIZE >= sb->max_pages)
+		size = sb->max_pages * PAGE_SIZE - offset;
+
+	/* Make room for the page table: */
+	uint32_t last = size ? (offset + size - 1) / PAGE_SIZE : 0;
+	if(size && last >= inode->page_slots) {
+		uint32_t slots = inode->page_slots ? inode->page_slots : 4;
+		while(slots <= last)
+			slots *= 2;
+		uint8_t ** pages = (uint8_t**)malloc(sizeof(uint8_t*) * slots);
+		memset(pages, 0, sizeof(uint8_t*) * slots);
+		if(inode->pages) {
+			memcpy(pages, inode->pages, sizeof(uint8_t*) * inode->page_slots);
+			free(inode->pages);
+		}
+		inode->pages = pages;
+		inode->page_slots = slots;
+	}
+
+	uint32_t done = 0;
+	while(done < size) {
+		uint32_t index = (offset + done) / PAGE_SIZE;
+		uint32_t in_page = (offset + done) % PAGE_SIZE;
+		uint32_t chunk = PAGE_SIZE - in_page < size - done ? PAGE_SIZE - in_page : size - done;
+		if(!inode->pages[index]) {
+			if(sb->max_pages && sb->used_pages >= sb->max_pages)
+				break; /* Full */
+			inode->pages[index] = (uint8_t*)valloc(PAGE_SIZE);
+			memset(inode->pages[index], 0, PAGE_SIZE);
+			sb->used_pages++;
+		}
+		memcpy(inode->pages[index] + in_page, buffer + done, chunk);
+		done += chunk;
+	}
+
+	if(offset + done > inode->size)
+		inode->size = offset + done;
+	if(done)
+		inode->mtime = tmpfs_now();
+	node->size = inode->size;
+	spin_unlock(sb->lock);
+	return done || !size ? done : (uint32_t)-ENOSPC;
+}
+
+/* Points straight at the page holding 'offset'. Holes point at a page of zeroes: */
+static uint32_t tmpfs_peek(FILE * node, uint32_t offset, uint32_t size, uint8_t ** addr) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(!inode || offset >= inode->size) {
+		spin_unlock(sb->lock);
+		return 0;
+	}
+	if(size > inode->size - offset)
+		size = inode->size - offset;
+	if(size > PAGE_SIZE - offset % PAGE_SIZE)
+		size = PAGE_SIZE - offset % PAGE_SIZE;
+
+	uint32_t index = offset / PAGE_SIZE;
+	uint8_t * page = index < inode->page_slots ? inode->pages[index] : 0;
+	*addr = (page ? page : tmpfs_zero_page) + offset % PAGE_SIZE;
+	sb->peeks++;
+	spin_unlock(sb->lock);
+	return size;
+}
+
+static void tmpfs_unpeek(FILE * node) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	if(sb->peeks && !--sb->peeks) {
+		while(sb->retired.head) {
+			node_t * retired = sb->retired.head;
+			list_delete(&sb->retired, retired);
+			free(retired->value);
+			free(retired);
+		}
+	}
+	spin_unlock(sb->lock);
+}
+
+static int tmpfs_readlink(FILE * node, char * buf, size_t size) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(!inode || !inode->target) {
+		spin_unlock(sb->lock);
+		return -1;
+	}
+	size_t len = inode->size < size ? inode->size : size;
+	memcpy(buf, inode->target, len);
+	if(len < size)
+		buf[len] = '\0';
+	spin_unlock(sb->lock);
+	return len;
+}
+
+static int tmpfs_chmod(FILE * node, int mode) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(inode) {
+		inode->mask = mode & 0xFFF;
+		inode->ctime = tmpfs_now();
+		node->mask = inode->mask;
+	}
+	spin_unlock(sb->lock);
+	return inode ? 0 : -1;
+}
+
+static uint32_t tmpfs_open(FILE * node, unsigned int flags) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(inode) {
+		/* Only count each node once, so that only the nodes opened here get to take it back on close: */
+		if(node->impl != TMPFS_OPENED) {
+			node->impl = TMPFS_OPENED;
+			inode->opens++;
+		}
+		if((flags & O_TRUNC) && (inode->flags & FS_FILE)) {
+			tmpfs_truncate_pages(sb, inode, 0);
+			node->size = 0;
+		}
+	}
+	spin_unlock(sb->lock);
+	return 0;
+}
+
+static uint32_t tmpfs_close(FILE * node) {
+	tmpfs_sb_t * sb = GETSB(node);
+	spin_lock(sb->lock);
+	tmpfs_inode_t * inode = tmpfs_inode_of(node);
+	if(inode && node->impl == TMPFS_OPENED) {
+		node->impl = 0;
+		inode->opens--;
+		tmpfs_inode_put(sb, inode);
+	}
+	spin_unlock(sb->lock);
+	return 0;
+}
+
+/* Fills in a node for 'inode'. Called with the lock held: */
+static void tmpfs_make_node(tmpfs_sb_t * sb, tmpfs_inode_t * inode, char * name, FILE * fnode) {
+	memset(fnode, 0, sizeof(FILE));
+	size_t len = strlen(name);
+	if(len > sizeof(fnode->name) - 1)
+		len = sizeof(fnode->name) - 1;
+	memcpy(fnode->name, name, len);
+	fnode->name[len] = '\0';
+	fnode->device = sb;
+	fnode->inode = inode->ino;
+	fnode->flags = inode->flags;
+	fnode->mask = inode->mask;
+	fnode->uid = inode->uid;
+	fnode->gid = inode->gid;
+	fnode->size = inode->size;
+	fnode->nlink = inode->nlink;
+	fnode->atime = inode->atime;
+	fnode->mtime = inode->mtime;
+	fnode->ctime = inode->ctime;
+
+	fnode->open  = tmpfs_open;
+	fnode->close = tmpfs_close;
+	fnode->chmod = tmpfs_chmod;
+	if(inode->flags & FS_FILE) {
+		fnode->read  = tmpfs_read;
+		fnode->write = tmpfs_write;
+		fnode->peek  = tmpfs_peek;
+		fnode->unpeek = tmpfs_unpeek;
+	}
+	if(inode->flags & FS_DIR) {
+		fnode->flags  |= FS_DCACHE;
+		fnode->readdir = tmpfs_readdir;
+		fnode->finddir = tmpfs_finddir;
+		fnode->create  = tmpfs_create;
+		fnode->mkdir   = tmpfs_mkdir;
+		fnode->unlink  = tmpfs_unlink;
+		fnode->symlink = tmpfs_symlink;
+	}
+	if(inode->flags & FS_SYMLINK)
+		fnode->readlink = tmpfs_readlink;
+}
+
+/******************/
+/**** Mounting ****/
+/******************/
+
+/* If 'opt' is "<key>=<number>", returns the number. 64 bits wide, so that sizes of 4g and up don't wrap around: */
+static char tmpfs_option(char * opt, const char * key, uint64_t * value) {
+	while(*key)
+		if(*opt++ != *key++)
+			return 0;
+	if(*opt++ != '=' || !isdigit(*opt))
+		return 0;
+
+	*value = 0;
+	while(isdigit(*opt))
+		*value = *value * 10 + (*opt++ - '0');
+	switch(tolower(*opt)) {
+	case 'g': *value *= 1024; /* Fall through */
+	case 'm': *value *= 1024; /* Fall through */
+	case 'k': *value *= 1024; break;
+	}
+	return 1;
+}
+
+/* Parses "size=..." and "nr_inodes=..." out of the mount argument. Anything too big for the counters is capped: */
+static void tmpfs_parse_options(tmpfs_sb_t * sb, char * options) {
+	uint64_t size = TMPFS_DEFAULT_SIZE;
+	uint64_t inodes = TMPFS_DEFAULT_INODES;
+
+	for(char * opt = options; opt && *opt;) {
+		if(!tmpfs_option(opt, "size", &size))
+			tmpfs_option(opt, "nr_inodes", &inodes);
+		opt = strchr(opt, ',');
+		if(opt)
+			opt++;
+	}
+	uint64_t pages = (size + PAGE_SIZE - 1) >> 12; /* PAGE_SIZE is 4 KB. No 64 bit division in here */
+	sb->max_pages  = pages > UINT32_MAX ? UINT32_MAX : (uint32_t)pages;
+	sb->max_inodes = inodes > UINT32_MAX ? UINT32_MAX : (uint32_t)inodes;
+}
+
+/* tmpfs mount callback registered by 'vfs_register' and called by 'vfs_mount_type': */
+static FILE * tmpfs_mount(char * arg, char * mountpath) {
+	tmpfs_sb_t * sb = (tmpfs_sb_t*)malloc(sizeof(tmpfs_sb_t));
+	memset(sb, 0, sizeof(tmpfs_sb_t));
+	tmpfs_parse_options(sb, arg);
+	sb->next_ino = TMPFS_ROOT_INO;
+
+	tmpfs_inode_t * root = tmpfs_inode_new(sb, FS_DIR, 01777); /* Sticky and world writable, like /tmp */
+	root->nlink = 2;
+	root->parent = root->ino;
+
+	FILE * fnode = (FILE*)malloc(sizeof(FILE));
+	tmpfs_make_node(sb, root, (char*)"/", fnode);
+	kprintf("\n\t> tmpfs: %d KB, %d inodes", sb->max_pages * (PAGE_SIZE / 1024), sb->max_inodes);
+	return fnode;
+}
+
+/*****************************************/
+/**** Module initializers and ioctl: ****/
+/*****************************************/
+static int tmpfs_init(void) {
+	vfs_register((char*)"tmpfs", (vfs_mount_callback)tmpfs_mount);
+	return 0;
+}
+
+static int tmpfs_finit(void) {
+	return 0;
+}
+
+static uintptr_t tmpfs_ioctl(void * ioctl_packet) {
+	return 0;
+}
+
+MODULE_DEF(tmpfs_driver, tmpfs_init, tmpfs_finit, MODT_FS, "Miguel S.", tmpfs_ioctl);
@@ -8,6 +8,7 @@
 #include <kernel_headers/kheaders.h>
 #include <module.h>
 #include <libc/ringbuffer.h>
+#include <errno.h>
 #include "pipe.h"
 
 static uint32_t read_unixpipe(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
@@ -17,6 +18,8 @@ static uint32_t read_unixpipe(FILE * node, uint32_t offset, uint32_t size, uint8
 	while (read < size) {
 		if (self->write_closed && !ring_buffer_unread(self->buffer))
 			return read;
+		if ((node->open_flags & O_NONBLOCK) && !ring_buffer_unread(self->buffer))
+			return read ? read : -EAGAIN;
 		size_t r = ring_buffer_read(self->buffer, 1, buffer + read);
 		if (r && *((char *)(buffer + read)) == '\n')
 			return read + r;
@@ -40,11 +43,36 @@ static uint32_t write_unixpipe(FILE * node, uint32_t offset, uint32_t size, uint
 			handle_signal((task_t *)curr_task, sig);
 			return written;
 		}
-		written += ring_buffer_write(self->buffer, 1, buffer + written);
+		/* Hand over as much as fits in one go. When it's full, block for a single byte so the closed ends get rechecked: */
+		size_t chunk = ring_buffer_available(self->buffer);
+		if (!chunk) {
+			if (node->open_flags & O_NONBLOCK)
+				return written ? written : -EAGAIN;
+			chunk = 1;
+		}
+		if (chunk > size - written)
+			chunk = size - written;
+		written += ring_buffer_write(self->buffer, chunk, buffer + written);
 	}
 	return written;
 }
 
+static int poll_read_pipe(FILE * node, poll_table_t * table) {
+	unix_pipe_t * self = (unix_pipe_t*)node->device;
+	int mask = ring_buffer_poll(self->buffer, table) & POLLIN;
+	if (self->write_closed)
+		mask |= POLLHUP;
+	return mask;
+}
+
+static int poll_write_pipe(FILE * node, poll_table_t * table) {
+	unix_pipe_t * self = (unix_pipe_t*)node->device;
+	int mask = ring_buffer_poll(self->buffer, table) & POLLOUT;
+	if (self->read_closed)
+		mask |= POLLERR;
+	return mask;
+}
+
 static uint32_t close_read_pipe(FILE * node) {
 	unix_pipe_t * self = (unix_pipe_t*)node->device;
 	self->read_closed = 1;
@@ -82,6 +110,9 @@ static int make_unix_pipe_(FILE ** pipes) {
 	pipes[0]->close = close_read_pipe;
 	pipes[1]->close = close_write_pipe;
 
+	pipes[0]->poll = poll_read_pipe;
+	pipes[1]->poll = poll_write_pipe;
+
 	unix_pipe_t * internals = (unix_pipe*)malloc(sizeof(unix_pipe_t));
 	internals->read_end = pipes[0];
 	internals->write_end = pipes[1];
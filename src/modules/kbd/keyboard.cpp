@@ -8,8 +8,8 @@
 #include <system.h>
 #include <kernel_headers/kheaders.h>
 #include <module.h>
+#include <libc/spscring.h>
 #include "kbd_scan.h"
-#include "../fs/pipe.h"
 
 #define KEY_DEVICE  0x60
 #define KEY_PENDING 0x64
@@ -17,6 +17,7 @@
 #define KBD_PIPE_DEPTH 128
 
 static FILE * keyboard_pipe;
+static spsc_ring_t * keyboard_ring; /* keyboard_pipe's device. Only the IRQ handler writes into it */
 
 static void keyboard_wait(void) {
 	while(Kernel::inb(KEY_PENDING) & 2);
@@ -37,7 +38,7 @@ static int keyboard_handler(Kernel::CPU::regs_t * regs) {
 		else {
 			uint8_t b[1];
 			b[0] = kbdus[scan];
-			fwrite(keyboard_pipe, 0, 1, b);
+			spsc_ring_push(keyboard_ring, b, 1);
 		}
 	}
 	return 0;
@@ -45,8 +46,8 @@ static int keyboard_handler(Kernel::CPU::regs_t * regs) {
 
 static int keyboard_sched_ini(void) {
 	/* Prepare and mount keyboard onto the filesystem: */
-	keyboard_pipe = make_pipe(KBD_PIPE_DEPTH);
-	keyboard_pipe->flags = FS_CHARDEV;
+	keyboard_pipe = spsc_ring_make_file(KBD_PIPE_DEPTH);
+	keyboard_ring = (spsc_ring_t*)keyboard_pipe->device;
 	vfs_mount("/dev/kbd", keyboard_pipe);
 	/* Install interrupt handler: */
 	SYA(irq_install_handler, Kernel::CPU::IRQ::IRQ_KBD, keyboard_handler);
@@ -54,9 +55,8 @@ static int keyboard_sched_ini(void) {
 }
 
 static int keyboard_ini(void) {
-	/* We are only allowed to use the keyboard once we have the pipe working: */
-	module_schedule_quick("pipe_driver", keyboard_sched_ini);
-	return 0;
+	/* The input ring is part of the kernel, so there's no need to wait for the pipe driver anymore: */
+	return keyboard_sched_ini();
 }
 
 static int keyboard_fini(void) {
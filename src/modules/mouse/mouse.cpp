@@ -10,7 +10,7 @@
 #include <module.h>
 #include <stdint.h>
 #include <fs.h>
-#include <modules/fs/pipe.h>
+#include <libc/spscring.h>
 #include "mouse.h"
 
 /********************/
@@ -20,6 +20,7 @@ static uint8_t mouse_cycle = 0;
 static int8_t  mouse_byte[4];
 static int8_t  mouse_mode = MOUSE_DEFAULT;
 static FILE *  mouse_pipe;
+static spsc_ring_t * mouse_ring; /* mouse_pipe's device. Only the IRQ handler writes into it */
 
 static int mouse_ioctl(FILE * node, int request, void * argp); /* Prototype */
 /********************/
@@ -107,10 +108,9 @@ finish_packet:
 					packet.buttons = (mouse_click_t)((uintptr_t)packet.buttons | MOUSE_SCROLL_UP);
 			}
 
-			mouse_device_packet_t bitbucket;
-			while (pipe_size(mouse_pipe) > (int)(MOUSE_DISCARD_POINT * sizeof(packet)))
-				fread(mouse_pipe, 0, sizeof(packet), (uint8_t *)&bitbucket);
-			fwrite(mouse_pipe, 0, sizeof(packet), (uint8_t *)&packet);
+			/* Nobody's reading. The producer can't discard the old packets, so drop the new ones: */
+			if (spsc_ring_unread(mouse_ring) < MOUSE_DISCARD_POINT * sizeof(packet))
+				spsc_ring_push(mouse_ring, (uint8_t *)&packet, sizeof(packet));
 		}
 read_next:
 		status = inb(MOUSE_STATUS);
@@ -130,7 +130,8 @@ static int mouse_mod_init_sched(void) {
 	IRQ_OFF();
 
 	/* Create Mouse Pipe: */
-	mouse_pipe = make_pipe(sizeof(mouse_device_packet_t) * MOUSE_PACKETS_IN_PIPE);
+	mouse_pipe = spsc_ring_make_file(sizeof(mouse_device_packet_t) * MOUSE_PACKETS_IN_PIPE);
+	mouse_ring = (spsc_ring_t*)mouse_pipe->device;
 
 	/* Initialize Mouse: */
 	mouse_wait(1);
@@ -179,16 +180,14 @@ static int mouse_mod_init_sched(void) {
 	inb(MOUSE_PORT);
 
 	/* Mount the Mouse driver into the VFS: */
-	mouse_pipe->flags = FS_CHARDEV;
 	mouse_pipe->ioctl = mouse_ioctl;
 	vfs_mount("/dev/mouse", mouse_pipe);
 	return 0;
 }
 
 static int mouse_mod_init(void) {
-	/* We are only allowed to use the mouse once we have the pipe working: */
-	module_schedule_quick("pipe_driver", mouse_mod_init_sched);
-	return 0;
+	/* The input ring is part of the kernel, so there's no need to wait for the pipe driver anymore: */
+	return mouse_mod_init_sched();
 }
 
 static int mouse_mod_finit(void) {
@@ -0,0 +1,713 @@
+/*
+ * pagecache.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <fs.h>
+#include <errno.h>
+#include <system.h>
+#include <module.h>
+
+/*
+ * Caches regular file data in pages, between fread/fwrite and the filesystems.
+ * Pages are keyed by (device, inode, page index), so every FILE node of the same file shares them,
+ * whichever process opened it. Writes only dirty the pages, which go back to the filesystem
+ * when they're evicted (least recently used first, past PAGECACHE_MAX_PAGES), synced, or once they've been
+ * dirty for PAGECACHE_WRITEBACK_AGE seconds. Memory backed nodes (with a peek callback, like initrd's) are their own cache and skip it.
+ *
+ * The filesystems are never called with pc_lock held. Pages being read in or written back meanwhile are marked busy,
+ * which keeps them from being evicted or truncated away, and mappings are kept alive by their users count.
+ *
+ * Sequential readers get readahead: a worker tasklet fetches a window of pages past what they've asked for,
+ * which doubles every time they catch up with it (PAGECACHE_RA_MIN to PAGECACHE_RA_MAX), and halves on random access.
+ */
+
+#define PAGECACHE_MAX_PAGES   256 /* 1 MB */
+#define PAGECACHE_HASH_SIZE   256 /* Page buckets. Must be a power of two */
+#define PAGECACHE_MAP_HASH    64  /* Mapping buckets. Must be a power of two */
+#define PAGECACHE_RA_MIN      4   /* Readahead window, in pages (16 KB)... */
+#define PAGECACHE_RA_MAX      64  /* ...up to 256 KB */
+#define PAGECACHE_EVICT_SCAN  16  /* LRU pages looked at for a clean victim before writing a dirty one back */
+#define PAGECACHE_WRITEBACK_AGE      5 /* Seconds a page can stay dirty */
+#define PAGECACHE_WRITEBACK_INTERVAL 1 /* Seconds between two passes of the writeback tasklet */
+#define PAGECACHE_REPORT_SIZE 512
+
+/* pc_page_t busy states: */
+#define PC_READING   1 /* Its data isn't there yet */
+#define PC_WRITEBACK 2 /* Its data is being written, but can still be read and written over */
+
+/* One per cached file: */
+typedef struct pc_mapping {
+	void * device;
+	uint32_t inode;
+	FILE * file;    /* Private copy of the node, for writeback and readahead (the callers' ones come and go) */
+	uint32_t size;  /* Includes the cached writes the filesystem hasn't seen yet */
+	uint32_t users; /* Callers and readahead requests using it without the lock held. Keeps it alive even without pages */
+	list_t pages;   /* pc_page_t's, through their map_node */
+	node_t hash_node;
+} pc_mapping_t;
+
+typedef struct pc_page {
+	pc_mapping_t * mapping;
+	uint32_t index;
+	uint32_t valid;  /* Bytes of file data in the page (the rest is past the end of the file) */
+	uint8_t dirty;
+	uint8_t readahead; /* Brought in by readahead, and not used yet */
+	uint8_t busy;      /* PC_READING or PC_WRITEBACK, while the filesystem works on it without the lock held */
+	unsigned long dirtied; /* When it got dirty (in seconds), for the writeback tasklet */
+	uint8_t * data;
+	node_t lru_node;  /* On pc_lru, most recently used at the tail */
+	node_t map_node;  /* On mapping->pages */
+	node_t hash_node; /* On its pc_hash bucket */
+} pc_page_t;
+
+typedef struct {
+	pc_mapping_t * mapping;
+	uint32_t index; /* First page */
+	uint32_t count;
+} pc_ra_request_t;
+
+static list_t pc_hash[PAGECACHE_HASH_SIZE];
+static list_t pc_map_hash[PAGECACHE_MAP_HASH];
+static list_t pc_lru;
+static spin_lock_t pc_lock = { 0 };
+
+static list_t * pc_ra_queue = 0; /* pc_ra_request_t's for the worker. Readahead is off until pagecache_install */
+static list_t * pc_ra_wait  = 0; /* The worker sleeps here */
+
+static pagecache_stats_t pc_stats;
+
+static unsigned long * pc_ticks = 0;
+static unsigned long * pc_subticks = 0;
+
+/*************************/
+/**** Lookup helpers: ****/
+/*************************/
+static inline uint32_t pc_hash_fn(void * device, uint32_t inode, uint32_t index) {
+	return ((uintptr_t)device >> 4) * 31 + inode * 2654435761u + index;
+}
+
+char pagecache_cacheable(FILE * node) {
+	return node && node->device && node->read && !node->peek
+		&& (node->flags & (FS_FILE | FS_DIR | FS_CHARDEV | FS_BLOCKDEV | FS_PIPE)) == FS_FILE;
+}
+EXPORT_SYMBOL(pagecache_cacheable);
+
+static pc_mapping_t * pc_mapping_get(FILE * node, char create) {
+	list_t * bucket = &pc_map_hash[pc_hash_fn(node->device, node->inode, 0) & (PAGECACHE_MAP_HASH - 1)];
+	foreach(it, bucket) {
+		pc_mapping_t * mapping = (pc_mapping_t*)it->value;
+		if(mapping->device == node->device && mapping->inode == node->inode)
+			return mapping;
+	}
+	if(!create)
+		return 0;
+
+	pc_mapping_t * mapping = (pc_mapping_t*)malloc(sizeof(pc_mapping_t));
+	memset(mapping, 0, sizeof(pc_mapping_t));
+	mapping->device = node->device;
+	mapping->inode  = node->inode;
+	mapping->size   = node->size;
+	mapping->file   = (FILE*)malloc(sizeof(FILE));
+	memcpy(mapping->file, node, sizeof(FILE));
+	mapping->file->refcount = -1;
+	mapping->hash_node.value = mapping;
+	list_append(bucket, &mapping->hash_node);
+	return mapping;
+}
+
+static void pc_mapping_put(pc_mapping_t * mapping) {
+	if(mapping->pages.length || mapping->users)
+		return;
+	list_delete(&pc_map_hash[pc_hash_fn(mapping->device, mapping->inode, 0) & (PAGECACHE_MAP_HASH - 1)], &mapping->hash_node);
+	free(mapping->file);
+	free(mapping);
+}
+
+static pc_page_t * pc_page_find(pc_mapping_t * mapping, uint32_t index) {
+	list_t * bucket = &pc_hash[pc_hash_fn(mapping->device, mapping->inode, index) & (PAGECACHE_HASH_SIZE - 1)];
+	foreach(it, bucket) {
+		pc_page_t * page = (pc_page_t*)it->value;
+		if(page->mapping == mapping && page->index == index)
+			return page;
+	}
+	return 0;
+}
+
+/* Lets whoever's working on a busy page get on with it. Called with the lock held, which is dropped meanwhile: */
+static void pc_wait(void) {
+	spin_unlock(pc_lock);
+	switch_task(TASKST_READY);
+	spin_lock(pc_lock);
+}
+
+static void pc_mark_dirty(pc_page_t * page) {
+	if(page->dirty)
+		return;
+	/* The page ages from the moment it first got dirty: writing to it again doesn't hold its writeback back */
+	page->dirty = 1;
+	page->dirtied = pc_ticks ? *pc_ticks : 0;
+}
+
+/*******************************/
+/**** Writeback / eviction: ****/
+/*******************************/
+static inline void pc_writeback_start(pc_page_t * page) {
+	page->dirty = 0; /* Writing to it from now on dirties it again */
+	page->busy  = PC_WRITEBACK;
+	page->mapping->users++;
+}
+
+/* Writes back pages marked by pc_writeback_start. Called with the lock held, which is dropped during the writes: */
+static void pc_writeback_run(pc_page_t ** pages, uint32_t count) {
+	spin_unlock(pc_lock);
+	for(uint32_t i = 0; i < count; i++) {
+		FILE * file = pages[i]->mapping->file;
+		if(file->write)
+			file->write(file, pages[i]->index * PAGE_SIZE, pages[i]->valid, pages[i]->data);
+	}
+	spin_lock(pc_lock);
+	for(uint32_t i = 0; i < count; i++) {
+		pc_mapping_t * mapping = pages[i]->mapping;
+		pages[i]->busy = 0;
+		mapping->users--;
+		pc_mapping_put(mapping);
+		pc_stats.writebacks++;
+	}
+}
+
+/*
+ * Writes back the pages of 'mapping' (or every page, without one) which got dirty at or before 'dirtied_by'.
+ * With 'wait', doesn't return until the ones somebody else was already writing back are done as well.
+ * Called with the lock held, which is dropped meanwhile
+ */
+static void pc_writeback(pc_mapping_t * mapping, unsigned long dirtied_by, char wait) {
+	list_t * pages = mapping ? &mapping->pages : &pc_lru;
+	if(mapping)
+		mapping->users++;
+
+	if(pages->length) {
+		/* Everything is picked under the lock first: the lists can change as soon as it's dropped */
+		pc_page_t ** batch = (pc_page_t**)malloc(pages->length * sizeof(pc_page_t*));
+		uint32_t count = 0;
+		foreach(it, pages) {
+			pc_page_t * page = (pc_page_t*)it->value;
+			if(page->dirty && !page->busy && page->dirtied <= dirtied_by) {
+				pc_writeback_start(page);
+				batch[count++] = page;
+			}
+		}
+		if(count)
+			pc_writeback_run(batch, count);
+		free(batch);
+	}
+
+	for(node_t * it = wait ? pages->head : 0; it;) {
+		if(((pc_page_t*)it->value)->busy == PC_WRITEBACK) {
+			pc_wait();
+			it = pages->head;
+		} else {
+			it = it->next;
+		}
+	}
+
+	if(mapping) {
+		mapping->users--;
+		pc_mapping_put(mapping);
+	}
+}
+
+/* Doesn't free the mapping when it runs empty, the caller might still be using it (see pc_mapping_put): */
+static void pc_page_drop(pc_page_t * page) {
+	pc_mapping_t * mapping = page->mapping;
+	list_delete(&pc_hash[pc_hash_fn(mapping->device, mapping->inode, page->index) & (PAGECACHE_HASH_SIZE - 1)], &page->hash_node);
+	list_delete(&mapping->pages, &page->map_node);
+	list_delete(&pc_lru, &page->lru_node);
+	if(page->readahead)
+		pc_stats.ra_wasted++;
+	free(page->data);
+	free(page);
+}
+
+/*
+ * Evicts a page when the cache is full. Clean pages go first, the least recently used (at the head) of them.
+ * When all of the PAGECACHE_EVICT_SCAN oldest are dirty, the oldest is written back instead, and this returns 1:
+ * the lock was dropped, so the caller has to look up whatever it was about to add again and come back
+ */
+static char pc_make_room(void) {
+	if(pc_lru.length < PAGECACHE_MAX_PAGES)
+		return 0;
+
+	pc_page_t * dirty = 0;
+	int scanned = 0;
+	foreach(it, &pc_lru) {
+		pc_page_t * page = (pc_page_t*)it->value;
+		if(page->busy)
+			continue;
+		if(!page->dirty) {
+			pc_mapping_t * owner = page->mapping;
+			pc_page_drop(page);
+			pc_mapping_put(owner);
+			pc_stats.evictions++;
+			return 0;
+		}
+		if(!dirty)
+			dirty = page;
+		if(++scanned == PAGECACHE_EVICT_SCAN)
+			break;
+	}
+	if(!dirty)
+		return 0; /* Everything is busy. Go over the limit for now */
+
+	pc_writeback_start(dirty);
+	pc_writeback_run(&dirty, 1);
+	return 1;
+}
+
+/* 'data' is a PAGE_SIZE buffer from valloc, which the page takes over. Call pc_make_room first: */
+static pc_page_t * pc_page_new(pc_mapping_t * mapping, uint32_t index, uint8_t * data) {
+	pc_page_t * page = (pc_page_t*)malloc(sizeof(pc_page_t));
+	memset(page, 0, sizeof(pc_page_t));
+	page->mapping = mapping;
+	page->index   = index;
+	page->data    = data;
+	page->lru_node.value  = page;
+	page->map_node.value  = page;
+	page->hash_node.value = page;
+	list_append(&pc_hash[pc_hash_fn(mapping->device, mapping->inode, index) & (PAGECACHE_HASH_SIZE - 1)], &page->hash_node);
+	list_append(&mapping->pages, &page->map_node);
+	list_append(&pc_lru, &page->lru_node);
+	return page;
+}
+
+/*
+ * Reads in the pages of [index, index + count) that aren't cached, and are within the file.
+ * Each run of consecutive missing pages takes a single read call, into one buffer, so that the filesystem
+ * sees the whole run (and can batch its blocks). The run's pages are marked as being read in meanwhile.
+ * Whatever the filesystem comes up short on below the size (holes, or cached writes past its end) is zeroes.
+ * Called with the lock held, which is dropped meanwhile. The caller must be counted in mapping->users
+ */
+static void pc_fill(pc_mapping_t * mapping, FILE * node, uint32_t index, uint32_t count, char readahead) {
+	uint32_t end = index + count;
+	while(index < end && index * PAGE_SIZE < mapping->size) {
+		if(pc_page_find(mapping, index)) {
+			index++;
+			continue;
+		}
+
+		pc_page_t * run[PAGECACHE_RA_MAX];
+		uint32_t n = 0;
+		while(n < PAGECACHE_RA_MAX && index + n < end && (index + n) * PAGE_SIZE < mapping->size && !pc_page_find(mapping, index + n)) {
+			if(pc_make_room())
+				continue; /* The lock was dropped: look again */
+			/* Whoever else wants this page waits for it to come in: */
+			run[n] = pc_page_new(mapping, index + n, (uint8_t*)valloc(PAGE_SIZE));
+			run[n]->busy = PC_READING;
+			n++;
+		}
+		if(!n)
+			continue;
+
+		spin_unlock(pc_lock);
+		uint8_t * buff = n == 1 ? run[0]->data : (uint8_t*)malloc(n * PAGE_SIZE);
+		int ret = node->read(node, index * PAGE_SIZE, n * PAGE_SIZE, buff);
+		if(n > 1) {
+			for(uint32_t i = 0; i < n && ret > (int)(i * PAGE_SIZE); i++)
+				memcpy(run[i]->data, buff + i * PAGE_SIZE, PAGE_SIZE);
+			free(buff);
+		}
+		spin_lock(pc_lock);
+
+		for(uint32_t i = 0; i < n; i++) {
+			pc_page_t * page = run[i];
+			uint32_t offset = (index + i) * PAGE_SIZE;
+			uint32_t got = ret > (int)(i * PAGE_SIZE) ? ret - i * PAGE_SIZE : 0;
+			if(got > PAGE_SIZE)
+				got = PAGE_SIZE;
+			memset(page->data + got, 0, PAGE_SIZE - got);
+			/* After an error there's nothing. The size might also have been truncated meanwhile: */
+			page->valid = ret < 0 || offset >= mapping->size ? 0 : mapping->size - offset;
+			if(page->valid > PAGE_SIZE)
+				page->valid = PAGE_SIZE;
+			page->readahead = readahead;
+			page->busy = 0;
+		}
+		if(readahead)
+			pc_stats.ra_pages += n;
+		else
+			pc_stats.misses += n;
+		index += n;
+	}
+}
+
+/*
+ * Returns the page, reading it in from the filesystem if it wasn't cached, along with the missing ones among
+ * the next 'fill' - 1 (so that a big read goes to the filesystem in runs). 'fill' is 0 when it's about to be overwritten whole.
+ * Called with the lock held, which might be dropped meanwhile. The caller must be counted in mapping->users
+ */
+static pc_page_t * pc_page_get(pc_mapping_t * mapping, FILE * node, uint32_t index, uint32_t fill) {
+	pc_page_t * page;
+	char missed = 0;
+	for(;;) {
+		page = pc_page_find(mapping, index);
+		if(page && page->busy == PC_READING) {
+			pc_wait();
+			continue;
+		}
+		if(page) {
+			/* Touch it: */
+			list_delete(&pc_lru, &page->lru_node);
+			list_append(&pc_lru, &page->lru_node);
+			if(page->readahead) {
+				page->readahead = 0;
+				pc_stats.ra_hits++;
+			}
+			if(!missed)
+				pc_stats.hits++;
+			return page;
+		}
+		if(fill && index * PAGE_SIZE < mapping->size) {
+			pc_fill(mapping, node, index, fill < PAGECACHE_RA_MAX ? fill : PAGECACHE_RA_MAX, 0);
+			missed = 1;
+			continue;
+		}
+		if(!pc_make_room())
+			break;
+	}
+
+	/* Past the end of the file, or about to be overwritten: */
+	pc_stats.misses++;
+	page = pc_page_new(mapping, index, (uint8_t*)valloc(PAGE_SIZE));
+	memset(page->data, 0, PAGE_SIZE);
+	return page;
+}
+
+/*******************/
+/**** Readahead ****/
+/*******************/
+static void pc_ra_worker(void * arg, char * name) {
+	for(;;) {
+		IRQ_OFF();
+		while(!pc_ra_queue->length)
+			sleep_on(pc_ra_wait);
+		node_t * node = list_dequeue(pc_ra_queue);
+		IRQ_RES();
+		pc_ra_request_t * req = (pc_ra_request_t*)node->value;
+		free(node);
+
+		/* The whole window in as few reads as the cached pages allow. Readers only wait for the pages they want: */
+		pc_mapping_t * mapping = req->mapping;
+		spin_lock(pc_lock);
+		pc_fill(mapping, mapping->file, req->index, req->count, 1);
+		mapping->users--;
+		pc_mapping_put(mapping);
+		spin_unlock(pc_lock);
+		free(req);
+	}
+}
+
+/* Called with pc_lock held, on every read of [first, last] (page indices) through 'node': */
+static void pc_readahead(FILE * node, pc_mapping_t * mapping, uint32_t first, uint32_t last) {
+	file_ra_t * ra = &node->ra;
+
+	if(first == ra->prev_index || first == ra->prev_index + 1) {
+		/* Sequential: */
+		if(!ra->window)
+			ra->window = PAGECACHE_RA_MIN;
+		if(ra->ahead <= last)
+			ra->ahead = last + 1;
+	} else {
+		/* Random access. Back off: */
+		if(ra->window) {
+			ra->window = ra->window / 2 < PAGECACHE_RA_MIN ? 0 : ra->window / 2;
+			pc_stats.ra_shrinks++;
+		}
+		ra->ahead = last + 1;
+	}
+	ra->prev_index = last;
+
+	/* Only fire when the reader gets into the second half of what's been read ahead: */
+	if(!ra->window || !pc_ra_queue || ra->ahead - last > ra->window / 2)
+		return;
+	if(ra->ahead * PAGE_SIZE >= mapping->size)
+		return; /* Nothing left to read ahead */
+
+	pc_ra_request_t * req = (pc_ra_request_t*)malloc(sizeof(pc_ra_request_t));
+	req->mapping = mapping;
+	req->index   = ra->ahead;
+	req->count   = ra->window;
+	mapping->users++;
+	ra->ahead += ra->window;
+	if(ra->window < PAGECACHE_RA_MAX)
+		ra->window *= 2;
+	pc_stats.ra_requests++;
+
+	IRQ_OFF();
+	list_insert(pc_ra_queue, req);
+	IRQ_RES();
+	wakeup_queue(pc_ra_wait);
+}
+
+/***************************/
+/**** Cached read/write ****/
+/***************************/
+/* Walks the vector alongside the pages, so a vectored read fills its whole span like a single read would: */
+int pagecache_readv(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt) {
+	uint32_t size = 0;
+	for(int i = 0; i < iovcnt; i++)
+		size = size + iov[i].iov_len < size ? (uint32_t)-1 : size + iov[i].iov_len;
+
+	spin_lock(pc_lock);
+	pc_mapping_t * mapping = pc_mapping_get(node, 1);
+
+	if(offset >= mapping->size) {
+		pc_mapping_put(mapping);
+		spin_unlock(pc_lock);
+		return 0;
+	}
+	mapping->users++;
+	if(size > mapping->size - offset)
+		size = mapping->size - offset;
+	uint32_t last = (offset + size - 1) / PAGE_SIZE;
+	if(size)
+		pc_readahead(node, mapping, offset / PAGE_SIZE, last);
+
+	uint32_t done = 0;
+	int v = 0;
+	uint32_t v_done = 0;
+	while(done < size) {
+		while(v_done == iov[v].iov_len) {
+			v++;
+			v_done = 0;
+		}
+		uint32_t in_page = (offset + done) % PAGE_SIZE;
+		uint32_t chunk = PAGE_SIZE - in_page;
+		if(chunk > size - done)
+			chunk = size - done;
+		if(chunk > iov[v].iov_len - v_done)
+			chunk = iov[v].iov_len - v_done;
+
+		uint32_t index = (offset + done) / PAGE_SIZE;
+		pc_page_t * page = pc_page_get(mapping, node, index, last - index + 1);
+		if(in_page + chunk > page->valid) {
+			/* The filesystem came up short */
+			chunk = page->valid > in_page ? page->valid - in_page : 0;
+			memcpy((uint8_t*)iov[v].iov_base + v_done, page->data + in_page, chunk);
+			done += chunk;
+			break;
+		}
+		memcpy((uint8_t*)iov[v].iov_base + v_done, page->data + in_page, chunk);
+		done += chunk;
+		v_done += chunk;
+	}
+
+	mapping->users--;
+	pc_mapping_put(mapping);
+	spin_unlock(pc_lock);
+	return done;
+}
+EXPORT_SYMBOL(pagecache_readv);
+
+uint32_t pagecache_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	struct iovec iov = { buffer, size };
+	return pagecache_readv(node, offset, &iov, 1);
+}
+EXPORT_SYMBOL(pagecache_read);
+
+int pagecache_write(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	if(!node->write)
+		return -EINVAL;
+
+	spin_lock(pc_lock);
+	pc_mapping_t * mapping = pc_mapping_get(node, 1);
+	mapping->users++;
+
+	uint32_t done = 0;
+	while(done < size) {
+		uint32_t in_page = (offset + done) % PAGE_SIZE;
+		uint32_t chunk = PAGE_SIZE - in_page;
+		if(chunk > size - done)
+			chunk = size - done;
+
+		/* Only read the old contents in if some of them survive the write: */
+		char whole = !in_page && (chunk == PAGE_SIZE || offset + done + chunk >= mapping->size);
+		pc_page_t * page = pc_page_get(mapping, node, (offset + done) / PAGE_SIZE, !whole);
+		memcpy(page->data + in_page, buffer + done, chunk);
+		if(in_page + chunk > page->valid)
+			page->valid = in_page + chunk;
+		pc_mark_dirty(page);
+		done += chunk;
+	}
+
+	if(offset + size > mapping->size)
+		mapping->size = offset + size;
+	node->size = mapping->size;
+
+	mapping->users--;
+	pc_mapping_put(mapping);
+	spin_unlock(pc_lock);
+	return done;
+}
+EXPORT_SYMBOL(pagecache_write);
+
+/* The size of the file, counting the writes still in the cache: */
+uint32_t pagecache_size(FILE * node) {
+	spin_lock(pc_lock);
+	pc_mapping_t * mapping = pagecache_cacheable(node) ? pc_mapping_get(node, 0) : 0;
+	uint32_t size = mapping ? mapping->size : (node ? node->size : 0);
+	spin_unlock(pc_lock);
+	return size;
+}
+
+/*******************************/
+/**** Sync and invalidation ****/
+/*******************************/
+
+/* Writes back every dirty page of the file: */
+void pagecache_sync(FILE * node) {
+	if(!pagecache_cacheable(node))
+		return;
+	spin_lock(pc_lock);
+	pc_mapping_t * mapping = pc_mapping_get(node, 0);
+	if(mapping)
+		pc_writeback(mapping, (unsigned long)-1, 1);
+	spin_unlock(pc_lock);
+}
+EXPORT_SYMBOL(pagecache_sync);
+
+void pagecache_sync_all(void) {
+	spin_lock(pc_lock);
+	pc_writeback(0, (unsigned long)-1, 1);
+	spin_unlock(pc_lock);
+}
+EXPORT_SYMBOL(pagecache_sync_all);
+
+/* Writes back the pages that have been dirty for at least 'age' seconds: */
+void pagecache_writeback(unsigned long age) {
+	if(!pc_ticks || *pc_ticks < age)
+		return;
+	spin_lock(pc_lock);
+	pc_writeback(0, *pc_ticks - age, 0);
+	spin_unlock(pc_lock);
+}
+EXPORT_SYMBOL(pagecache_writeback);
+
+/* Drops everything past 'size' without writing it back (truncate), or the whole file (unlink) with size 0: */
+void pagecache_truncate(FILE * node, uint32_t size) {
+	if(!pagecache_cacheable(node))
+		return;
+	spin_lock(pc_lock);
+	pc_mapping_t * mapping = pc_mapping_get(node, 0);
+	if(mapping) {
+		/* Reads still in flight see this when they're done, and cut the page short: */
+		mapping->size = size;
+		mapping->users++;
+		uint32_t first = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+		for(node_t * it = mapping->pages.head; it;) {
+			pc_page_t * page = (pc_page_t*)it->value;
+			it = it->next;
+			if(page->index >= first && page->busy) {
+				/* The filesystem's still working on it. Wait, and start over: */
+				pc_wait();
+				it = mapping->pages.head;
+			} else if(page->index >= first)
+				pc_page_drop(page);
+			else if(page->index == first - 1 && size % PAGE_SIZE && page->valid > size % PAGE_SIZE) {
+				/* The page that now holds the end of the file: */
+				page->valid = size % PAGE_SIZE;
+				memset(page->data + page->valid, 0, PAGE_SIZE - page->valid);
+			}
+		}
+		mapping->users--;
+		pc_mapping_put(mapping);
+	}
+	spin_unlock(pc_lock);
+}
+EXPORT_SYMBOL(pagecache_truncate);
+
+/*********************************************/
+/**** Statistics device (/dev/pagecache): ****/
+/*********************************************/
+void pagecache_get_stats(pagecache_stats_t * stats) {
+	spin_lock(pc_lock);
+	*stats = pc_stats;
+	stats->pages = pc_lru.length;
+	spin_unlock(pc_lock);
+}
+EXPORT_SYMBOL(pagecache_get_stats);
+
+static uint32_t pagecache_stat_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	pagecache_stats_t st;
+	pagecache_get_stats(&st);
+
+	char * buff = (char*)malloc(PAGECACHE_REPORT_SIZE);
+	size_t len = sprintf(buff,
+		"pages %d/%d\nhits %d\nmisses %d\nevictions %d\nwritebacks %d\n"
+		"ra_requests %d\nra_pages %d\nra_hits %d\nra_wasted %d\nra_shrinks %d\n",
+		st.pages, PAGECACHE_MAX_PAGES, st.hits, st.misses, st.evictions, st.writebacks,
+		st.ra_requests, st.ra_pages, st.ra_hits, st.ra_wasted, st.ra_shrinks);
+	if(offset >= len) {
+		free(buff);
+		return 0;
+	}
+	if(offset + size > len)
+		size = len - offset;
+	memcpy(buffer, buff + offset, size);
+	free(buff);
+	return size;
+}
+
+static int pagecache_stat_ioctl(FILE * node, int request, void * argp) {
+	switch(request) {
+	case 0: /* Reset */
+		spin_lock(pc_lock);
+		memset(&pc_stats, 0, sizeof(pc_stats));
+		spin_unlock(pc_lock);
+		return 0;
+	case 1: pagecache_sync_all(); return 0;
+	}
+	return -1;
+}
+
+static uint32_t pagecache_stat_open(FILE * node, unsigned int flags) {
+	return 0;
+}
+
+static uint32_t pagecache_stat_close(FILE * node) {
+	return 0;
+}
+
+/* Every PAGECACHE_WRITEBACK_INTERVAL seconds, writes back the pages that have been dirty for too long: */
+static void pc_writeback_worker(void * arg, char * name) {
+	for(;;) {
+		IRQ_OFF();
+		sleep_until(current_task_get(), *pc_ticks + PAGECACHE_WRITEBACK_INTERVAL, *pc_subticks);
+		switch_task(TASKST_CRADLE);
+		IRQ_RES();
+		pagecache_writeback(PAGECACHE_WRITEBACK_AGE);
+	}
+}
+
+/* Needs tasking (for the readahead and writeback workers). Until then, reads are only cached, and writes only go back on eviction and sync */
+void pagecache_install(void) {
+	pc_ra_wait = list_create();
+	pc_ra_queue = list_create();
+	task_create_tasklet(pc_ra_worker, (char*)"[readahead]", 0);
+
+	pc_ticks    = (unsigned long*)symbol_find((char*)"timer_ticks");
+	pc_subticks = (unsigned long*)symbol_find((char*)"timer_subticks");
+	if(pc_ticks && pc_subticks)
+		task_create_tasklet(pc_writeback_worker, (char*)"[pc-writeback]", 0);
+
+	FILE * fnode = (FILE*)malloc(sizeof(FILE));
+	memset(fnode, 0, sizeof(FILE));
+	sprintf(fnode->name, "%s", "[pagecache]");
+	fnode->flags = FS_CHARDEV;
+	fnode->read  = pagecache_stat_read;
+	fnode->open  = pagecache_stat_open;
+	fnode->close = pagecache_stat_close;
+	fnode->ioctl = pagecache_stat_ioctl;
+	vfs_mount((char*)"/dev/pagecache", fnode);
+}
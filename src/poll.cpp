@@ -0,0 +1,219 @@
+/*
+ * poll.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <fs.h>
+#include <errno.h>
+#include <system.h>
+#include <module.h>
+#include "poll.h"
+
+/*
+ * A poller doesn't use its sleep_node (it can only be on one queue).
+ * Instead, every wait queue it registers on gets its own node, whose value is the polling task,
+ * so wakeup_queue() on any of them puts the task back into the scheduler.
+ * Tables with a callback (epoll) get WAIT_CBACK nodes instead.
+ */
+typedef struct {
+	wait_cback_t wait; /* Sits on 'queue' */
+	list_t * queue;
+} poll_entry_t;
+
+static unsigned long * poll_ticks = 0;
+static unsigned long * poll_subticks = 0;
+static unsigned long * poll_hz = 0;
+
+/****************************/
+/**** Wait queue entries ****/
+/****************************/
+void poll_wait(list_t * queue, poll_table_t * table) {
+	if(!queue || !table) return; /* Only querying */
+
+	poll_entry_t * entry = (poll_entry_t*)malloc(sizeof(poll_entry_t));
+	entry->wait.node.next  = 0;
+	entry->wait.node.prev  = 0;
+	entry->wait.node.value = table->cback ? WAIT_CBACK : table->task;
+	entry->wait.func = table->cback;
+	entry->wait.data = table->data;
+	entry->queue = queue;
+
+	IRQ_OFF();
+	list_append(queue, &entry->wait.node);
+	IRQ_RES();
+	list_insert(table->entries, entry);
+}
+EXPORT_SYMBOL(poll_wait);
+
+void poll_table_init(poll_table_t * table, task_t * task, void (*cback)(wait_cback_t*), void * data) {
+	table->task = task;
+	table->cback = cback;
+	table->data = data;
+	table->entries = list_create();
+}
+
+/* Get off every queue registered on. Queues that already fired have popped their entry by now: */
+void poll_table_reset(poll_table_t * table) {
+	IRQ_OFF();
+	foreach(node, table->entries) {
+		poll_entry_t * entry = (poll_entry_t*)node->value;
+		if(entry->wait.node.owner)
+			list_delete(entry->queue, &entry->wait.node);
+		free(entry);
+	}
+	list_free(table->entries);
+	table->entries->head = table->entries->tail = 0;
+	table->entries->length = 0;
+	IRQ_RES();
+}
+
+void poll_table_free(poll_table_t * table) {
+	poll_table_reset(table);
+	free(table->entries);
+}
+
+int fs_poll(FILE * node, poll_table_t * table) {
+	if(!node) return POLLNVAL;
+	/* Nodes without a poll callback never block: */
+	return node->poll ? node->poll(node, table) : POLLIN | POLLOUT;
+}
+EXPORT_SYMBOL(fs_poll);
+
+/*****************/
+/**** Timeout ****/
+/*****************/
+char poll_timer_init(void) {
+	if(!poll_ticks) {
+		poll_ticks    = (unsigned long*)symbol_find((char*)"timer_ticks");
+		poll_subticks = (unsigned long*)symbol_find((char*)"timer_subticks");
+		poll_hz       = (unsigned long*)symbol_find((char*)"timer_hz");
+	}
+	return poll_ticks && poll_subticks && poll_hz && *poll_hz;
+}
+
+void poll_deadline(int timeout_ms, unsigned long * seconds, unsigned long * subseconds) {
+	unsigned long hz = *poll_hz;
+	*seconds    = *poll_ticks + timeout_ms / 1000;
+	*subseconds = *poll_subticks + (timeout_ms % 1000) * hz / 1000;
+	if(*subseconds >= hz) {
+		(*seconds)++;
+		*subseconds -= hz;
+	}
+}
+
+char poll_expired(unsigned long seconds, unsigned long subseconds) {
+	return *poll_ticks > seconds || (*poll_ticks == seconds && *poll_subticks >= subseconds);
+}
+
+/*************************/
+/**** poll and select ****/
+/*************************/
+
+/* timeout is in milliseconds. -1 waits forever, 0 returns right away */
+int poll(struct pollfd * fds, uint32_t nfds, int timeout) {
+	if(nfds && !fds) return -EFAULT;
+
+	unsigned long seconds = 0, subseconds = 0;
+	if(timeout > 0) {
+		if(poll_timer_init())
+			poll_deadline(timeout, &seconds, &subseconds);
+		else
+			timeout = 0; /* There's no clock to wake us up */
+	}
+
+	poll_table_t table;
+	poll_table_init(&table, (task_t*)current_task, 0, 0);
+
+	int ready;
+	for(;;) {
+		ready = 0;
+		IRQ_OFF();
+		for(uint32_t i = 0; i < nfds; i++) {
+			fds[i].revents = 0;
+			if(fds[i].fd < 0) continue;
+			FILE * node = task_get_fd(table.task, fds[i].fd);
+			/* Once something is ready we won't sleep, so there's no point in registering any further: */
+			int mask = node ? fs_poll(node, ready ? 0 : &table) : POLLNVAL;
+			mask &= fds[i].events | POLLERR | POLLHUP | POLLNVAL;
+			if(mask) {
+				fds[i].revents = mask;
+				ready++;
+			}
+		}
+
+		if(ready || !timeout || (timeout > 0 && poll_expired(seconds, subseconds))) {
+			IRQ_RES();
+			break;
+		}
+
+		/* Sleep until one of the queues (or the timer) wakes us up: */
+		if(timeout > 0)
+			sleep_until(table.task, seconds, subseconds);
+		switch_task(0);
+		sleep_cancel(table.task); /* In case a queue beat the timer */
+		IRQ_RES();
+
+		poll_table_reset(&table);
+		if(current_task->signal_queue->length) {
+			ready = -EINTR;
+			break;
+		}
+	}
+
+	poll_table_free(&table);
+	return ready;
+}
+
+int select(int nfds, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout) {
+	if(nfds < 0 || nfds > FD_SETSIZE) return -EINVAL;
+
+	/* Translate the sets into a pollfd array: */
+	struct pollfd * fds = (struct pollfd*)malloc(sizeof(struct pollfd) * (nfds ? nfds : 1));
+	uint32_t count = 0;
+	for(int fd = 0; fd < nfds; fd++) {
+		short events = 0;
+		if(readfds   && FD_ISSET(fd, readfds))   events |= POLLIN;
+		if(writefds  && FD_ISSET(fd, writefds))  events |= POLLOUT;
+		if(exceptfds && FD_ISSET(fd, exceptfds)) events |= POLLPRI;
+		if(!events) continue;
+		fds[count].fd = fd;
+		fds[count].events = events;
+		count++;
+	}
+
+	int ret = poll(fds, count, timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1);
+	if(ret >= 0)
+		for(uint32_t i = 0; i < count; i++)
+			if(fds[i].revents & POLLNVAL)
+				ret = -EBADF;
+	if(ret < 0) {
+		free(fds);
+		return ret; /* The sets are left untouched */
+	}
+
+	/* And back into the sets: */
+	if(readfds)   FD_ZERO(readfds);
+	if(writefds)  FD_ZERO(writefds);
+	if(exceptfds) FD_ZERO(exceptfds);
+	ret = 0;
+	for(uint32_t i = 0; i < count; i++) {
+		int fd = fds[i].fd;
+		short revents = fds[i].revents;
+		if((fds[i].events & POLLIN) && (revents & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fd, readfds);
+			ret++;
+		}
+		if((fds[i].events & POLLOUT) && (revents & (POLLOUT | POLLERR))) {
+			FD_SET(fd, writefds);
+			ret++;
+		}
+		if((fds[i].events & POLLPRI) && (revents & POLLPRI)) {
+			FD_SET(fd, exceptfds);
+			ret++;
+		}
+	}
+	free(fds);
+	return ret;
+}
@@ -0,0 +1,32 @@
+/*
+ * poll.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_POLL_H_
+#define SRC_POLL_H_
+
+#include <fs.h>
+#include <system.h>
+
+/* Kernel side of poll_table_t, shared by poll.cpp and epoll.cpp */
+
+struct poll_table {
+	task_t * task;                    /* Woken up by the queues... */
+	void (*cback)(wait_cback_t * cb); /* ...or, when set, this runs instead */
+	void * data;                      /* Handed to 'cback' */
+	list_t * entries;                 /* Every queue registered on (with poll_wait) */
+};
+
+void poll_table_init(poll_table_t * table, task_t * task, void (*cback)(wait_cback_t*), void * data);
+void poll_table_reset(poll_table_t * table);
+void poll_table_free(poll_table_t * table);
+
+/* Timeouts, in milliseconds. poll_timer_init is 0 if there's no clock to wake up to: */
+char poll_timer_init(void);
+void poll_deadline(int timeout_ms, unsigned long * seconds, unsigned long * subseconds);
+char poll_expired(unsigned long seconds, unsigned long subseconds);
+
+#endif /* SRC_POLL_H_ */
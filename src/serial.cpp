@@ -10,7 +10,7 @@
 #include <va_list.h>
 #include <libc.h>
 #include <system.h>
-#include "modules/fs/pipe.h"
+#include <libc/spscring.h>
 
 using namespace Kernel::IO;
 
@@ -26,10 +26,10 @@ int serial_cback(Kernel::CPU::regs_t * regs) {
 	Kernel::serial.serial_cback_buffer[serial_cback_ctr++] = ch;
 
 	if(Kernel::serial.serial_pipe) {
-		/* Push character into pipe buffer: */
+		/* Push character into the input ring (never blocks, drops it if full): */
 		uint8_t b[1];
 		b[0] = ch;
-		fwrite(Kernel::serial.serial_pipe, 0, 1, b);
+		spsc_ring_push((spsc_ring_t*)Kernel::serial.serial_pipe->device, b, 1);
 	}
 	return 0;
 }
@@ -64,13 +64,20 @@ void Serial::init(uint16_t port) {
 	read_async();
 }
 
+/* Writes to the device file go straight out of the port: */
+static uint32_t serial_file_write(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	for(uint32_t i = 0; i < size; i++)
+		Kernel::serial.write(buffer[i]);
+	return size;
+}
+
 void Serial::init_late(uint16_t port) {
 	if(serial_pipe) return; /* Thanks but we're already initialized */
 	if(port != this->comport) { /* We're trying to open with a different port here. Handle this */ }
 
 	/* Create serial pipe and then start reading from it instead of reading normally through the buffers */
-	serial_pipe = make_pipe(SERIAL_READ_BUFF_SIZE);
-	serial_pipe->flags = FS_CHARDEV;
+	serial_pipe = spsc_ring_make_file(SERIAL_READ_BUFF_SIZE);
+	serial_pipe->write = serial_file_write;
 
 	int port_num = 0;
 	switch(port) {
@@ -0,0 +1,108 @@
+/*
+ * splice.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <fs.h>
+#include <errno.h>
+#include <system.h>
+#include <module.h>
+
+/*
+ * Moves data between two FILE nodes without it ever going through userspace.
+ * Memory backed sources (the ones with a peek callback) are handed straight to the destination's write,
+ * everything else goes through a single kernel bounce buffer.
+ */
+
+#define SPLICE_CHUNK 4096
+
+/* Both offsets are read from and advanced: */
+int fs_splice(FILE * in, uint32_t * in_pos, FILE * out, uint32_t * out_pos, uint32_t len, unsigned int flags) {
+	if(!in || !out) return -EBADF;
+	if(!in_pos || !out_pos) return -EINVAL;
+	if(!in->read && !in->peek) return -EINVAL;
+	if(!out->write) return -EINVAL;
+
+	/*
+	 * SPLICE_F_NONBLOCK only applies to the input. Writes always complete, or the bytes read would be lost.
+	 * The file might be shared with other descriptors, so its O_NONBLOCK isn't touched: the input is polled instead
+	 */
+	char nonblock = (flags & SPLICE_F_NONBLOCK) && in->poll;
+
+	uint8_t * bounce = 0;
+	int total = 0;
+	while((uint32_t)total < len) {
+		uint32_t chunk = len - total > SPLICE_CHUNK ? SPLICE_CHUNK : len - total;
+		uint8_t * data;
+		int got;
+
+		if(nonblock && !(in->poll(in, 0) & (POLLIN | POLLERR | POLLHUP))) {
+			if(!total)
+				total = -EAGAIN;
+			break;
+		}
+
+		if(in->peek) {
+			/* Zero copy. This may come back shorter than the chunk without being the end of the file: */
+			got = in->peek(in, *in_pos, chunk, &data);
+		} else {
+			if(!bounce)
+				bounce = (uint8_t*)malloc(SPLICE_CHUNK);
+			data = bounce;
+			got = fread(in, *in_pos, chunk, data);
+		}
+		if(got <= 0) {
+			if(!total && got < 0)
+				total = got; /* Only report the error if nothing went through */
+			break;
+		}
+
+		/*
+		 * What was read into the bounce buffer is gone from a stream, so keep writing until it's all out.
+		 * A peeked chunk wasn't consumed: whatever the output didn't take is still there for next time
+		 */
+		int put = 0, ret;
+		do {
+			ret = fwrite(out, *out_pos, got - put, data + put);
+			if(ret <= 0)
+				break;
+			*out_pos += ret;
+			put      += ret;
+		} while(!in->peek && put < got);
+		if(in->peek && in->unpeek)
+			in->unpeek(in);
+		if(!put) {
+			if(!total)
+				total = ret < 0 ? ret : -EIO;
+			break;
+		}
+		*in_pos  += put;
+		total    += put;
+
+		/* A short read from a stream means there's nothing more for now, from a file that it's the end: */
+		if(put < got || (!in->peek && (uint32_t)got < chunk))
+			break;
+	}
+
+	if(bounce)
+		free(bounce);
+	return total;
+}
+
+/* Without explicit offsets the descriptors' own positions are used and advanced: */
+int splice(int fd_in, uint32_t * off_in, int fd_out, uint32_t * off_out, uint32_t len, unsigned int flags) {
+	file_t * in  = task_get_file((task_t*)current_task, fd_in);
+	file_t * out = task_get_file((task_t*)current_task, fd_out);
+	if(!in || !out) return -EBADF;
+	if(in->node == out->node) return -EINVAL;
+	if(!off_out && (out->open_flags & O_APPEND))
+		out->offset = fs_filesize(out->node);
+	return fs_splice(in->node, off_in ? off_in : &in->offset, out->node, off_out ? off_out : &out->offset, len, flags);
+}
+
+/* Like splice, but 'offset' (when given) is read from and updated instead of in_fd's position */
+int sendfile(int out_fd, int in_fd, uint32_t * offset, uint32_t count) {
+	return splice(in_fd, offset, out_fd, 0, count, 0);
+}
@@ -1,14 +1,19 @@
 OBJS += \
 $(BOUT)/args.o \
+$(BOUT)/dcache.o \
 $(BOUT)/elf.o \
+$(BOUT)/epoll.o \
 $(BOUT)/error.o \
 $(BOUT)/initrd.o \
 $(BOUT)/kmain.o \
 $(BOUT)/ktest.o \
 $(BOUT)/log.o \
 $(BOUT)/module.o \
+$(BOUT)/pagecache.o \
+$(BOUT)/poll.o \
 $(BOUT)/serial.o \
 $(BOUT)/shm.o \
+$(BOUT)/splice.o \
 $(BOUT)/vfs.o \
 $(BOUT)/video.o
 
@@ -19,6 +24,13 @@ $(BOUT)/args.o: src/args.cpp
 	@echo '>> Finished building: $<'
 	@echo ' '
 
+$(BOUT)/dcache.o: src/dcache.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
 $(BOUT)/elf.o: src/elf.cpp 
 	@echo '>> Building file $<'
 	@echo '>> Invoking LLVM C++ Clang++'
@@ -26,6 +38,13 @@ $(BOUT)/elf.o: src/elf.cpp
 	@echo '>> Finished building: $<'
 	@echo ' '
 
+$(BOUT)/epoll.o: src/epoll.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
 $(BOUT)/error.o: src/error.cpp 
 	@echo '>> Building file $<'
 	@echo '>> Invoking LLVM C++ Clang++'
@@ -68,6 +87,20 @@ $(BOUT)/module.o: src/module.cpp
 	@echo '>> Finished building: $<'
 	@echo ' '
 
+$(BOUT)/pagecache.o: src/pagecache.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
+$(BOUT)/poll.o: src/poll.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
 $(BOUT)/serial.o: src/serial.cpp 
 	@echo '>> Building file $<'
 	@echo '>> Invoking LLVM C++ Clang++'
@@ -82,6 +115,13 @@ $(BOUT)/shm.o: src/shm.cpp
 	@echo '>> Finished building: $<'
 	@echo ' '
 
+$(BOUT)/splice.o: src/splice.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
 $(BOUT)/vfs.o: src/vfs.cpp 
 	@echo '>> Building file $<'
 	@echo '>> Invoking LLVM C++ Clang++'
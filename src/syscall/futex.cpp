@@ -0,0 +1,154 @@
+/*
+ * futex.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <system.h>
+#include <errno.h>
+#include "futex.h"
+
+namespace Kernel {
+namespace Syscall {
+
+#define FUTEX_HASH_SIZE 64 /* Buckets. Must be a power of two */
+
+/*
+ * One per word that has sleepers. The sleepers sit on 'queue' with their own sleep_node (exclusively),
+ * so wakeups go through the regular wakeup_queue_nr. It's freed as soon as its queue runs empty
+ */
+typedef struct futex {
+	list_t queue; /* First, so that a sleep_node's owner leads back to its futex */
+	uintptr_t key;
+} futex_t;
+
+static list_t * futex_table[FUTEX_HASH_SIZE];
+
+/* Physical address of the word, or 0 if it isn't mapped in user memory (or misaligned): */
+static uintptr_t futex_key(uint32_t * uaddr) {
+	uintptr_t addr = (uintptr_t)uaddr;
+	if(!addr || (addr & 3)) return 0;
+	/* Kernel words would make FUTEX_WAIT a way to read kernel memory: */
+	if(!user_range_ok(addr, sizeof(uint32_t))) return 0;
+
+	page_table_t * table = curr_dir->tables[addr / PAGE_SIZE / PAGES_PER_TABLE];
+	if(!table) return 0;
+	page_t * page = &table->pages[(addr / PAGE_SIZE) % PAGES_PER_TABLE];
+	if(!page->present) return 0;
+	return (page->phys_addr << 12) | (addr & (PAGE_SIZE - 1));
+}
+
+static inline list_t * futex_bucket(uintptr_t key) {
+	/* Words are 4 byte aligned, and neighbouring words are usually unrelated locks: */
+	uint32_t i = (key >> 2) * 2654435761u;
+	list_t ** bucket = &futex_table[i >> 26 & (FUTEX_HASH_SIZE - 1)];
+	if(!*bucket)
+		*bucket = list_create();
+	return *bucket;
+}
+
+/* Must be called with IRQs off: */
+static futex_t * futex_get(uintptr_t key, char create) {
+	list_t * bucket = futex_bucket(key);
+	foreach(node, bucket)
+		if(((futex_t*)node->value)->key == key)
+			return (futex_t*)node->value;
+	if(!create)
+		return 0;
+
+	futex_t * futex = (futex_t*)malloc(sizeof(futex_t));
+	memset(futex, 0, sizeof(futex_t));
+	futex->key = key;
+	list_insert(bucket, futex);
+	return futex;
+}
+
+static void futex_put(futex_t * futex) {
+	if(futex->queue.length)
+		return;
+	list_t * bucket = futex_bucket(futex->key);
+	list_delete(bucket, list_find(bucket, futex));
+	free(futex);
+}
+
+static int futex_wait(uintptr_t key, uint32_t * uaddr, uint32_t val) {
+	/* With the IRQs off no waker can slip in between the check and going to sleep: */
+	IRQ_OFF();
+	if(*uaddr != val || current_task->sleep_node.owner) {
+		IRQ_RES();
+		return -EAGAIN; /* Changed already, or can't sleep (already sleeping) */
+	}
+	current_task->futex_key = key;
+	int interrupted = sleep_on_exclusive(&futex_get(key, 1)->queue);
+
+	/* Woken up by something else than a FUTEX_WAKE (we might have been requeued meanwhile): */
+	list_t * owner = (list_t*)current_task->sleep_node.owner;
+	if(owner) {
+		list_delete(owner, (node_t*)&current_task->sleep_node);
+		futex_put((futex_t*)owner);
+	} else {
+		/* Taken off the queue by whoever woke us (make_task_ready doesn't know about futexes), which might have emptied it: */
+		futex_t * futex = futex_get(current_task->futex_key, 0);
+		if(futex)
+			futex_put(futex);
+	}
+	IRQ_RES();
+	return interrupted ? -EINTR : 0;
+}
+
+static int futex_wake(uintptr_t key, uint32_t nr_wake) {
+	IRQ_OFF();
+	int woken = 0;
+	futex_t * futex = futex_get(key, 0);
+	if(futex) {
+		woken = wakeup_queue_nr(&futex->queue, nr_wake);
+		futex_put(futex);
+	}
+	IRQ_RES();
+	return woken;
+}
+
+static int futex_requeue(uintptr_t key, uint32_t nr_wake, uintptr_t key2, uint32_t nr_requeue) {
+	IRQ_OFF();
+	int woken = 0;
+	futex_t * futex = futex_get(key, 0);
+	if(futex) {
+		woken = wakeup_queue_nr(&futex->queue, nr_wake);
+		/* Instead of waking the rest up only to have them sleep on the other word, just move them there: */
+		if(futex->queue.length && nr_requeue && key2 != key) {
+			futex_t * futex2 = futex_get(key2, 1);
+			for(; futex->queue.head && nr_requeue; nr_requeue--) {
+				node_t * node = futex->queue.head;
+				list_delete(&futex->queue, node);
+				list_append(&futex2->queue, node);
+				((task_t*)node->value)->futex_key = key2;
+			}
+			futex_put(futex2);
+		}
+		futex_put(futex);
+	}
+	IRQ_RES();
+	return woken;
+}
+
+int futex(uint32_t * uaddr, int op, uint32_t val, uint32_t val2, uint32_t * uaddr2) {
+	uintptr_t key = futex_key(uaddr);
+	if(!key) return -EFAULT;
+
+	switch(op) {
+	case FUTEX_WAIT:
+		return futex_wait(key, uaddr, val);
+	case FUTEX_WAKE:
+		return futex_wake(key, val);
+	case FUTEX_REQUEUE: {
+		uintptr_t key2 = futex_key(uaddr2);
+		if(!key2) return -EFAULT;
+		return futex_requeue(key, val, key2, val2);
+	}
+	}
+	return -ENOSYS;
+}
+
+}
+}
@@ -0,0 +1,26 @@
+/*
+ * futex.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_SYSCALL_FUTEX_H_
+#define SRC_SYSCALL_FUTEX_H_
+
+/*
+ * Fast userspace mutexes. Userspace does all the locking with atomic operations on a 32-bit word,
+ * and only traps into the kernel to sleep on that word (contended) or to wake its sleepers up.
+ * Words are keyed by their physical address, so threads and shared memory mappings all meet on the same queue.
+ *
+ * SYS_FUTEX(uaddr, op, val, val2, uaddr2):
+ *  - FUTEX_WAIT:    sleep if *uaddr is still 'val'. Returns -EAGAIN if it isn't
+ *  - FUTEX_WAKE:    wake up at most 'val' sleepers. Returns how many were woken up
+ *  - FUTEX_REQUEUE: wake up at most 'val' sleepers, and move at most 'val2' of the rest onto 'uaddr2'
+ */
+
+#define FUTEX_WAIT    0
+#define FUTEX_WAKE    1
+#define FUTEX_REQUEUE 3
+
+#endif /* SRC_SYSCALL_FUTEX_H_ */
@@ -1,6 +1,11 @@
 OBJS += \
 $(BOUT)/syscall_vector.o \
-$(BOUT)/syscall.o
+$(BOUT)/syscall.o \
+$(BOUT)/syscall_fast.o \
+$(BOUT)/syscall_ring.o \
+$(BOUT)/vdso.o \
+$(BOUT)/syscall_stats.o \
+$(BOUT)/futex.o
 
 $(BOUT)/syscall_vector.o: src/syscall/syscall_vector.c 
 	@echo '>> Building file $<'
@@ -15,3 +20,38 @@ $(BOUT)/syscall.o: src/syscall/syscall.cpp
 	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
 	@echo '>> Finished building: $<'
 	@echo ' '
+
+$(BOUT)/syscall_fast.o: src/syscall/syscall_fast.s 
+	@echo '>> Building file $<'
+	@echo '>> Invoking Cross i686-elf GCC Assembler'
+	$(AS) $(ASFLAGS)  -o $@  $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
+$(BOUT)/syscall_ring.o: src/syscall/syscall_ring.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
+$(BOUT)/vdso.o: src/syscall/vdso.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
+$(BOUT)/syscall_stats.o: src/syscall/syscall_stats.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
+
+$(BOUT)/futex.o: src/syscall/futex.cpp 
+	@echo '>> Building file $<'
+	@echo '>> Invoking LLVM C++ Clang++'
+	$(CXX_LLVM) $(LLVMCPPFLAGS)  -o $@ -c $<  
+	@echo '>> Finished building: $<'
+	@echo ' '
@@ -11,9 +11,11 @@
 #include "syscall_nums.h"
 #include <time.h>
 #include <utsname.h>
+#include <errno.h>
 
 extern int (*syscalls[])();
 extern uint32_t num_syscalls;
+extern "C" { void sysenter_entry(void); } /* Declared in syscall/syscall_fast.s */
 
 namespace Kernel {
 namespace Syscall {
@@ -31,6 +33,7 @@ uint32_t syscall_count = 0;
 syscall_callback_t * syscall_vector;
 hashmap_t * syscall_vector_hash;
 char syscall_initialized = 0;
+char syscall_fast_enabled = 0;
 list_t * syscall_schedule_installs = 0;
 
 /* Handle the System Call from Within the Kernel or from Usermode: */
@@ -42,21 +45,58 @@ void syscall_handler(Kernel::CPU::regs_t * regs) {
 
 	current_task->syscall_regs = regs;
 
+#if SYSCALL_STATS == 1
+	uint32_t no = regs->eax;
+	uint64_t start = CPU::rdtsc();
+#endif
+
 	/* Run system call: */
 	uint32_t ret = cback(regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
 
+#if SYSCALL_STATS == 1
+	syscall_stats_account(no, (int)ret, CPU::rdtsc() - start);
+#endif
+
 	if ((current_task->syscall_regs == regs) ||
 			((uintptr_t)cback != (uintptr_t)&fork && (uintptr_t)cback != (uintptr_t)&task_clone)) {
 		regs->eax = ret;
 	}
 }
 
+/*
+ * Entry point for SYSENTER. The frame has the same layout as the one built by int 0x7F,
+ * but for the return address, which is still on the user stack (right below useresp).
+ * %ebp comes straight from userspace, so it's checked before being read: pointing it
+ * at kernel memory (or nowhere) gets the task a SIGSEGV instead of a kernel fault
+ */
+extern "C" void syscall_fast_handler(Kernel::CPU::regs_t * regs) {
+	uintptr_t slot = regs->useresp - sizeof(uintptr_t);
+	if(!user_range_ok(slot, sizeof(uintptr_t))) {
+		send_signal(current_task->pid, SIGSEGV);
+		return; /* Back to eip 0, in case the signal doesn't take it down first */
+	}
+	regs->eip = *(uintptr_t*)slot;
+	syscall_handler(regs);
+}
+
+/* Program the SYSENTER MSRs. int 0x7F stays installed as the fallback path: */
+static void sysenter_install(void) {
+	if(!CPU::cpu_has_sep()) return;
+	CPU::wrmsr(MSR_SYSENTER_CS, SEG_KERNEL_CS); /* SS = CS + 8, user CS = CS + 16, user SS = CS + 24 */
+	CPU::wrmsr(MSR_SYSENTER_ESP, CPU::TSS::tss_kernel_stack_slot());
+	CPU::wrmsr(MSR_SYSENTER_EIP, (uintptr_t)&sysenter_entry);
+	syscall_fast_enabled = 1;
+}
+
 /* Initialize System Calls: */
 void syscalls_initialize(void) {
 	syscall_vector = new syscall_callback_t[SYSCALL_MAXCALLS];
 	memset(syscall_vector, 0, SYSCALL_MAXCALLS);
 	syscall_vector_hash = hashmap_create(SYSCALL_MAXCALLS);
 	CPU::ISR::isr_install_handler(CPU::IDT::SYSCALL_VECTOR, syscall_handler);
+	sysenter_install();
+	vdso_install();
+	syscall_stats_install();
 
 	/* Now install all the scheduled system calls: */
 	if(syscall_schedule_installs) {
@@ -75,7 +115,7 @@ void syscalls_initialize(void) {
 	for(uint32_t i = 0; i < num_syscalls; i++)
 		syscall_install_n(i, (uintptr_t)syscalls[i]);
 	/* Report back how many system calls were installed: */
-	kprintf("(# of syscalls: %d) ", syscall_count);
+	kprintf("(# of syscalls: %d%s) ", syscall_count, syscall_fast_enabled ? ", sysenter" : "");
 	syscall_initialized = 1; /* All ready */
 }
 
@@ -164,6 +204,25 @@ EXPORT_SYMBOL(syscall_run_s);
 /***************************************************/
 /********** System Call Default Functions **********/
 /***************************************************/
+#define MOUNT_ARG_MAX 256 /* Longest string sys_mount takes, terminator included */
+
+/* Copies a string from user memory, checking every page it goes through. Null if it isn't all there, or it's too long: */
+static char * user_strdup(const char * str, size_t max) {
+	if(!str)
+		return 0;
+	for(size_t len = 0; len < max; len++) {
+		uintptr_t addr = (uintptr_t)str + len;
+		if((!len || !(addr % PAGE_SIZE)) && !user_range_ok(addr, 1))
+			return 0;
+		if(!str[len]) {
+			char * copy = (char*)malloc(len + 1);
+			memcpy(copy, str, len + 1);
+			return copy;
+		}
+	}
+	return 0;
+}
+
 SYSDECL(sys_exit, int retval) {
 
 	return 0;
@@ -185,8 +244,7 @@ SYSDECL(sys_write, int fd, char * ptr, int len) {
 }
 
 SYSDECL(sys_close, int fd) {
-
-	return 0;
+	return task_close_fd((task_t*)current_task, fd);
 }
 
 SYSDECL(sys_gettimeofday, time_t * tv, void * tz) {
@@ -239,8 +297,7 @@ SYSDECL(sys_mkpipe, void) {
 }
 
 SYSDECL(sys_dup2, int old, int _new) {
-
-	return 0;
+	return process_move_fd((task_t*)current_task, old, _new);
 }
 
 SYSDECL(sys_getuid, void) {
@@ -379,8 +436,17 @@ SYSDECL(sys_pipe, int pipes[2]) {
 }
 
 SYSDECL(sys_mount, char * arg, char * mountpoint, char * type, unsigned long flags, void * data) {
+	if(current_task->user != USER_ROOT_UID) return -EPERM;
 
-	return 0;
+	/* The filesystems get copies of their own, checked to come from the caller's memory: */
+	char * k_arg        = user_strdup(arg, MOUNT_ARG_MAX);
+	char * k_mountpoint = user_strdup(mountpoint, MOUNT_ARG_MAX);
+	char * k_type       = user_strdup(type, MOUNT_ARG_MAX);
+	int ret = k_arg && k_mountpoint && k_type ? vfs_mount_type(k_type, k_arg, k_mountpoint) : -EFAULT;
+	if(k_arg) free(k_arg);
+	if(k_mountpoint) free(k_mountpoint);
+	if(k_type) free(k_type);
+	return ret;
 }
 
 SYSDECL(sys_symlink, char * target, char * name) {
@@ -397,4 +463,84 @@ SYSDECL(sys_lstat, char * file, uintptr_t st) {
 
 	return 0;
 }
+
+SYSDECL(sys_ring_setup, void * mem, uint32_t entries) {
+	return ring_setup(mem, entries);
+}
+
+SYSDECL(sys_ring_enter, int ringfd, uint32_t to_submit, uint32_t min_complete) {
+	return ring_enter(ringfd, to_submit, min_complete);
+}
+
+SYSDECL(sys_ring_destroy, int ringfd) {
+	return ring_destroy(ringfd);
+}
+
+SYSDECL(sys_poll, struct pollfd * fds, uint32_t nfds, int timeout) {
+	return poll(fds, nfds, timeout);
+}
+
+SYSDECL(sys_select, int nfds, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout) {
+	return select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+SYSDECL(sys_epoll_create, void) {
+	return epoll_create();
+}
+
+SYSDECL(sys_epoll_ctl, int epfd, int op, int fd, struct epoll_event * event) {
+	return epoll_ctl(epfd, op, fd, event);
+}
+
+SYSDECL(sys_epoll_wait, int epfd, struct epoll_event * events, int maxevents, int timeout) {
+	return epoll_wait(epfd, events, maxevents, timeout);
+}
+
+SYSDECL(sys_splice, struct splice_args * args) {
+	if(!args) return -EFAULT;
+	return splice(args->fd_in, args->off_in, args->fd_out, args->off_out, args->len, args->flags);
+}
+
+SYSDECL(sys_sendfile, int out_fd, int in_fd, uint32_t * offset, uint32_t count) {
+	return sendfile(out_fd, in_fd, offset, count);
+}
+
+SYSDECL(sys_readv, int fd, const struct iovec * iov, int iovcnt) {
+	return readv(fd, iov, iovcnt);
+}
+
+SYSDECL(sys_writev, int fd, const struct iovec * iov, int iovcnt) {
+	return writev(fd, iov, iovcnt);
+}
+
+SYSDECL(sys_preadv, int fd, const struct iovec * iov, int iovcnt, uint32_t offset) {
+	return preadv(fd, iov, iovcnt, offset);
+}
+
+SYSDECL(sys_pwritev, int fd, const struct iovec * iov, int iovcnt, uint32_t offset) {
+	return pwritev(fd, iov, iovcnt, offset);
+}
+
+SYSDECL(sys_futex, uint32_t * uaddr, int op, uint32_t val, uint32_t val2, uint32_t * uaddr2) {
+	return futex(uaddr, op, val, val2, uaddr2);
+}
+
+SYSDECL(sys_sync, void) {
+	return sync();
+}
+
+SYSDECL(sys_fsync, int fd) {
+	return fsync(fd);
+}
+
+SYSDECL(sys_fcntl, int fd, int cmd, int arg) {
+	switch(cmd) {
+	case F_GETFD: {
+		int cloexec = task_get_cloexec((task_t*)current_task, fd);
+		return cloexec > 0 ? FD_CLOEXEC : cloexec;
+	}
+	case F_SETFD: return task_set_cloexec((task_t*)current_task, fd, (arg & FD_CLOEXEC) != 0);
+	}
+	return -EINVAL;
+}
 /***************************************************/
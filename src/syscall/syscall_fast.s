@@ -0,0 +1,59 @@
+/* Fast System Call entry (SYSENTER / SYSEXIT) */
+.global sysenter_entry
+.type sysenter_entry, @function
+
+.extern syscall_fast_handler
+.type syscall_fast_handler, @function
+
+/*
+ * Userspace calling convention (see userspace/syscall.h):
+ *  %eax = syscall number, %ebx, %ecx, %edx, %esi, %edi = arguments
+ *  %ebp = user stack, which holds the return address at (%ebp). It isn't touched here:
+ *         syscall_fast_handler reads it, once it knows it's user memory
+ *  %ecx and %edx are clobbered on return (SYSEXIT uses them)
+ */
+sysenter_entry:
+    /* MSR_SYSENTER_ESP points at the TSS' esp0 slot. Fetch the real kernel stack: */
+    movl (%esp), %esp
+
+    /* Build a regs_t frame identical to the one int 0x7F makes, so that fork,
+       clone and signals can keep returning through iret: */
+    pushl $0x23          /* ss */
+    pushl %ebp           /* useresp (return address is popped on the way back) */
+    addl $4, (%esp)
+    pushfl               /* eflags */
+    orl $0x200, (%esp)   /* Userspace always runs with interrupts on */
+    pushl $0x1B          /* cs */
+    pushl $0             /* eip, filled in by syscall_fast_handler */
+    pushl $0             /* err_code */
+    pushl $0x7F          /* int_no */
+
+    pusha
+    push %ds
+    push %es
+    push %fs
+    push %gs
+
+    mov $0x10, %ax
+    mov %ax, %ds
+    mov %ax, %es
+    mov %ax, %fs
+    mov %ax, %gs
+
+    push %esp
+    call syscall_fast_handler
+    add $4, %esp
+
+    pop %gs
+    pop %fs
+    pop %es
+    pop %ds
+    popa
+    add $8, %esp
+
+    /* SYSEXIT: %edx = eip, %ecx = esp */
+    movl (%esp), %edx
+    movl 12(%esp), %ecx
+    /* sti only takes effect after sysexit, so no interrupt can land on the user stack */
+    sti
+    sysexit
@@ -55,6 +55,24 @@
 #define SYS_SYMLINK 56
 #define SYS_READLINK 57
 #define SYS_LSTAT 58
+#define SYS_RING_SETUP 59
+#define SYS_RING_ENTER 60
+#define SYS_RING_DESTROY 61
+#define SYS_POLL 62
+#define SYS_SELECT 63
+#define SYS_EPOLL_CREATE 64
+#define SYS_EPOLL_CTL 65
+#define SYS_EPOLL_WAIT 66
+#define SYS_SPLICE 67
+#define SYS_SENDFILE 68
+#define SYS_READV 69
+#define SYS_WRITEV 70
+#define SYS_PREADV 71
+#define SYS_PWRITEV 72
+#define SYS_FUTEX 73
+#define SYS_SYNC 74
+#define SYS_FSYNC 75
+#define SYS_FCNTL 76
 
 #define SYSDECL(name, ...) extern "C" int name(__VA_ARGS__); int name(__VA_ARGS__)
 
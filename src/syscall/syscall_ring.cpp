@@ -0,0 +1,415 @@
+/*
+ * syscall_ring.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <system.h>
+#include <errno.h>
+#include "syscall_ring.h"
+
+namespace Kernel {
+namespace Syscall {
+
+#define RING_MAX     16 /* Maximum amount of rings alive at the same time */
+#define RING_WORKERS 2  /* Workers per ring, so that one blocking operation doesn't stall the whole batch */
+#define RING_BOUNCE  (PAGE_SIZE * 4) /* Reads and writes go through a buffer this big, one chunk at a time */
+
+typedef struct {
+	ring_hdr_t * hdr;            /* Shared with userspace */
+	task_t * owner;
+	paging_directory_t * dir;    /* The owner's address space, which the workers borrow */
+	uint32_t sq_limit;           /* Submissions handed over by ring_enter (the workers stop here) */
+	list_t * sq_wait;            /* Workers waiting for submissions */
+	list_t * cq_wait;            /* Tasks waiting for completions */
+	list_t * busy;               /* Files an operation is running on (FILE*) */
+	list_t * busy_wait;          /* Workers waiting for one of them */
+	list_t * exit_wait;          /* Whoever tears the ring down, waiting for the workers to leave the address space */
+	task_t * volatile tasks[RING_WORKERS]; /* The workers still running, to interrupt them on teardown */
+	volatile int workers;        /* Workers in the owner's address space (attached) right now */
+	volatile int refs;           /* One per worker, plus one for the ring descriptor */
+	volatile char dead;
+	spin_lock_t lock;
+} ring_t;
+
+static ring_t * rings[RING_MAX];
+
+/**************************/
+/**** Ring operations: ****/
+/**************************/
+static int ring_op_stat(FILE * node, struct stat * st) {
+	if(!st) return -EFAULT;
+	uint32_t type = 0;
+	if(node->flags & FS_FILE)     type |= _IFREG;
+	if(node->flags & FS_DIR)      type |= _IFDIR;
+	if(node->flags & FS_CHARDEV)  type |= _IFCHR;
+	if(node->flags & FS_BLOCKDEV) type |= _IFBLK;
+	if(node->flags & FS_PIPE)     type |= _IFIFO;
+	if(node->flags & FS_SYMLINK)  type |= _IFLNK;
+
+	memset(st, 0, sizeof(struct stat));
+	st->st_dev   = (uint16_t)(uintptr_t)node->device;
+	st->st_ino   = node->inode;
+	st->st_mode  = node->mask | type;
+	st->st_nlink = node->nlink;
+	st->st_uid   = node->uid;
+	st->st_gid   = node->gid;
+	st->st_size  = node->size;
+	st->st_atime = node->atime;
+	st->st_mtime = node->mtime;
+	st->st_ctime = node->ctime;
+	return 0;
+}
+
+/*
+ * A worker is attached while it's in the owner's address space. It only ever is while it touches user memory
+ * (the ring and the buffers) or waits for something the teardown wakes it up from, never during the operation itself.
+ * Attaching fails once the ring is dead: the address space might be gone already.
+ */
+static char ring_attach(ring_t * ring) {
+	IRQ_OFF();
+	spin_lock(ring->lock);
+	char alive = !ring->dead;
+	if(alive)
+		ring->workers++;
+	spin_unlock(ring->lock);
+	IRQ_RES();
+	if(alive) {
+		current_task->thread.page_dir = ring->dir;
+		switch_directory(ring->dir);
+	}
+	return alive;
+}
+
+static void ring_detach(ring_t * ring) {
+	/* Give the address space back first, or freeing this task would free it along: */
+	current_task->thread.page_dir = kernel_directory;
+	switch_directory(kernel_directory);
+
+	IRQ_OFF();
+	spin_lock(ring->lock);
+	ring->workers--;
+	spin_unlock(ring->lock);
+	wakeup_queue(ring->exit_wait);
+	IRQ_RES();
+}
+
+/*
+ * Operations on the same open file run one at a time, so that the ones
+ * using (and advancing) its offset don't interleave or overwrite each other.
+ * Returns 0 if the ring died while waiting:
+ */
+static char ring_file_acquire(ring_t * ring, file_t * file) {
+	for(;;) {
+		IRQ_OFF();
+		spin_lock(ring->lock);
+		if(ring->dead) {
+			spin_unlock(ring->lock);
+			IRQ_RES();
+			return 0;
+		}
+		if(!list_find(ring->busy, file)) {
+			list_insert(ring->busy, file);
+			spin_unlock(ring->lock);
+			IRQ_RES();
+			return 1;
+		}
+		spin_unlock(ring->lock);
+		sleep_on(ring->busy_wait);
+		IRQ_RES();
+	}
+}
+
+static void ring_file_release(ring_t * ring, file_t * file) {
+	spin_lock(ring->lock);
+	list_delete(ring->busy, list_find(ring->busy, file));
+	spin_unlock(ring->lock);
+	wakeup_queue(ring->busy_wait);
+}
+
+/*
+ * Reads and writes go through the worker's bounce buffer, a chunk at a time. The user buffer is only
+ * touched while attached, and the transfer itself (which may block for good, like a pipe read) runs detached.
+ * Called attached. Returns attached too, unless the ring died meanwhile: then *attached is 0
+ */
+static int ring_file_rw(ring_t * ring, file_t * file, ring_sqe_t * sqe, uint8_t * bounce, char * attached) {
+	FILE * node = file->node;
+	char reading = sqe->opcode == RING_OP_READ;
+	if(!reading && sqe->off == RING_OFF_CURRENT && (file->open_flags & O_APPEND))
+		file->offset = fs_filesize(node);
+	uint32_t offset = sqe->off == RING_OFF_CURRENT ? file->offset : sqe->off;
+	int done = 0;
+
+	while((uint32_t)done < sqe->len) {
+		uint32_t chunk = sqe->len - done;
+		if(chunk > RING_BOUNCE)
+			chunk = RING_BOUNCE;
+		if(!reading)
+			memcpy(bounce, (uint8_t*)sqe->addr + done, chunk);
+
+		ring_detach(ring);
+		int ret = reading ? (int)fread(node, offset + done, chunk, bounce) : (int)fwrite(node, offset + done, chunk, bounce);
+		if(!(*attached = ring_attach(ring)))
+			return -ECANCELED;
+
+		if(ret <= 0) {
+			if(!done)
+				done = ret;
+			break;
+		}
+		if(reading)
+			memcpy((uint8_t*)sqe->addr + done, bounce, ret);
+		done += ret;
+		if((uint32_t)ret < chunk)
+			break;
+	}
+	if(sqe->off == RING_OFF_CURRENT && done > 0)
+		file->offset += done;
+	return done;
+}
+
+static int ring_file_op(ring_t * ring, file_t * file, ring_sqe_t * sqe, uint8_t * bounce, char * attached) {
+	switch(sqe->opcode) {
+	case RING_OP_READ:
+	case RING_OP_WRITE:
+		return ring_file_rw(ring, file, sqe, bounce, attached);
+	case RING_OP_SEEK:
+		switch(sqe->len) {
+		case 0: file->offset = sqe->off; break;
+		case 1: file->offset += sqe->off; break;
+		case 2: file->offset = file->node->size + sqe->off; break;
+		default: return -EINVAL;
+		}
+		return file->offset;
+	case RING_OP_STAT: {
+		struct stat st;
+		int ret = ring_op_stat(file->node, sqe->addr ? &st : 0);
+		if(!ret)
+			memcpy((void*)sqe->addr, &st, sizeof(struct stat));
+		return ret;
+	}
+	}
+	return -EINVAL;
+}
+
+/* Called attached. Like ring_file_op, *attached says whether it still is on return: */
+static int ring_op(ring_t * ring, ring_sqe_t * sqe, uint8_t * bounce, char * attached) {
+	if(sqe->opcode == RING_OP_NOP) return 0;
+
+	/* Our own reference, as the owner may close the descriptor while the operation runs: */
+	IRQ_OFF();
+	file_t * file = file_get(task_get_file(ring->owner, sqe->fd));
+	IRQ_RES();
+	if(!file) return -EBADF;
+
+	int ret = -ECANCELED;
+	if(ring_file_acquire(ring, file)) {
+		ret = ring_file_op(ring, file, sqe, bounce, attached);
+		ring_file_release(ring, file);
+	}
+	file_put(file);
+	return ret;
+}
+
+/* Must be called with the ring locked: */
+static void ring_complete(ring_t * ring, uint32_t user_data, int res) {
+	ring_hdr_t * hdr = ring->hdr;
+	if(hdr->cq_tail - hdr->cq_head >= hdr->entries) {
+		hdr->cq_overflow++;
+		return;
+	}
+	ring_cqe_t * cqe = &RING_CQES(hdr)[hdr->cq_tail & RING_MASK(hdr)];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	hdr->cq_tail++;
+}
+
+static void ring_put(ring_t * ring) {
+	if(__sync_sub_and_fetch(&ring->refs, 1))
+		return;
+	/* Every queue is empty by now */
+	free(ring->sq_wait);
+	free(ring->cq_wait);
+	list_free(ring->busy);
+	free(ring->busy);
+	free(ring->busy_wait);
+	free(ring->exit_wait);
+	free(ring);
+}
+
+/***********************/
+/**** Ring workers: ****/
+/***********************/
+static void ring_worker(void * argp, char * name) {
+	ring_t * ring = (ring_t*)argp;
+	uint8_t * bounce = (uint8_t*)malloc(RING_BOUNCE);
+
+	int slot = 0;
+	IRQ_OFF();
+	while(ring->tasks[slot])
+		slot++;
+	ring->tasks[slot] = (task_t*)current_task;
+	IRQ_RES();
+
+	/* The submissions and the buffers in them are in the owner's address space. Borrow it: */
+	char attached = ring_attach(ring);
+	while(attached) {
+		IRQ_OFF();
+		spin_lock(ring->lock);
+		if(ring->dead) {
+			spin_unlock(ring->lock);
+			IRQ_RES();
+			break;
+		}
+		if(ring->hdr->sq_head == ring->sq_limit) {
+			spin_unlock(ring->lock);
+			sleep_on(ring->sq_wait);
+			IRQ_RES();
+			continue;
+		}
+		ring_sqe_t sqe = RING_SQES(ring->hdr)[ring->hdr->sq_head & RING_MASK(ring->hdr)];
+		ring->hdr->sq_head++;
+		spin_unlock(ring->lock);
+		IRQ_RES();
+
+		int res = ring_op(ring, &sqe, bounce, &attached);
+		if(!attached)
+			break; /* Nobody is left to reap it */
+
+		spin_lock(ring->lock);
+		ring_complete(ring, sqe.user_data, res);
+		spin_unlock(ring->lock);
+		wakeup_queue(ring->cq_wait);
+	}
+	if(attached)
+		ring_detach(ring);
+
+	IRQ_OFF();
+	ring->tasks[slot] = 0;
+	IRQ_RES();
+	free(bounce);
+	ring_put(ring);
+}
+
+/****************************/
+/**** Ring system calls: ****/
+/****************************/
+static ring_t * ring_get(int ringfd) {
+	if(ringfd < 0 || ringfd >= RING_MAX || !rings[ringfd] || rings[ringfd]->owner != current_task)
+		return 0;
+	return rings[ringfd];
+}
+
+int ring_setup(void * mem, uint32_t entries) {
+	if(!mem) return -EFAULT;
+	if(!entries || entries > RING_MAX_ENTRIES || (entries & (entries - 1))) return -EINVAL;
+
+	int ringfd = -1;
+	for(int i = 0; i < RING_MAX; i++)
+		if(!rings[i]) {
+			ringfd = i;
+			break;
+		}
+	if(ringfd == -1) return -ENFILE;
+
+	ring_hdr_t * hdr = (ring_hdr_t*)mem;
+	memset(hdr, 0, RING_MEM_SIZE(entries));
+	hdr->entries = entries;
+
+	ring_t * ring = (ring_t*)malloc(sizeof(ring_t));
+	memset(ring, 0, sizeof(ring_t));
+	ring->hdr = hdr;
+	ring->owner = (task_t*)current_task;
+	ring->dir = current_task->thread.page_dir;
+	ring->sq_wait = list_create();
+	ring->cq_wait = list_create();
+	ring->busy = list_create();
+	ring->busy_wait = list_create();
+	ring->exit_wait = list_create();
+	ring->refs = 1;
+	spin_init(ring->lock);
+	rings[ringfd] = ring;
+
+	for(int i = 0; i < RING_WORKERS; i++) {
+		ring->refs++;
+		task_create_tasklet(ring_worker, (char*)"[ring_worker]", ring);
+	}
+	return ringfd;
+}
+
+/*
+ * Hands 'to_submit' new submissions over to the workers,
+ * then sleeps until at least 'min_complete' completions are waiting to be reaped.
+ * Returns how many submissions were handed over.
+ */
+int ring_enter(int ringfd, uint32_t to_submit, uint32_t min_complete) {
+	ring_t * ring = ring_get(ringfd);
+	if(!ring) return -EBADF;
+	ring_hdr_t * hdr = ring->hdr;
+	if(min_complete > hdr->entries) return -EINVAL;
+
+	spin_lock(ring->lock);
+	uint32_t pending = hdr->sq_tail - ring->sq_limit;
+	if(pending > hdr->entries) pending = 0; /* Userspace corrupted the tail */
+	if(to_submit > pending) to_submit = pending;
+	ring->sq_limit += to_submit;
+	spin_unlock(ring->lock);
+
+	if(to_submit)
+		wakeup_queue(ring->sq_wait);
+
+	while(hdr->cq_tail - hdr->cq_head < min_complete) {
+		IRQ_OFF();
+		if(hdr->cq_tail - hdr->cq_head >= min_complete) {
+			IRQ_RES();
+			break;
+		}
+		int interrupted = sleep_on(ring->cq_wait);
+		IRQ_RES();
+		if(interrupted) return -EINTR;
+	}
+	return to_submit;
+}
+
+/*
+ * Stops the workers and waits for them to be out of the owner's address space
+ * (the ring memory and the buffers are in it). That doesn't take long: only detached workers run operations,
+ * and those just get interrupted, to give up early if the operation lets them.
+ * Whoever is left holding a reference frees the ring:
+ */
+static void ring_teardown(int ringfd) {
+	ring_t * ring = rings[ringfd];
+	rings[ringfd] = 0;
+
+	IRQ_OFF();
+	spin_lock(ring->lock);
+	ring->dead = 1;
+	spin_unlock(ring->lock);
+	wakeup_queue(ring->sq_wait);
+	wakeup_queue(ring->busy_wait);
+	for(int i = 0; i < RING_WORKERS; i++)
+		if(ring->tasks[i] && ring->tasks[i]->sleep_node.owner)
+			make_task_ready(ring->tasks[i]);
+
+	while(ring->workers)
+		sleep_on(ring->exit_wait);
+	IRQ_RES();
+	ring_put(ring);
+}
+
+int ring_destroy(int ringfd) {
+	if(!ring_get(ringfd)) return -EBADF;
+	ring_teardown(ringfd);
+	return 0;
+}
+
+/* The task is exiting: tear down the rings it didn't destroy, while its address space is still there */
+void ring_task_exit(task_t * task) {
+	for(int i = 0; i < RING_MAX; i++)
+		if(rings[i] && rings[i]->owner == task)
+			ring_teardown(i);
+}
+
+}
+}
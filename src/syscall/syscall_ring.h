@@ -0,0 +1,62 @@
+/*
+ * syscall_ring.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_SYSCALL_SYSCALL_RING_H_
+#define SRC_SYSCALL_SYSCALL_RING_H_
+
+#include <stdint.h>
+
+/*
+ * Submission/completion rings for batched asynchronous system calls.
+ * The ring lives in user memory (handed over with SYS_RING_SETUP) and is shared with the kernel:
+ *  - Userspace fills sqes[sq_tail & mask] and bumps sq_tail. The kernel consumes them and bumps sq_head
+ *  - The kernel fills cqes[cq_tail & mask] and bumps cq_tail. Userspace reaps them and bumps cq_head
+ * Nothing is consumed until SYS_RING_ENTER is called, which can also wait for completions.
+ */
+
+#define RING_MAX_ENTRIES 256
+#define RING_OFF_CURRENT ((uint32_t)-1) /* Use (and advance) the file's own offset */
+
+enum RING_OPS {
+	RING_OP_NOP,
+	RING_OP_READ,  /* addr = buffer, len = size */
+	RING_OP_WRITE, /* addr = buffer, len = size */
+	RING_OP_SEEK,  /* off = offset, len = whence */
+	RING_OP_STAT   /* addr = struct stat * */
+};
+
+typedef struct {
+	uint8_t   opcode;
+	uint8_t   flags;
+	uint16_t  reserved;
+	int32_t   fd;
+	uintptr_t addr;
+	uint32_t  len;
+	uint32_t  off;
+	uint32_t  user_data; /* Copied as is into the completion */
+} ring_sqe_t;
+
+typedef struct {
+	uint32_t user_data;
+	int32_t  res; /* Same return value the synchronous call would give */
+} ring_cqe_t;
+
+typedef struct {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	uint32_t entries;     /* Power of two, for both queues */
+	uint32_t cq_overflow; /* Completions dropped because userspace didn't reap them in time */
+} ring_hdr_t;
+
+#define RING_MASK(hdr) ((hdr)->entries - 1)
+#define RING_SQES(hdr) ((ring_sqe_t*)((ring_hdr_t*)(hdr) + 1))
+#define RING_CQES(hdr) ((ring_cqe_t*)(RING_SQES(hdr) + (hdr)->entries))
+#define RING_MEM_SIZE(entries) (sizeof(ring_hdr_t) + (entries) * (sizeof(ring_sqe_t) + sizeof(ring_cqe_t)))
+
+#endif /* SRC_SYSCALL_SYSCALL_RING_H_ */
@@ -0,0 +1,149 @@
+/*
+ * syscall_stats.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <system.h>
+#include <module.h>
+
+namespace Kernel {
+
+namespace Task {
+	extern list_t * task_list;
+}
+
+namespace Syscall {
+
+#if SYSCALL_STATS == 1
+
+#define SYSCALL_HIST_BUCKETS 32
+#define SYSCALL_REPORT_SIZE  (PAGE_SIZE * 4)
+#define SYSCALL_LINE_MAX     640 /* Worst case length of one line of the report */
+
+typedef struct {
+	uint32_t calls;
+	uint32_t errors;
+	uint64_t cycles;
+	uint32_t hist[SYSCALL_HIST_BUCKETS]; /* hist[n] = calls that took [2^n, 2^(n+1)) cycles */
+} syscall_stat_t;
+
+static syscall_stat_t syscall_stats[SYSCALL_MAXCALLS];
+
+/* Called by syscall_handler after every system call: */
+void syscall_stats_account(uint32_t no, int ret, uint64_t cycles) {
+	syscall_stat_t * stat = &syscall_stats[no];
+	uint32_t c = cycles > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)cycles;
+
+	stat->calls++;
+	stat->cycles += cycles;
+	stat->hist[c ? 31 - __builtin_clz(c) : 0]++;
+	current_task->syscall_calls++;
+	current_task->syscall_cycles += cycles;
+
+	if(ret < 0) {
+		stat->errors++;
+		current_task->syscall_errors++;
+	}
+}
+
+void syscall_stats_reset(void) {
+	memset(syscall_stats, 0, sizeof(syscall_stats));
+	foreach(n, Task::task_list) {
+		task_t * task = (task_t*)n->value;
+		task->syscall_calls = task->syscall_errors = 0;
+		task->syscall_cycles = 0;
+	}
+}
+
+/* Writes the report into buff (of size SYSCALL_REPORT_SIZE). The cycle counts are 64 bit, so they're printed in hex: */
+static size_t syscall_stats_report(char * buff) {
+	char * ptr = buff;
+	char * end = buff + SYSCALL_REPORT_SIZE;
+
+	ptr += sprintf(ptr, "# syscall: calls errors cycles(hex) | log2(cycles):calls\n");
+	for(int i = 0; i < SYSCALL_MAXCALLS && end - ptr > SYSCALL_LINE_MAX; i++) {
+		syscall_stat_t * stat = &syscall_stats[i];
+		if(!stat->calls) continue;
+		ptr += sprintf(ptr, "%d: %d %d 0x%x%8x |", i, stat->calls, stat->errors,
+				(uint32_t)(stat->cycles >> 32), (uint32_t)stat->cycles);
+		for(int b = 0; b < SYSCALL_HIST_BUCKETS; b++)
+			if(stat->hist[b])
+				ptr += sprintf(ptr, " %d:%d", b, stat->hist[b]);
+		ptr += sprintf(ptr, "\n");
+	}
+
+	ptr += sprintf(ptr, "# pid name: calls errors cycles(hex)\n");
+	foreach(n, Task::task_list) {
+		if(end - ptr <= SYSCALL_LINE_MAX) break;
+		task_t * task = (task_t*)n->value;
+		if(!task->syscall_calls) continue;
+		ptr += sprintf(ptr, "%d %s: %d %d 0x%x%8x\n", task->pid, task->name, task->syscall_calls, task->syscall_errors,
+				(uint32_t)(task->syscall_cycles >> 32), (uint32_t)task->syscall_cycles);
+	}
+	return ptr - buff;
+}
+
+void syscall_stats_dump(void) {
+	char * buff = (char*)malloc(SYSCALL_REPORT_SIZE);
+	syscall_stats_report(buff);
+	Kernel::serial.puts(buff);
+	free(buff);
+}
+
+/********************************************/
+/**** Statistics device (/dev/sysstat): ****/
+/********************************************/
+static uint32_t sysstat_read(FILE * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	char * buff = (char*)malloc(SYSCALL_REPORT_SIZE);
+	size_t len = syscall_stats_report(buff);
+	if(offset >= len) {
+		free(buff);
+		return 0;
+	}
+	if(offset + size > len)
+		size = len - offset;
+	memcpy(buffer, buff + offset, size);
+	free(buff);
+	return size;
+}
+
+static int sysstat_ioctl(FILE * node, int request, void * argp) {
+	switch(request) {
+	case 0: syscall_stats_reset(); return 0;
+	case 1: syscall_stats_dump(); return 0;
+	}
+	return -1;
+}
+
+static uint32_t sysstat_open(FILE * node, unsigned int flags) {
+	return 0;
+}
+
+static uint32_t sysstat_close(FILE * node) {
+	return 0;
+}
+
+void syscall_stats_install(void) {
+	FILE * fnode = (FILE*)malloc(sizeof(FILE));
+	memset(fnode, 0, sizeof(FILE));
+	sprintf(fnode->name, "%s", "[sysstat]");
+	fnode->flags = FS_CHARDEV;
+	fnode->read  = sysstat_read;
+	fnode->open  = sysstat_open;
+	fnode->close = sysstat_close;
+	fnode->ioctl = sysstat_ioctl;
+	vfs_mount("/dev/sysstat", fnode);
+}
+
+#else
+
+void syscall_stats_install(void) { }
+void syscall_stats_reset(void) { }
+void syscall_stats_dump(void) { }
+
+#endif
+
+}
+}
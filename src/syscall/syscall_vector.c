@@ -60,6 +60,24 @@ int sys_mount(char * arg, char * mountpoint, char * type, unsigned long flags, v
 int sys_symlink(char * target, char * name);
 int sys_readlink(const char * file, char * ptr, int len);
 int sys_lstat(char * file, uintptr_t st);
+int sys_ring_setup(void * mem, uint32_t entries);
+int sys_ring_enter(int ringfd, uint32_t to_submit, uint32_t min_complete);
+int sys_ring_destroy(int ringfd);
+int sys_poll(struct pollfd * fds, uint32_t nfds, int timeout);
+int sys_select(int nfds, void * readfds, void * writefds, void * exceptfds, struct timeval * timeout);
+int sys_epoll_create(void);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event * event);
+int sys_epoll_wait(int epfd, struct epoll_event * events, int maxevents, int timeout);
+int sys_splice(struct splice_args * args);
+int sys_sendfile(int out_fd, int in_fd, uint32_t * offset, uint32_t count);
+int sys_readv(int fd, const struct iovec * iov, int iovcnt);
+int sys_writev(int fd, const struct iovec * iov, int iovcnt);
+int sys_preadv(int fd, const struct iovec * iov, int iovcnt, uint32_t offset);
+int sys_pwritev(int fd, const struct iovec * iov, int iovcnt, uint32_t offset);
+int sys_futex(uint32_t * uaddr, int op, uint32_t val, uint32_t val2, uint32_t * uaddr2);
+int sys_sync(void);
+int sys_fsync(int fd);
+int sys_fcntl(int fd, int cmd, int arg);
 /****************************/
 
 /******************************/
@@ -113,7 +131,25 @@ int (*syscalls[])() =
 		[SYS_MOUNT]        = sys_mount,
 		[SYS_SYMLINK]      = sys_symlink,
 		[SYS_READLINK]     = sys_readlink,
-		[SYS_LSTAT]        = sys_lstat
+		[SYS_LSTAT]        = sys_lstat,
+		[SYS_RING_SETUP]   = sys_ring_setup,
+		[SYS_RING_ENTER]   = sys_ring_enter,
+		[SYS_RING_DESTROY] = sys_ring_destroy,
+		[SYS_POLL]         = sys_poll,
+		[SYS_SELECT]       = sys_select,
+		[SYS_EPOLL_CREATE] = sys_epoll_create,
+		[SYS_EPOLL_CTL]    = sys_epoll_ctl,
+		[SYS_EPOLL_WAIT]   = sys_epoll_wait,
+		[SYS_SPLICE]       = sys_splice,
+		[SYS_SENDFILE]     = sys_sendfile,
+		[SYS_READV]        = sys_readv,
+		[SYS_WRITEV]       = sys_writev,
+		[SYS_PREADV]       = sys_preadv,
+		[SYS_PWRITEV]      = sys_pwritev,
+		[SYS_FUTEX]        = sys_futex,
+		[SYS_SYNC]         = sys_sync,
+		[SYS_FSYNC]        = sys_fsync,
+		[SYS_FCNTL]        = sys_fcntl
 };
 
 uint32_t num_syscalls = sizeof(syscalls) / sizeof(*syscalls);
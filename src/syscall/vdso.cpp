@@ -0,0 +1,71 @@
+/*
+ * vdso.cpp
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#include <system.h>
+#include <module.h>
+#include "vdso.h"
+
+namespace Kernel {
+namespace Syscall {
+
+static vdso_data_t * vdso = 0;
+static uint32_t * vdso_ticks;
+static uint32_t * vdso_subticks;
+
+static inline void vdso_write_begin(void) {
+	vdso->seq++;
+	asm volatile("" ::: "memory");
+}
+
+static inline void vdso_write_end(void) {
+	asm volatile("" ::: "memory");
+	vdso->seq++;
+}
+
+/* Called on every PIT tick: */
+void vdso_update_time(void) {
+	if(!vdso) return;
+	vdso_write_begin();
+	vdso->ticks    = *vdso_ticks;
+	vdso->subticks = *vdso_subticks;
+	vdso_write_end();
+}
+
+/* Called on every context switch: */
+void vdso_update_task(void) {
+	if(!vdso) return;
+	vdso_write_begin();
+	vdso->pid = current_task->pid;
+	vdso->uid = current_task->user;
+	vdso_write_end();
+}
+
+void vdso_install(void) {
+	uintptr_t phys;
+	vdso = (vdso_data_t*)kvmalloc_p(PAGE_SIZE, &phys);
+	memset(vdso, 0, PAGE_SIZE);
+
+	/* Map the same frame for userspace, read-only (the kernel keeps writing through its own mapping, CR0.WP is off): */
+	alloc_page((char)0, (char)0, VDSO_ADDR, phys);
+	invalidate_tables_at(VDSO_ADDR);
+
+	vdso_ticks    = (uint32_t*)symbol_find("timer_ticks");
+	vdso_subticks = (uint32_t*)symbol_find("timer_subticks");
+	uint32_t * hz = (uint32_t*)symbol_find("timer_hz");
+	vdso->hz = hz ? *hz : 0;
+	MOD_IOCTLD("cmos_driver", vdso->boot_time, 5);
+
+	if(!vdso_ticks || !vdso_subticks) {
+		/* No PIT driver. Leave the time fields at 0 */
+		vdso_ticks = vdso_subticks = &vdso->ticks;
+	}
+	vdso_update_time();
+	vdso_update_task();
+}
+
+}
+}
@@ -0,0 +1,31 @@
+/*
+ * vdso.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_SYSCALL_VDSO_H_
+#define SRC_SYSCALL_VDSO_H_
+
+#include <stdint.h>
+
+/*
+ * Kernel data page, mapped read-only at VDSO_ADDR in every address space.
+ * The kernel bumps 'seq' before and after every update (odd = update in progress),
+ * so readers retry until they see the same even value on both sides of the read.
+ */
+
+#define VDSO_ADDR 0xBFFFF000
+
+typedef struct {
+	volatile uint32_t seq;
+	uint32_t ticks;     /* Seconds since the PIT started */
+	uint32_t subticks;  /* 1/hz fractions of the current second */
+	uint32_t hz;
+	uint32_t boot_time; /* RTC epoch at boot */
+	int32_t  pid;       /* Of the task that is currently running (which is always the reader) */
+	uint32_t uid;
+} vdso_data_t;
+
+#endif /* SRC_SYSCALL_VDSO_H_ */
@@ -96,6 +96,7 @@ namespace Kernel {
 				uint16_t	iomap_base;
 			} __packed tss_entry_t;
 			void tss_set_kernel_stack(uintptr_t stack);
+			uintptr_t tss_kernel_stack_slot(void);
 		}
 
 		namespace GDT {
@@ -205,6 +206,7 @@ namespace Kernel {
 			void dealloc_table(uintptr_t virtual_address);
 
 			void invalidate_tables_at(uintptr_t addr);
+			char user_range_ok(uintptr_t addr, size_t size);
 			void invalidate_page_tables(void);
 
 			extern paging_directory_t * kernel_directory;
@@ -251,12 +253,14 @@ namespace Kernel {
 	/* System Calls: */
 	namespace Syscall {
 		#define SYSCALL_MAXCALLS 128
+		#define SYSCALL_STATS 1 /* Per syscall and per task call/error/cycle accounting (syscall_stats.cpp) */
 		typedef uint32_t (*syscall_callback_t)(unsigned int, ...);
 
 		/* Enter Ring3 (usermode): */
 		void usermode_enter(uintptr_t location, int argc, char ** argv, uintptr_t stack);
 
 		void syscalls_initialize(void);
+		extern char syscall_fast_enabled;
 		char syscall_schedule_install(char * syscall_name, int no, uintptr_t syscall_addr);
 		#define syscall_install(syscall_name, no) syscall_install_s((char*)# syscall_name, no, (uintptr_t)syscall_name)
 		void syscall_install_n(int no, uintptr_t syscall);
@@ -267,6 +271,26 @@ namespace Kernel {
 		void syscall_run_n(int intno);
 		void syscall_run_s(char * syscall_name);
 		#define syscall_run(syscall_name) syscall_run_s((char*)# syscall_name)
+
+		/* Submission/completion rings (syscall_ring.cpp): */
+		int ring_setup(void * mem, uint32_t entries);
+		int ring_enter(int ringfd, uint32_t to_submit, uint32_t min_complete);
+		int ring_destroy(int ringfd);
+		void ring_task_exit(Task::task_t * task);
+
+		/* Fast userspace mutexes (futex.cpp): */
+		int futex(uint32_t * uaddr, int op, uint32_t val, uint32_t val2, uint32_t * uaddr2);
+
+		/* System call accounting (syscall_stats.cpp): */
+		void syscall_stats_install(void);
+		void syscall_stats_account(uint32_t no, int ret, uint64_t cycles);
+		void syscall_stats_reset(void);
+		void syscall_stats_dump(void);
+
+		/* Shared kernel data page (vdso.cpp): */
+		void vdso_install(void);
+		void vdso_update_time(void);
+		void vdso_update_task(void);
 	}
 
 	/* Shared Memory: */
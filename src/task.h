@@ -66,10 +66,22 @@ typedef struct image {
 	volatile int lock[2];
 } image_t;
 
+#define TASK_OPEN_MAX 1024 /* Descriptors per process. A multiple of 32 */
+
+/* The descriptors themselves. A forked child shares its parent's until either of them changes anything: */
+typedef struct file_descriptor_slots {
+	file_t ** entries;
+	uint32_t * open_map;    /* One bit per descriptor in use */
+	uint32_t * cloexec_map; /* One bit per descriptor to close on exec */
+	size_t length;          /* One past the highest descriptor in use */
+	size_t capacity;        /* Always a multiple of 32 */
+	size_t free_hint;       /* Every word of open_map below this one is full */
+	volatile size_t refs;   /* Tables using these slots. Atomic: parent and child drop theirs independently */
+} fd_slots_t;
+
+/* Shared by the threads of a process: */
 typedef struct file_descriptor_table {
-	FILE ** entries;
-	size_t length;
-	size_t capacity;
+	fd_slots_t * slots;
 	size_t refs;
 } fd_table_t;
 
@@ -130,12 +142,19 @@ typedef struct task {
 	node_t sleep_node;
 	node_t * timed_sleep_node;
 	volatile uint8_t sleep_interrupted;
+	uint8_t sleep_exclusive; /* Only wakeup_queue_one/_nr's quota wakes it up */
+	uintptr_t futex_key;     /* Word it's waiting on in futex_wait (futex.cpp). Requeues move it along */
 
 	/* Shared memory: */
 	list_t * shm_mappings;
 
 	/* Process type: */
 	uint8_t is_tasklet;
+
+	/* System call accounting (SYSCALL_STATS): */
+	uint32_t syscall_calls;
+	uint32_t syscall_errors;
+	uint64_t syscall_cycles;
 } task_t;
 
 typedef struct sleeper {
@@ -144,6 +163,17 @@ typedef struct sleeper {
 	task_t * task;
 } sleeper_t;
 
+/*
+ * Wait queue entry that runs a function instead of waking up a task.
+ * It's told apart from the sleep_nodes by its value, which is WAIT_CBACK instead of a task_t*
+ */
+typedef struct wait_cback {
+	node_t node; /* Sits on the wait queue */
+	void (*func)(struct wait_cback * cb);
+	void * data;
+} wait_cback_t;
+#define WAIT_CBACK ((void*)1)
+
 extern volatile task_t * current_task;
 extern task_t * main_task;
 
@@ -179,12 +209,22 @@ task_t * task_get_parent(task_t * task);
 
 void make_task_ready(task_t * task);
 int wakeup_queue(list_t * queue);
+int wakeup_queue_one(list_t * queue);
+int wakeup_queue_nr(list_t * queue, int nr_exclusive);
 int wakeup_queue_interrupted(list_t * queue);
 void wakeup_sleepers(unsigned long seconds, unsigned long subseconds);
 int sleep_on(list_t * queue);
+int sleep_on_exclusive(list_t * queue);
 void sleep_until(task_t * task, unsigned long seconds, unsigned long subseconds);
+void sleep_cancel(task_t * task);
 
 uint32_t task_append_fd(task_t * task, FILE * node);
+FILE * task_get_fd(task_t * task, int fd);
+file_t * task_get_file(task_t * task, int fd);
+int task_close_fd(task_t * task, int fd);
+int task_set_cloexec(task_t * task, int fd, char cloexec);
+int task_get_cloexec(task_t * task, int fd);
+void task_close_cloexec(task_t * task);
 uint32_t process_move_fd(task_t * task, int src, int dest);
 
 /******************/
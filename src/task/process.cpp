@@ -19,6 +19,7 @@ namespace Task {
 extern void task_return_grave(int retval);
 extern char is_tasking_initialized;
 extern void task_reap(task_t * task);
+static void fd_slots_put(fd_slots_t * slots);
 /****************************************************************************/
 
 /**********************************************************/
@@ -57,19 +58,26 @@ task_t * fetch_next_task(void) {
 	return (task_t*)list_dequeue(task_queue)->value;
 }
 
+/* Drop a pending sleep_until, if there's one: */
+void sleep_cancel(task_t * task) {
+	if (task->sleep_node.owner != sleep_queue || !task->timed_sleep_node)
+		return;
+	IRQ_OFF();
+	spin_lock(sleep_lock);
+	list_delete(sleep_queue, task->timed_sleep_node);
+	spin_unlock(sleep_lock);
+	IRQ_RES();
+	task->sleep_node.owner = 0;
+	free(task->timed_sleep_node->value);
+	free(task->timed_sleep_node);
+	task->timed_sleep_node = 0;
+}
+
 /* Insert task back into the queue: */
 void make_task_ready(task_t * task) {
 	if(task->sleep_node.owner != 0) {
 		if (task->sleep_node.owner == sleep_queue) {
-			if (task->timed_sleep_node) {
-				IRQ_OFF();
-				spin_lock(sleep_lock);
-				list_delete(sleep_queue, task->timed_sleep_node);
-				spin_unlock(sleep_lock);
-				IRQ_RES();
-				task->sleep_node.owner = 0;
-				free(task->timed_sleep_node->value);
-			}
+			sleep_cancel(task);
 		} else {
 			task->sleep_interrupted = 1;
 			spin_lock(wait_lock_tmp);
@@ -78,34 +86,53 @@ void make_task_ready(task_t * task) {
 		}
 	}
 
+	/* A poller sits on several wait queues at once and can be woken more than once: */
+	if(task_is_ready(task))
+		return;
+
 	spin_lock(task_queue_lock);
 	list_append(task_queue, &task->sched_node);
 	spin_unlock(task_queue_lock);
 }
 
-int wakeup_queue(list_t * queue) {
-	int awoken_processes = 0;
-	while (queue->length > 0) {
-		spin_lock(wait_lock_tmp);
-		node_t * node = list_pop(queue);
-		spin_unlock(wait_lock_tmp);
-		if (!((task_t *)node->value)->finished)
-			make_task_ready((task_t*)node->value);
-		awoken_processes++;
-	}
-	return awoken_processes;
+/*
+ * Only a task's own sleep_node can be exclusive (see sleep_on_exclusive).
+ * Poll entries and WAIT_CBACK entries always get woken up
+ */
+static inline char wait_entry_exclusive(node_t * node) {
+	if (node->value == WAIT_CBACK)
+		return 0;
+	task_t * task = (task_t*)node->value;
+	return node == &task->sleep_node && task->sleep_exclusive;
 }
-EXPORT_SYMBOL(wakeup_queue);
 
-int wakeup_queue_interrupted(list_t * queue) {
+/*
+ * Wakes up every non-exclusive entry and, in FIFO order, up to 'nr_exclusive' exclusive ones (all of them if negative).
+ * The exclusive entries past the limit stay on the queue
+ */
+static int wakeup_queue_(list_t * queue, int nr_exclusive, char interrupted) {
 	int awoken_processes = 0;
-	while (queue->length > 0) {
+	for (;;) {
 		spin_lock(wait_lock_tmp);
-		node_t * node = list_pop(queue);
+		node_t * node = queue->head;
+		while (node && nr_exclusive == 0 && wait_entry_exclusive(node))
+			node = node->next;
+		if (node)
+			list_delete(queue, node);
 		spin_unlock(wait_lock_tmp);
-		if (!((task_t *)node->value)->finished) {
-			task_t * task = (task_t*)node->value;
-			task->sleep_interrupted = 1;
+		if (!node)
+			break;
+
+		if (node->value == WAIT_CBACK) {
+			((wait_cback_t*)node)->func((wait_cback_t*)node);
+			continue;
+		}
+		task_t * task = (task_t*)node->value;
+		if (wait_entry_exclusive(node) && nr_exclusive > 0)
+			nr_exclusive--;
+		if (!task->finished) {
+			if (interrupted)
+				task->sleep_interrupted = 1;
 			make_task_ready(task);
 		}
 		awoken_processes++;
@@ -113,6 +140,26 @@ int wakeup_queue_interrupted(list_t * queue) {
 	return awoken_processes;
 }
 
+int wakeup_queue(list_t * queue) {
+	return wakeup_queue_(queue, -1, 0);
+}
+EXPORT_SYMBOL(wakeup_queue);
+
+/* Wakes up at most one exclusive waiter (plus every non-exclusive one, like pollers): */
+int wakeup_queue_one(list_t * queue) {
+	return wakeup_queue_(queue, 1, 0);
+}
+EXPORT_SYMBOL(wakeup_queue_one);
+
+int wakeup_queue_nr(list_t * queue, int nr_exclusive) {
+	return wakeup_queue_(queue, nr_exclusive, 0);
+}
+EXPORT_SYMBOL(wakeup_queue_nr);
+
+int wakeup_queue_interrupted(list_t * queue) {
+	return wakeup_queue_(queue, -1, 1);
+}
+
 void wakeup_sleepers(unsigned long seconds, unsigned long subseconds) {
 	IRQ_OFF();
 	spin_lock(sleep_lock);
@@ -122,8 +169,8 @@ void wakeup_sleepers(unsigned long seconds, unsigned long subseconds) {
 			task_t * task = proc->task;
 			task->sleep_node.owner = 0;
 			task->timed_sleep_node = 0;
-			//if (!task_is_ready(task))
-			//	make_task_ready(task);
+			if (!task_is_ready(task))
+				make_task_ready(task);
 			free(proc);
 			free(list_dequeue(sleep_queue));
 			if (sleep_queue->length)
@@ -155,6 +202,13 @@ static int wait_candidate(task_t * parent, int pid, int options, task_t * task)
 	return 0;
 }
 
+static char task_has_children(task_t * task) {
+	foreach(node, task->tree_entry->children)
+		if (node->value)
+			return 1;
+	return 0;
+}
+
 int waitpid(int pid, int * status, int options) {
 	task_t * task = (task_t*)current_task;
 	if (task->group)
@@ -188,31 +242,52 @@ int waitpid(int pid, int * status, int options) {
 				*status = candidate->status;
 			int pid = candidate->pid;
 			task_reap(candidate);
+			/* The others waiting for "any child" have nothing left to wait for: */
+			if (!task_has_children(task))
+				wakeup_queue(task->wait_queue);
 			return pid;
 		} else {
 			if (options & 1)
 				return 0;
-			/* Wait */
-			if (sleep_on(task->wait_queue) != 0)
+			/*
+			 * Wait. Any child will do for pid -1, so only one of those waiters needs to wake up per exit.
+			 * The ones waiting for a specific pid or group have to check for themselves
+			 */
+			int interrupted = pid == -1 ? sleep_on_exclusive(task->wait_queue) : sleep_on(task->wait_queue);
+			if (interrupted)
 				return -EINTR;
 		}
 	} while (1);
 }
 
-int sleep_on(list_t * queue) {
+static int sleep_on_(list_t * queue, uint8_t exclusive) {
 	if(current_task->sleep_node.owner) {
 		switch_task(0);
 		return 0;
 	}
 	current_task->sleep_interrupted = 0;
+	current_task->sleep_exclusive = exclusive;
 	spin_lock(wait_lock_tmp);
 	list_append(queue, (node_t*)&current_task->sleep_node);
 	spin_unlock(wait_lock_tmp);
 	switch_task(0);
 	return current_task->sleep_interrupted;
 }
+
+int sleep_on(list_t * queue) {
+	return sleep_on_(queue, 0);
+}
 EXPORT_SYMBOL(sleep_on);
 
+/*
+ * Same as sleep_on, but wakeup_queue_one/wakeup_queue_nr only wake up as many exclusive sleepers as asked for.
+ * Whoever sleeps exclusively and doesn't use up the whole event must pass it on with another wakeup_queue_one
+ */
+int sleep_on_exclusive(list_t * queue) {
+	return sleep_on_(queue, 1);
+}
+EXPORT_SYMBOL(sleep_on_exclusive);
+
 void sleep_until(task_t * task, unsigned long seconds, unsigned long subseconds) {
 	if(current_task->sleep_node.owner)
 		return; /* Can't sleep. Already sleeping */
@@ -222,7 +297,7 @@ void sleep_until(task_t * task, unsigned long seconds, unsigned long subseconds)
 	IRQ_OFF();
 	spin_lock(sleep_lock);
 
-	node_t * before;
+	node_t * before = 0;
 	foreach(node, sleep_queue) {
 		sleeper_t * candidate = ((sleeper_t *)node->value);
 		if (candidate->end_tick > seconds || (candidate->end_tick == seconds && candidate->end_subtick > subseconds))
@@ -266,11 +341,7 @@ void task_free(task_t * task, int retval) {
 
 	if(--task->fds->refs == 0) {
 		release_directory(task->thread.page_dir);
-		for(uint32_t i = 0; i < task->fds->length; i++) {
-			fclose(task->fds->entries[i]);
-			task->fds->entries[i] = 0;
-		}
-		free(task->fds->entries);
+		fd_slots_put(task->fds->slots);
 		free(task->fds);
 		free((void *)(task->image.stack - TASK_STACK_SIZE));
 		free(task->syscall_regs);
@@ -357,48 +428,212 @@ pid_t get_next_pid(char restart_pid) {
 /***** Task file descriptors *****/
 /*********************************/
 
+#define FD_BIT(fd)  (1 << ((fd) % 32))
+#define FD_WORD(fd) ((fd) / 32)
+
+static inline uint32_t fd_bsf(uint32_t word) {
+	uint32_t bit;
+	asm("bsf %1, %0" : "=r"(bit) : "rm"(word));
+	return bit;
+}
+
+static fd_slots_t * fd_slots_create(size_t capacity) {
+	fd_slots_t * slots  = (fd_slots_t*)malloc(sizeof(fd_slots_t));
+	slots->entries      = (file_t**)malloc(sizeof(file_t*) * capacity);
+	slots->open_map     = (uint32_t*)malloc(capacity / 8);
+	slots->cloexec_map  = (uint32_t*)malloc(capacity / 8);
+	memset(slots->entries, 0, sizeof(file_t*) * capacity);
+	memset(slots->open_map, 0, capacity / 8);
+	memset(slots->cloexec_map, 0, capacity / 8);
+	slots->length    = 0;
+	slots->capacity  = capacity;
+	slots->free_hint = 0;
+	slots->refs      = 1;
+	return slots;
+}
+
+static void fd_slots_put(fd_slots_t * slots) {
+	if(__sync_sub_and_fetch(&slots->refs, 1))
+		return;
+	for(size_t fd = 0; fd < slots->length; fd++)
+		if(slots->open_map[FD_WORD(fd)] & FD_BIT(fd))
+			file_put(slots->entries[fd]);
+	free(slots->entries);
+	free(slots->open_map);
+	free(slots->cloexec_map);
+	free(slots);
+}
+
+static fd_table_t * fd_table_create(fd_slots_t * slots) {
+	fd_table_t * table = new fd_table_t;
+	table->slots = slots;
+	table->refs  = 1;
+	return table;
+}
+
+/* Makes sure nobody else (but our threads) is using the table's slots, before changing them: */
+static fd_slots_t * fd_table_own(fd_table_t * table) {
+	fd_slots_t * shared = table->slots;
+	if(shared->refs == 1)
+		return shared;
+
+	/* Copy on write. Each copy of a descriptor holds its own reference to the same open file: */
+	fd_slots_t * slots = fd_slots_create(shared->capacity);
+	memcpy(slots->open_map, shared->open_map, shared->capacity / 8);
+	memcpy(slots->cloexec_map, shared->cloexec_map, shared->capacity / 8);
+	for(size_t fd = 0; fd < shared->length; fd++)
+		if(shared->open_map[FD_WORD(fd)] & FD_BIT(fd))
+			slots->entries[fd] = file_get(shared->entries[fd]);
+	slots->length    = shared->length;
+	slots->free_hint = shared->free_hint;
+
+	/* The other users might have let go of it meanwhile, in which case we're the last: */
+	fd_slots_put(shared);
+	table->slots = slots;
+	return slots;
+}
+
+/* Callers keep 'min_capacity' below TASK_OPEN_MAX: */
+static void fd_slots_grow(fd_slots_t * slots, size_t min_capacity) {
+	size_t capacity = slots->capacity;
+	while(capacity <= min_capacity)
+		capacity *= 2;
+	if(capacity == slots->capacity)
+		return;
+
+	slots->entries     = (file_t**)realloc(slots->entries, sizeof(file_t*) * capacity);
+	slots->open_map    = (uint32_t*)realloc(slots->open_map, capacity / 8);
+	slots->cloexec_map = (uint32_t*)realloc(slots->cloexec_map, capacity / 8);
+	memset(slots->entries + slots->capacity, 0, sizeof(file_t*) * (capacity - slots->capacity));
+	memset((uint8_t*)slots->open_map + slots->capacity / 8, 0, (capacity - slots->capacity) / 8);
+	memset((uint8_t*)slots->cloexec_map + slots->capacity / 8, 0, (capacity - slots->capacity) / 8);
+	slots->capacity = capacity;
+}
+
+static void fd_slots_set(fd_slots_t * slots, int fd, file_t * file) {
+	slots->entries[fd] = file;
+	slots->open_map[FD_WORD(fd)] |= FD_BIT(fd);
+	slots->cloexec_map[FD_WORD(fd)] &= ~FD_BIT(fd);
+	if((size_t)fd >= slots->length)
+		slots->length = fd + 1;
+}
+
+static file_t * fd_slots_clear(fd_slots_t * slots, int fd) {
+	file_t * file = slots->entries[fd];
+	slots->entries[fd] = 0;
+	slots->open_map[FD_WORD(fd)] &= ~FD_BIT(fd);
+	slots->cloexec_map[FD_WORD(fd)] &= ~FD_BIT(fd);
+	if((size_t)FD_WORD(fd) < slots->free_hint)
+		slots->free_hint = FD_WORD(fd);
+	while(slots->length && !(slots->open_map[FD_WORD(slots->length - 1)] & FD_BIT(slots->length - 1)))
+		slots->length--;
+	return file;
+}
+
 /*
  * Append a file descriptor to a process.
+ * It gets the lowest free one: full words of the open bitmap are skipped (starting from free_hint),
+ * and the first free bit of the next one is found with bsf.
  *
  * @param proc Process to append to
- * @param node The VFS node
+ * @param node The VFS node, as kopen returned it. Its reference goes to the new open file
  * @return The actual fd, for use in userspace
  */
 uint32_t task_append_fd(task_t * task, FILE * node) {
-	/* Fill gaps */
-	for (unsigned int i = 0; i < task->fds->length; ++i) {
-		if (!task->fds->entries[i]) {
-			task->fds->entries[i] = node;
-			return i;
-		}
+	fd_slots_t * slots = fd_table_own(task->fds);
+
+	size_t word = slots->free_hint;
+	while(word < slots->capacity / 32 && slots->open_map[word] == 0xFFFFFFFF)
+		word++;
+	slots->free_hint = word;
+	if(word == slots->capacity / 32) {
+		if(slots->capacity >= TASK_OPEN_MAX)
+			return -EMFILE;
+		fd_slots_grow(slots, slots->capacity); /* All full, expand */
 	}
-	/* No gaps, expand */
-	if (task->fds->length == task->fds->capacity) {
-		task->fds->capacity *= 2;
-		task->fds->entries = (FILE **)realloc(task->fds->entries, sizeof(FILE *) * task->fds->capacity);
+
+	int fd = word * 32 + fd_bsf(~slots->open_map[word]);
+	fd_slots_set(slots, fd, file_create(node, node->open_flags));
+	return fd;
+}
+
+/* The open file behind a descriptor (with its position and flags): */
+file_t * task_get_file(task_t * task, int fd) {
+	fd_slots_t * slots = task->fds->slots;
+	if (fd < 0 || (size_t)fd >= slots->length)
+		return 0;
+	return slots->entries[fd];
+}
+
+FILE * task_get_fd(task_t * task, int fd) {
+	file_t * file = task_get_file(task, fd);
+	return file ? file->node : 0;
+}
+
+int task_close_fd(task_t * task, int fd) {
+	if(!task_get_file(task, fd))
+		return -EBADF;
+	file_put(fd_slots_clear(fd_table_own(task->fds), fd));
+	return 0;
+}
+
+int task_set_cloexec(task_t * task, int fd, char cloexec) {
+	if(!task_get_fd(task, fd))
+		return -EBADF;
+	fd_slots_t * slots = fd_table_own(task->fds);
+	if(cloexec)
+		slots->cloexec_map[FD_WORD(fd)] |= FD_BIT(fd);
+	else
+		slots->cloexec_map[FD_WORD(fd)] &= ~FD_BIT(fd);
+	return 0;
+}
+
+int task_get_cloexec(task_t * task, int fd) {
+	if(!task_get_fd(task, fd))
+		return -EBADF;
+	return (task->fds->slots->cloexec_map[FD_WORD(fd)] & FD_BIT(fd)) != 0;
+}
+
+/* Closes every descriptor marked close-on-exec: */
+void task_close_cloexec(task_t * task) {
+	fd_slots_t * slots = task->fds->slots;
+	for(size_t word = 0; word * 32 < slots->length; word++) {
+		uint32_t bits = slots->cloexec_map[word];
+		if(bits)
+			slots = fd_table_own(task->fds);
+		while(bits) {
+			int fd = word * 32 + fd_bsf(bits);
+			bits &= bits - 1;
+			file_put(fd_slots_clear(slots, fd));
+		}
 	}
-	task->fds->entries[task->fds->length] = node;
-	task->fds->length++;
-	return task->fds->length - 1;
 }
 
 /*
  * dup2() -> Move the file pointed to by `s(ou)rc(e)` into
  *           the slot pointed to be `dest(ination)`.
+ *           The table grows to fit dest, and dest isn't close-on-exec anymore.
  *
  * @param proc  Process to do this for
  * @param src   Source file descriptor
  * @param dest  Destination file descriptor
- * @return The destination file descriptor, -1 on failure
+ * @return The destination file descriptor, -EBADF on failure
  */
 uint32_t process_move_fd(task_t * task, int src, int dest) {
-	if ((size_t)src > task->fds->length || (size_t)dest > task->fds->length)
-		return -1;
-	if (task->fds->entries[dest] != task->fds->entries[src]) {
-		fclose(task->fds->entries[dest]);
-		task->fds->entries[dest] = task->fds->entries[src];
-		fopen(task->fds->entries[dest], 0);
+	file_t * file = task_get_file(task, src);
+	if (!file || dest < 0 || dest >= TASK_OPEN_MAX)
+		return -EBADF;
+	fd_slots_t * slots = fd_table_own(task->fds);
+	fd_slots_grow(slots, dest);
+
+	/* Both descriptors share the open file, position included: */
+	file_t * old = (size_t)dest < slots->length ? slots->entries[dest] : 0;
+	if (old != file) {
+		fd_slots_set(slots, dest, file_get(file));
+		if (old)
+			file_put(old);
 	}
+	slots->cloexec_map[FD_WORD(dest)] &= ~FD_BIT(dest);
 	return dest;
 }
 /*********************************/
@@ -439,11 +674,7 @@ task_t * spawn_rootproc(void) {
 	root->group             = 0;
 	root->status            = TASKST_CRADLE;
 
-	root->fds               = new fd_table_t;
-	root->fds->refs         = 1;
-	root->fds->length       = 0;
-	root->fds->capacity     = 4;
-	root->fds->entries      = (FILE**)malloc(sizeof(FILE *) * root->fds->capacity);
+	root->fds               = fd_table_create(fd_slots_create(32));
 
 	root->wd_node           = fs_clone(fs_root);
 	root->work_dirpath      = strdup("/");
@@ -528,14 +759,9 @@ task_t * spawn_proc(task_t * parent, char addtotree, paging_directory_t * pagedi
 
 	spin_init(task->image.lock);
 
-	/* Clone the file descriptors from the parent process */
-	task->fds = new fd_table_t;
-	task->fds->refs = 1;
-	task->fds->length = parent->fds->length;
-	task->fds->capacity = parent->fds->capacity;
-	task->fds->entries  = (FILE**)malloc(sizeof(FILE *) * task->fds->capacity);
-	for(uint32_t i = 0; i < parent->fds->length; i++)
-		task->fds->entries[i] = fs_clone(parent->fds->entries[i]);
+	/* Share the file descriptors with the parent process, until either of them changes them */
+	task->fds = fd_table_create(parent->fds->slots);
+	__sync_fetch_and_add(&task->fds->slots->refs, 1);
 
 	task->wd_node = fs_clone(parent->wd_node);
 	task->work_dirpath = strdup(parent->work_dirpath);
@@ -672,6 +898,7 @@ uint32_t task_clone(uintptr_t new_stack, uintptr_t thread_function, uintptr_t ar
 
 	new_task->is_tasklet = parent->is_tasklet;
 
+	fd_slots_put(new_task->fds->slots);
 	free(new_task->fds);
 	new_task->fds = current_task->fds;
 	new_task->fds->refs++;
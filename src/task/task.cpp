@@ -132,6 +132,7 @@ void switch_task(status_t new_process_state) {
 	curr_dir = current_task->thread.page_dir;
 	switch_directory(curr_dir);
 	CPU::TSS::tss_set_kernel_stack(current_task->image.stack);
+	vdso_update_task();
 
 	if(current_task->started) {
 		if (!current_task->signal_kstack) {
@@ -172,6 +173,7 @@ unsigned long * timer_ticks;
 unsigned long * timer_subticks;
 
 void pit_switch_task(void) {
+	vdso_update_time();
 	wakeup_sleepers(*timer_ticks, *timer_subticks);
 	switch_task(TASKST_READY);
 }
@@ -194,6 +196,10 @@ void task_reap(task_t * task) {
 void task_exit(int retval) {
 	if(!current_task->pid)
 		return; /* Do not let the main task kill itself */
+
+	/* Rings whose workers are still using our address space (this might sleep, so it goes before IRQ_OFF): */
+	Kernel::Syscall::ring_task_exit((task_t*)current_task);
+
 	if(!irq_already_off)
 		IRQ_OFF();
 
@@ -202,7 +208,7 @@ void task_exit(int retval) {
 
 	task_t * parent = task_get_parent((task_t*)current_task);
 	if(parent)
-		wakeup_queue(parent->wait_queue);
+		wakeup_queue_one(parent->wait_queue); /* One zombie, one reaper */
 
 	irq_already_off = 0;
 	IRQ_RES(); /* Resume switching */
@@ -341,7 +347,10 @@ void tasking_install(void) {
 	/* Initialize the very first task, which is the main thread that was already running: */
 	current_task = main_task = spawn_rootproc();
 	/* Fetch keyboard file descriptor and insert into the current task (without using the VFS): */
-	MOD_IOCTLDT("keyboard_driver", FILE *, current_task->fds->entries[0], 0);
+	FILE * kbd_file = 0;
+	MOD_IOCTLDT("keyboard_driver", FILE *, kbd_file, 0);
+	if(kbd_file)
+		task_append_fd((task_t*)current_task, kbd_file); /* It's the first one, so it's fd 0 */
 	tasking_enable(1); /* Allow tasking to work */
 	is_tasking_initialized = 1;
 
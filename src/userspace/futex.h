@@ -0,0 +1,112 @@
+/*
+ * futex.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_USERSPACE_FUTEX_H_
+#define SRC_USERSPACE_FUTEX_H_
+
+/* Mutexes and condition variables on top of SYS_FUTEX (see syscall/futex.h). Uncontended, they never leave userspace */
+
+#include <syscall/futex.h>
+#include <syscall/syscall_nums.h>
+#include "syscall.h"
+
+static inline int futex_wait(volatile uint32_t * uaddr, uint32_t val) {
+	return syscall3(SYS_FUTEX, uaddr, FUTEX_WAIT, val);
+}
+
+static inline int futex_wake(volatile uint32_t * uaddr, uint32_t nr_wake) {
+	return syscall3(SYS_FUTEX, uaddr, FUTEX_WAKE, nr_wake);
+}
+
+static inline int futex_requeue(volatile uint32_t * uaddr, uint32_t nr_wake, uint32_t nr_requeue, volatile uint32_t * uaddr2) {
+	return syscall5(SYS_FUTEX, uaddr, FUTEX_REQUEUE, nr_wake, nr_requeue, uaddr2);
+}
+
+/***************/
+/**** Mutex ****/
+/***************/
+
+/* 0: unlocked, 1: locked, 2: locked and somebody might be sleeping on it */
+typedef struct {
+	volatile uint32_t state;
+} mutex_t;
+
+#define MUTEX_INITIALIZER { 0 }
+
+static inline void mutex_init(mutex_t * mutex) {
+	mutex->state = 0;
+}
+
+static inline int mutex_trylock(mutex_t * mutex) {
+	return __sync_val_compare_and_swap(&mutex->state, 0, 1) == 0;
+}
+
+static inline void mutex_lock(mutex_t * mutex) {
+	uint32_t c = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+	if(!c)
+		return; /* Fast path */
+
+	/* Contended. Mark it as such, so that the unlock knows it has to wake someone up: */
+	if(c != 2)
+		c = __sync_lock_test_and_set(&mutex->state, 2);
+	while(c) {
+		futex_wait(&mutex->state, 2);
+		c = __sync_lock_test_and_set(&mutex->state, 2);
+	}
+}
+
+static inline void mutex_unlock(mutex_t * mutex) {
+	/* Going from 1 to 0 means nobody was waiting: */
+	if(__sync_fetch_and_sub(&mutex->state, 1) != 1) {
+		mutex->state = 0;
+		futex_wake(&mutex->state, 1);
+	}
+}
+
+/****************************/
+/**** Condition variable ****/
+/****************************/
+
+/* Every signal/broadcast bumps the sequence, so a waiter can't miss one between unlocking and sleeping */
+typedef struct {
+	volatile uint32_t seq;
+} cond_t;
+
+#define COND_INITIALIZER { 0 }
+
+static inline void cond_init(cond_t * cond) {
+	cond->seq = 0;
+}
+
+static inline void cond_wait(cond_t * cond, mutex_t * mutex) {
+	uint32_t seq = cond->seq;
+	mutex_unlock(mutex);
+	futex_wait(&cond->seq, seq);
+
+	/* We might have been requeued onto the mutex with others behind us, so take it as contended: */
+	while(__sync_lock_test_and_set(&mutex->state, 2))
+		futex_wait(&mutex->state, 2);
+}
+
+static inline void cond_signal(cond_t * cond) {
+	__sync_fetch_and_add(&cond->seq, 1);
+	futex_wake(&cond->seq, 1);
+}
+
+/*
+ * Wakes one waiter and moves the rest straight onto the mutex, instead of having them all race for it.
+ * Must be called with the mutex held, which is marked as contended so that its unlock wakes the requeued waiters
+ */
+static inline void cond_broadcast(cond_t * cond, mutex_t * mutex) {
+	__sync_fetch_and_add(&cond->seq, 1);
+	if(__sync_val_compare_and_swap(&mutex->state, 1, 2) == 0)
+		futex_wake(&cond->seq, 0x7FFFFFFF); /* Not held after all. Nobody would wake them up from there */
+	else
+		futex_requeue(&cond->seq, 1, 0x7FFFFFFF, &mutex->state);
+}
+
+#endif /* SRC_USERSPACE_FUTEX_H_ */
@@ -0,0 +1,73 @@
+/*
+ * ring.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_USERSPACE_RING_H_
+#define SRC_USERSPACE_RING_H_
+
+/* Userspace side of the submission/completion rings (see syscall/syscall_ring.h) */
+
+#include <syscall/syscall_ring.h>
+#include <syscall/syscall_nums.h>
+#include "syscall.h"
+
+typedef struct {
+	int fd;
+	ring_hdr_t * hdr;
+	uint32_t unsubmitted; /* Queued but not yet handed over with ring_submit */
+} ring_t;
+
+/* 'mem' must hold at least RING_MEM_SIZE(entries) bytes and stay alive until ring_exit */
+static inline int ring_init(ring_t * ring, void * mem, uint32_t entries) {
+	ring->hdr = (ring_hdr_t*)mem;
+	ring->unsubmitted = 0;
+	ring->fd = syscall2(SYS_RING_SETUP, mem, entries);
+	return ring->fd;
+}
+
+static inline int ring_exit(ring_t * ring) {
+	return syscall1(SYS_RING_DESTROY, ring->fd);
+}
+
+/* Returns the next free submission slot, or 0 if the queue is full */
+static inline ring_sqe_t * ring_get_sqe(ring_t * ring) {
+	ring_hdr_t * hdr = ring->hdr;
+	if(hdr->sq_tail - hdr->sq_head >= hdr->entries) return 0;
+	/* The kernel only looks at it after the next ring_submit, so it's safe to bump the tail already: */
+	ring_sqe_t * sqe = &RING_SQES(hdr)[hdr->sq_tail & RING_MASK(hdr)];
+	hdr->sq_tail++;
+	ring->unsubmitted++;
+	return sqe;
+}
+
+static inline void ring_prep(ring_sqe_t * sqe, uint8_t opcode, int fd, void * addr, uint32_t len, uint32_t off, uint32_t user_data) {
+	sqe->opcode    = opcode;
+	sqe->flags     = 0;
+	sqe->fd        = fd;
+	sqe->addr      = (uintptr_t)addr;
+	sqe->len       = len;
+	sqe->off       = off;
+	sqe->user_data = user_data;
+}
+
+/* One trap for the whole batch. Optionally waits for 'wait_nr' completions */
+static inline int ring_submit(ring_t * ring, uint32_t wait_nr) {
+	int ret = syscall3(SYS_RING_ENTER, ring->fd, ring->unsubmitted, wait_nr);
+	if(ret > 0) ring->unsubmitted -= ret;
+	return ret;
+}
+
+/* Pops one completion into 'cqe'. Returns 0 if there was none */
+static inline int ring_reap(ring_t * ring, ring_cqe_t * cqe) {
+	ring_hdr_t * hdr = ring->hdr;
+	if(hdr->cq_head == hdr->cq_tail) return 0;
+	*cqe = RING_CQES(hdr)[hdr->cq_head & RING_MASK(hdr)];
+	__sync_synchronize();
+	hdr->cq_head++;
+	return 1;
+}
+
+#endif /* SRC_USERSPACE_RING_H_ */
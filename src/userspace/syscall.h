@@ -0,0 +1,64 @@
+/*
+ * syscall.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_USERSPACE_SYSCALL_H_
+#define SRC_USERSPACE_SYSCALL_H_
+
+/* Userspace system call stubs. SYSENTER is used whenever the CPU supports it, int 0x7F otherwise */
+
+#include <stdint.h>
+
+#define SYSCALL_VECTOR_INT "0x7F"
+
+static inline int syscall_int(int no, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5) {
+	int ret;
+	asm volatile("int $" SYSCALL_VECTOR_INT
+		: "=a"(ret)
+		: "0"(no), "b"(a1), "c"(a2), "d"(a3), "S"(a4), "D"(a5)
+		: "memory");
+	return ret;
+}
+
+/* The kernel returns to the address stored at (%ebp), with %esp = %ebp + 4. %ecx/%edx are clobbered */
+static inline int syscall_sysenter(int no, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5) {
+	int ret;
+	asm volatile(
+		"pushl %%ebp\n"
+		"pushl $1f\n"
+		"movl %%esp, %%ebp\n"
+		"sysenter\n"
+		"1: popl %%ebp\n"
+		: "=a"(ret), "+c"(a2), "+d"(a3)
+		: "0"(no), "b"(a1), "S"(a4), "D"(a5)
+		: "memory", "cc");
+	return ret;
+}
+
+/* Same check the kernel does before programming the SYSENTER MSRs: */
+static inline char syscall_has_sysenter(void) {
+	uint32_t eax, ebx, ecx, edx;
+	asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+	if(!(edx & (1 << 11))) return 0;
+	if(((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3) return 0;
+	return 1;
+}
+
+static inline int syscall(int no, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5) {
+	static char use_sysenter = -1;
+	if(use_sysenter == -1)
+		use_sysenter = syscall_has_sysenter();
+	return use_sysenter ? syscall_sysenter(no, a1, a2, a3, a4, a5) : syscall_int(no, a1, a2, a3, a4, a5);
+}
+
+#define syscall0(no)                     syscall((no), 0, 0, 0, 0, 0)
+#define syscall1(no, a1)                 syscall((no), (uintptr_t)(a1), 0, 0, 0, 0)
+#define syscall2(no, a1, a2)             syscall((no), (uintptr_t)(a1), (uintptr_t)(a2), 0, 0, 0)
+#define syscall3(no, a1, a2, a3)         syscall((no), (uintptr_t)(a1), (uintptr_t)(a2), (uintptr_t)(a3), 0, 0)
+#define syscall4(no, a1, a2, a3, a4)     syscall((no), (uintptr_t)(a1), (uintptr_t)(a2), (uintptr_t)(a3), (uintptr_t)(a4), 0)
+#define syscall5(no, a1, a2, a3, a4, a5) syscall((no), (uintptr_t)(a1), (uintptr_t)(a2), (uintptr_t)(a3), (uintptr_t)(a4), (uintptr_t)(a5))
+
+#endif /* SRC_USERSPACE_SYSCALL_H_ */
@@ -0,0 +1,59 @@
+/*
+ * vdso.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: agent
+ */
+
+#ifndef SRC_USERSPACE_VDSO_H_
+#define SRC_USERSPACE_VDSO_H_
+
+/* Reads the kernel data page (see syscall/vdso.h) without trapping into the kernel */
+
+#include <syscall/vdso.h>
+
+#define vdso_data ((const vdso_data_t*)VDSO_ADDR)
+
+/* Retry until the copy wasn't torn by a kernel update: */
+static inline void vdso_read(vdso_data_t * out) {
+	uint32_t seq;
+	do {
+		while((seq = vdso_data->seq) & 1);
+		__sync_synchronize();
+		out->ticks     = vdso_data->ticks;
+		out->subticks  = vdso_data->subticks;
+		out->hz        = vdso_data->hz;
+		out->boot_time = vdso_data->boot_time;
+		out->pid       = vdso_data->pid;
+		out->uid       = vdso_data->uid;
+		__sync_synchronize();
+	} while(seq != vdso_data->seq);
+	out->seq = seq;
+}
+
+typedef struct {
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+} vdso_timeval_t;
+
+static inline int vdso_gettimeofday(vdso_timeval_t * tv) {
+	vdso_data_t d;
+	vdso_read(&d);
+	tv->tv_sec  = d.boot_time + d.ticks;
+	tv->tv_usec = d.hz ? (uint32_t)((uint64_t)d.subticks * 1000000 / d.hz) : 0;
+	return 0;
+}
+
+static inline int vdso_getpid(void) {
+	vdso_data_t d;
+	vdso_read(&d);
+	return d.pid;
+}
+
+static inline int vdso_getuid(void) {
+	vdso_data_t d;
+	vdso_read(&d);
+	return d.uid;
+}
+
+#endif /* SRC_USERSPACE_VDSO_H_ */
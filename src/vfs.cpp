@@ -11,12 +11,14 @@
 /***********************************************************/
 #define MAX_SYMLINK_DEPTH 8
 #define MAX_SYMLINK_SIZE 4096
+#define MAX_NAME_SIZE 256
+#define VFS_MOUNT_HASH 64 /* Mount table buckets. Must be a power of two */
 
 tree_t * fs_tree     = 0; /* Filesystem mountpoint tree */
 hashmap_t * fs_types = 0;
 FILE * fs_root       = 0; /* Pointer to the root mount fs_node (must be some form of filesystem, even ramdisk) */
-static spin_lock_t tmp_refcount_lock = { 0 };
 static spin_lock_t tmp_vfs_lock = { 0 };
+static list_t vfs_mount_table[VFS_MOUNT_HASH]; /* Every node of fs_tree but the root, by (parent, name) */
 
 struct parent_path_packet {
 	FILE * parent;
@@ -31,8 +33,11 @@ char * canonicalize_path(char * cwd, char * input);
 struct parent_path_packet get_parent(char * path);
 static struct dirent * readdir_mapper(FILE *node, uint32_t index);
 static FILE * vfs_mapper(void);
-FILE * get_mount_point(char * path, unsigned int path_depth, char **outpath, unsigned int * outdepth);
+static list_t * vfs_mount_bucket(tree_node_t * parent, uint32_t hash);
+static tree_node_t * vfs_mount_child(tree_node_t * parent, path_comp_t * comp);
+FILE * get_mount_point(const char ** cursor);
 FILE * kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, char *relative_to);
+static void kopen_release(FILE * node, char owner);
 
 
 /****************************************************************/
@@ -44,6 +49,7 @@ void vfs_install(void) {
 
 	/* Create VFS root: */
 	struct vfs_entry * root = (struct vfs_entry *)malloc(sizeof(struct vfs_entry));
+	memset(root, 0, sizeof(struct vfs_entry));
 	root->name = strdup("[root]");
 	root->file = 0; /* Nothing mounted as root (yet) */
 	tree_set_root(fs_tree, root);
@@ -73,69 +79,34 @@ void * vfs_mount(char * path, FILE * local_root) {
 	spin_lock(tmp_vfs_lock);
 	local_root->refcount = -1;
 
-	tree_node_t * ret_val = 0;
-
-	char * p = strdup(path);
-	char * i = p;
-
-	int path_len = strlen(p);
-
-	/* Chop the path up. E.g.: /home/usr => \0home\0usr */
-	while(i < p + path_len) {
-		if(*i == PATH_SEPARATOR)
-			*i = '\0';
-		i++;
-	}
-	/* Clean up the end of the string: */
-	p[path_len] = '\0';
-	i = p + 1; /* skip the first \0 */
-
-	/* Root node: */
-	tree_node_t * root_node = fs_tree->root;
-
-	if(*i == '\0') {
-		/* Special case, we're trying to set the root node */
-		struct vfs_entry * root = (struct vfs_entry *)root_node->value;
-		root->file = local_root;
-		fs_root = local_root;
-		ret_val = root_node;
-	} else {
-		/* Mount local root into directory: */
-		tree_node_t * node = root_node;
-		char * at = i;
-		while(1) {
-			if(at >= p + path_len)
-				break;
-
-			char found = 0;
-			foreach(child, node->children) {
-				tree_node_t * tchild = (tree_node_t *)child->value;
-				struct vfs_entry * ent = (struct vfs_entry *)tchild->value;
-				if(!strcmp(ent->name, at)) {
-					found = 1;
-					node = tchild;
-					ret_val = node;
-					break;
-				}
-			}
-
-			if(!found) {
-				/* Making directory: */
-				struct vfs_entry * ent = (struct vfs_entry*)malloc(sizeof(struct vfs_entry));
-				ent->name = strdup(at);
-				ent->file = 0;
-				node = tree_node_insert_child(fs_tree, node, ent);
-			}
-			at += strlen(at) + 1;
+	tree_node_t * node = fs_tree->root;
+	const char * cursor = path;
+	path_comp_t comp;
+
+	/* Find (or make up) the directories on the way: */
+	while(path_next(&cursor, &comp)) {
+		tree_node_t * child = vfs_mount_child(node, &comp);
+		if(!child) {
+			/* Making directory: */
+			struct vfs_entry * ent = (struct vfs_entry*)malloc(sizeof(struct vfs_entry));
+			memset(ent, 0, sizeof(struct vfs_entry));
+			ent->name = (char*)malloc(comp.len + 1);
+			memcpy(ent->name, comp.name, comp.len);
+			ent->name[comp.len] = '\0';
+			ent->hash = comp.hash;
+			child = tree_node_insert_child(fs_tree, node, ent);
+			ent->hash_node.value = child;
+			list_append(vfs_mount_bucket(node, comp.hash), &ent->hash_node);
 		}
-
-		/* Set local root into the node: */
-		struct vfs_entry * ent = (struct vfs_entry *)node->value;
-		ent->file = local_root;
-		ret_val = node;
+		node = child;
 	}
 
-	free(p);
+	/* Set local root into the node: */
+	struct vfs_entry * ent = (struct vfs_entry *)node->value;
+	ent->file = local_root;
+	if(node == fs_tree->root)
+		fs_root = local_root; /* Special case, we're setting the root node */
+
 	spin_unlock(tmp_vfs_lock);
 	return 0;
 }
@@ -169,9 +140,7 @@ int vfs_mount_type(char * type, char * arg, char * mountpoint) {
 EXPORT_SYMBOL(vfs_mount_type);
 
 void vfs_lock(FILE * node) {
-	spin_lock(tmp_refcount_lock);
 	node->refcount = -1;
-	spin_unlock(tmp_refcount_lock);
 }
 EXPORT_SYMBOL(vfs_lock);
 
@@ -194,24 +163,110 @@ char fs_is_dir(FILE * node) {
 EXPORT_SYMBOL(fs_is_dir);
 
 uint32_t fread(FILE * node, uint32_t offset, uint32_t size, uint8_t* buffer) {
+	if(pagecache_cacheable(node))
+		return pagecache_read(node, offset, size, buffer);
 	return node && node->read  ? node->read(node, offset, size, buffer)  : -1;
 }
 EXPORT_SYMBOL(fread);
 
 uint32_t fwrite(FILE * node, uint32_t offset, uint32_t size, uint8_t* buffer) {
-	return node && node->write ? node->write(node, offset, size, buffer) : -1;
+	if(!node || !node->write) return -1;
+	return pagecache_cacheable(node) ? pagecache_write(node, offset, size, buffer) : node->write(node, offset, size, buffer);
 }
 EXPORT_SYMBOL(fwrite);
 
+/*
+ * Scatter/gather. The elements are laid out back to back starting at 'offset'.
+ * Cached files are read through the page cache in one pass over the vector. Nodes with a readv/writev callback
+ * get the whole vector in one call, the others get one read/write per element, until one of them comes up short
+ */
+int fs_readv(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt) {
+	if(!node) return -EBADF;
+	if(iovcnt < 0 || iovcnt > IOV_MAX) return -EINVAL;
+	if(iovcnt && !iov) return -EFAULT;
+	if(pagecache_cacheable(node)) return pagecache_readv(node, offset, iov, iovcnt);
+	if(node->readv) return node->readv(node, offset, iov, iovcnt);
+	if(!node->read) return -EINVAL;
+
+	int total = 0;
+	for(int i = 0; i < iovcnt; i++) {
+		int ret = fread(node, offset + total, iov[i].iov_len, (uint8_t*)iov[i].iov_base);
+		if(ret < 0) return total ? total : ret;
+		total += ret;
+		if((uint32_t)ret < iov[i].iov_len) break;
+	}
+	return total;
+}
+EXPORT_SYMBOL(fs_readv);
+
+int fs_writev(FILE * node, uint32_t offset, const struct iovec * iov, int iovcnt) {
+	if(!node) return -EBADF;
+	if(iovcnt < 0 || iovcnt > IOV_MAX) return -EINVAL;
+	if(iovcnt && !iov) return -EFAULT;
+	if(node->writev && !pagecache_cacheable(node)) return node->writev(node, offset, iov, iovcnt);
+	if(!node->write) return -EINVAL;
+
+	int total = 0;
+	for(int i = 0; i < iovcnt; i++) {
+		int ret = fwrite(node, offset + total, iov[i].iov_len, (uint8_t*)iov[i].iov_base);
+		if(ret < 0) return total ? total : ret;
+		total += ret;
+		if((uint32_t)ret < iov[i].iov_len) break;
+	}
+	return total;
+}
+EXPORT_SYMBOL(fs_writev);
+
+/* readv/writev go from the descriptor's position and move it, preadv/pwritev take an offset and leave it alone: */
+int readv(int fd, const struct iovec * iov, int iovcnt) {
+	file_t * file = task_get_file((task_t*)current_task, fd);
+	if(!file) return -EBADF;
+	int ret = fs_readv(file->node, file->offset, iov, iovcnt);
+	if(ret > 0) file->offset += ret;
+	return ret;
+}
+
+int writev(int fd, const struct iovec * iov, int iovcnt) {
+	file_t * file = task_get_file((task_t*)current_task, fd);
+	if(!file) return -EBADF;
+	if(file->open_flags & O_APPEND)
+		file->offset = fs_filesize(file->node);
+	int ret = fs_writev(file->node, file->offset, iov, iovcnt);
+	if(ret > 0) file->offset += ret;
+	return ret;
+}
+
+int preadv(int fd, const struct iovec * iov, int iovcnt, uint32_t offset) {
+	return fs_readv(task_get_fd((task_t*)current_task, fd), offset, iov, iovcnt);
+}
+
+int pwritev(int fd, const struct iovec * iov, int iovcnt, uint32_t offset) {
+	return fs_writev(task_get_fd((task_t*)current_task, fd), offset, iov, iovcnt);
+}
+
+int fsync(int fd) {
+	return fs_fsync(task_get_fd((task_t*)current_task, fd));
+}
+
+int sync(void) {
+	fs_sync();
+	return 0;
+}
+
 uint32_t fopen(FILE * node, unsigned int flags) {
 	if(!node) return -1;
-
-	if(node->refcount >= 0) {
-		spin_lock(tmp_refcount_lock);
-		node->refcount++;
-		spin_unlock(tmp_refcount_lock);
+	node->open_flags = flags;
+
+	if(node->refcount >= 0)
+		__sync_fetch_and_add(&node->refcount, 1);
+	uint32_t ret = node->open ? node->open(node, flags) : -1;
+	if(!ret && (flags & O_TRUNC)) {
+		/* Only once the filesystem has cut the file down. The cached pages (dirty or not) go with it, and so does the old size: */
+		if(pagecache_cacheable(node))
+			node->size = 0;
+		pagecache_truncate(node, 0);
 	}
-	return node->open ? node->open(node, flags) : -1;
+	return ret;
 }
 EXPORT_SYMBOL(fopen);
 
@@ -221,13 +276,14 @@ uint32_t fclose(FILE * node) {
 			return -1;
 		}
 		else {
-			spin_lock(tmp_refcount_lock);
-			if(--node->refcount == 0) {
+			/* Whoever takes it down to 0 is the last user: */
+			if(__sync_sub_and_fetch(&node->refcount, 1) == 0) {
+				if(node->flags & FS_INODE)
+					dcache_forget(node);
 				if(node->close)
 					node->close(node);
 				free(node);
 			}
-			spin_unlock(tmp_refcount_lock);
 			return 0;
 		}
 	} else {
@@ -247,7 +303,7 @@ FILE * fs_finddir(FILE* node, char * name) {
 EXPORT_SYMBOL(fs_finddir);
 
 uint32_t fs_filesize(FILE * node) {
-	return node->size;
+	return pagecache_size(node);
 }
 EXPORT_SYMBOL(fs_filesize);
 
@@ -257,12 +313,13 @@ int fs_mkdir(char * dirname, uint16_t permission) {
 
 	if(packet.parent && packet.parent->mkdir) {
 		packet.parent->mkdir(packet.parent, packet.f_path, permission);
+		dcache_invalidate(packet.parent, packet.f_path);
 		free(canon_path);
 		fclose(packet.parent);
 		return 0;
 	} else {
 		free(canon_path);
-		if(packet.parent) free(packet.parent);
+		fclose(packet.parent);
 		return -1;
 	}
 }
@@ -274,12 +331,13 @@ int fs_create_file(char * filename, uint16_t permission) {
 
 	if(packet.parent && packet.parent->create) {
 		packet.parent->create(packet.parent, packet.f_path, permission);
+		dcache_invalidate(packet.parent, packet.f_path);
 		free(canon_path);
-		free(packet.parent);
+		fclose(packet.parent);
 		return 0;
 	} else {
 		free(canon_path);
-		if(packet.parent) free(packet.parent);
+		fclose(packet.parent);
 		return -1;
 	}
 }
@@ -292,22 +350,51 @@ EXPORT_SYMBOL(kopen);
 
 FILE * fs_clone(FILE * source) {
 	if(!source) return 0;
-	if(source->refcount >= 0) {
-		spin_lock(tmp_refcount_lock);
-		source->refcount++;
-		spin_unlock(tmp_refcount_lock);
-	}
+	if(source->refcount >= 0)
+		__sync_fetch_and_add(&source->refcount, 1);
 	return source;
 }
 EXPORT_SYMBOL(fs_clone);
 
+/* Wraps the node (and the caller's reference to it) into a new open file: */
+file_t * file_create(FILE * node, uint32_t flags) {
+	file_t * file = (file_t*)malloc(sizeof(file_t));
+	memset(file, 0, sizeof(file_t));
+	file->node       = node;
+	file->open_flags = flags;
+	file->refcount   = 1;
+	return file;
+}
+EXPORT_SYMBOL(file_create);
+
+file_t * file_get(file_t * file) {
+	if(file)
+		__sync_fetch_and_add(&file->refcount, 1);
+	return file;
+}
+EXPORT_SYMBOL(file_get);
+
+void file_put(file_t * file) {
+	if(file && __sync_sub_and_fetch(&file->refcount, 1) == 0) {
+		if(file->epitems.length)
+			epoll_file_release(file); /* Closing it is the same as EPOLL_CTL_DEL for every epoll watching it */
+		fclose(file->node);
+		free(file);
+	}
+}
+EXPORT_SYMBOL(file_put);
+
 int fs_ioctl(FILE * node, int request, void * argp) {
 	return node && node->ioctl ? node->ioctl(node, request, argp) : -1;
 }
 EXPORT_SYMBOL(fs_ioctl);
 
 int fs_chmod(FILE * node, int mode) {
-	return node && node->chmod ? node->chmod(node, mode) : -1;
+	if(!node || !node->chmod) return -1;
+	int ret = node->chmod(node, mode);
+	if(!ret)
+		node->mask = mode & 07777; /* Shared nodes are what everyone else sees too */
+	return ret;
 }
 EXPORT_SYMBOL(fs_chmod);
 
@@ -316,13 +403,27 @@ int fs_unlink(char * filename) {
 	struct parent_path_packet packet = get_parent(canon_path);
 
 	if(packet.parent && packet.parent->unlink) {
+		/* Whatever is cached of it must not be written back over blocks the filesystem is about to reuse: */
+		FILE * victim = dcache_get(packet.parent, packet.f_path);
+		if(victim)
+			pagecache_truncate(victim, 0);
 		packet.parent->unlink(packet.parent, packet.f_path);
+		dcache_invalidate(packet.parent, packet.f_path);
+		if(victim) {
+			/* Its other links (and whoever has it open) share the node: */
+			if(victim->nlink)
+				victim->nlink--;
+			if(victim->flags & FS_INODE)
+				fclose(victim);
+			else
+				free(victim);
+		}
 		free(canon_path);
-		free(packet.parent);
+		fclose(packet.parent);
 		return 0;
 	} else {
 		free(canon_path);
-		if(packet.parent) free(packet.parent);
+		fclose(packet.parent);
 		return -1;
 	}
 }
@@ -334,12 +435,13 @@ int fs_symlink(char * target, char * filename) {
 
 	if(packet.parent && packet.parent->symlink) {
 		packet.parent->symlink(packet.parent, target, packet.f_path);
+		dcache_invalidate(packet.parent, packet.f_path);
 		free(canon_path);
 		fclose(packet.parent);
 		return 0;
 	} else {
 		free(canon_path);
-		if(packet.parent) free(packet.parent);
+		fclose(packet.parent);
 		return -1;
 	}
 }
@@ -350,117 +452,89 @@ int fs_readlink(FILE * node, char * buff, size_t size) {
 }
 EXPORT_SYMBOL(fs_readlink);
 
+/* Writes back the node's dirty pages, and then whatever its filesystem is holding on to: */
+int fs_fsync(FILE * node) {
+	if(!node) return -EBADF;
+	pagecache_sync(node);
+	return node->fsync ? node->fsync(node) : 0;
+}
+EXPORT_SYMBOL(fs_fsync);
+
+/* Same thing, for everything that is mounted (mountpoints are never taken out of the tree, so no lock is needed): */
+void fs_sync(void) {
+	pagecache_sync_all();
+	if(!fs_tree) return;
+
+	FILE * root = ((struct vfs_entry*)fs_tree->root->value)->file;
+	if(root && root->fsync)
+		root->fsync(root);
+	for(int i = 0; i < VFS_MOUNT_HASH; i++) {
+		foreach(it, &vfs_mount_table[i]) {
+			FILE * file = ((struct vfs_entry*)((tree_node_t*)it->value)->value)->file;
+			if(file && file->fsync)
+				file->fsync(file);
+		}
+	}
+}
+EXPORT_SYMBOL(fs_sync);
+
 
 /********************************************************/
 /************* VFS Implementation Functions *************/
 /********************************************************/
-char * canonicalize_path(char * cwd, char * input) {
-	/* This is a stack-based canonicalizer; we use a list as a stack */
-	list_t * out = list_create();
-
-	/*
-	* If we have a relative path, we need to canonicalize
-	* the working directory and insert it into the stack.
-	*/
-	if(strlen(input) && input[0] != PATH_SEPARATOR) {
-		/* Make a copy of the working directory */
-		char * path = (char*)malloc((strlen(cwd) + 1) * sizeof(char));
-		memcpy(path, cwd, strlen(cwd) + 1);
-
-		/* Setup tokenizer */
-		char * pch;
-		char * save;
-		pch = strtok_r(path, PATH_SEPARATOR_STRING, &save);
-
-		/* Start tokenizing */
-		while(pch != 0) {
-			/* Make copies of the path elements */
-			char * s = (char*)malloc(sizeof(char) * (strlen(pch) + 1));
-			memcpy(s, pch, strlen(pch) + 1);
-			/* And push them */
-			list_insert(out, s);
-			pch = strtok_r(0, PATH_SEPARATOR_STRING, &save);
-		}
-		free(path);
-	}
-
-	/* Similarly, we need to push the elements from the new path */
-	char * path = (char*)malloc((strlen(input) + 1) * sizeof(char));
-	memcpy(path, input, strlen(input) + 1);
+/*
+ * Steps over the next component of 'cursor' (skipping the separators around it), hashing it on the way.
+ * Returns 0 when there are no more:
+ */
+char path_next(const char ** cursor, path_comp_t * comp) {
+	const char * at = *cursor;
+	while(*at == PATH_SEPARATOR)
+		at++;
+	if(!*at)
+		return 0;
 
-	/* Initialize the tokenizer... */
-	char *pch;
-	char *save;
-	pch = strtok_r(path,PATH_SEPARATOR_STRING,&save);
+	comp->name = at;
+	comp->hash = 0;
+	while(*at && *at != PATH_SEPARATOR)
+		comp->hash = comp->hash * 31 + *at++;
+	comp->len = at - comp->name;
+	*cursor = at;
+	return 1;
+}
+EXPORT_SYMBOL(path_next);
 
-	/*
-	 * Tokenize the path, this time, taking care to properly
-	 * handle .. and . to represent up (stack pop) and current
-	 * (do nothing)
-	 */
-	while(pch != 0) {
-		if (!strcmp(pch,PATH_UP)) {
-			/*
-			* Path = ..
-			* Pop the stack to move up a directory
-			*/
-			node_t * n = list_pop(out);
-			if (n) {
-				free(n->value);
-				free(n);
+/* Resolves . and .. (and relative paths, against cwd) in a single pass over both: */
+char * canonicalize_path(char * cwd, char * input) {
+	char relative = input[0] && input[0] != PATH_SEPARATOR;
+	char * output = (char*)malloc((relative ? strlen(cwd) + 1 : 0) + strlen(input) + 2);
+	size_t len = 0;
+
+	const char * parts[2] = { relative ? cwd : "", input };
+	for(int i = 0; i < 2; i++) {
+		const char * cursor = parts[i];
+		path_comp_t comp;
+		while(path_next(&cursor, &comp)) {
+			if(comp.len == 1 && comp.name[0] == '.')
+				continue; /* Path = . Do nothing */
+			if(comp.len == 2 && comp.name[0] == '.' && comp.name[1] == '.') {
+				/* Path = .. Drop the last element to move up a directory */
+				while(len && output[len - 1] != PATH_SEPARATOR)
+					len--;
+				if(len)
+					len--;
+				continue;
 			}
-		} else if (!strcmp(pch,PATH_DOT)) {
-			/*
-			* Path = .
-			* Do nothing
-			*/
-		} else {
-			/*
-			* Regular path, push it
-			* XXX: Path elements should be checked for existence!
-			*/
-			char * s = (char*)malloc(sizeof(char) * (strlen(pch) + 1));
-			memcpy(s, pch, strlen(pch) + 1);
-			list_insert(out, s);
-		}
-		pch = strtok_r(0, PATH_SEPARATOR_STRING, &save);
-	}
-	free(path);
-
-	/* Calculate the size of the path string */
-	size_t size = 0;
-	foreach(item, out) {
-		/* Helpful use of our foreach macro. */
-		size += strlen((char*)item->value) + 1;
-	}
-
-	/* join() the list */
-	char *output = (char*)malloc(sizeof(char) * (size + 1));
-	char *output_offset = output;
-	if(size == 0) {
-		/*
-		 * If the path is empty, we take this to mean the root
-		 * thus we synthesize a path of "/" to return.
-		 */
-		output = (char*)realloc(output, sizeof(char) * 2);
-		output[0] = PATH_SEPARATOR;
-		output[1] = '\0';
-	} else {
-		/* Otherwise, append each element together */
-		foreach(item, out) {
-			output_offset[0] = PATH_SEPARATOR;
-			output_offset++;
-			memcpy(output_offset, item->value, strlen((char*)item->value) + 1);
-			output_offset += strlen((char*)item->value);
+			/* Regular path, append it */
+			output[len++] = PATH_SEPARATOR;
+			memcpy(output + len, comp.name, comp.len);
+			len += comp.len;
 		}
 	}
 
-	/* Clean up the various things we used to get here */
-	list_destroy(out);
-	list_free(out);
-	free(out);
-
-	/* And return a working, absolute path */
+	/* If the path is empty, we take this to mean the root */
+	if(!len)
+		output[len++] = PATH_SEPARATOR;
+	output[len] = '\0';
 	return output;
 }
 EXPORT_SYMBOL(canonicalize_path);
@@ -537,105 +611,119 @@ static FILE * vfs_mapper(void) {
 	return node;
 }
 
-FILE * get_mount_point(char * path, unsigned int path_depth, char **outpath, unsigned int * outdepth) {
-	for(size_t depth = 0; depth <= path_depth; depth++)
-		path += strlen(path) + 1;
+static list_t * vfs_mount_bucket(tree_node_t * parent, uint32_t hash) {
+	return &vfs_mount_table[(hash ^ ((uintptr_t)parent >> 4)) & (VFS_MOUNT_HASH - 1)];
+}
 
+/* The child of 'parent' in the mount tree named 'comp', without going through its siblings: */
+static tree_node_t * vfs_mount_child(tree_node_t * parent, path_comp_t * comp) {
+	foreach(it, vfs_mount_bucket(parent, comp->hash)) {
+		tree_node_t * tnode = (tree_node_t*)it->value;
+		struct vfs_entry * ent = (struct vfs_entry*)tnode->value;
+		if(tnode->parent == parent && ent->hash == comp->hash
+			&& strlen(ent->name) == comp->len && !memcmp(ent->name, comp->name, comp->len))
+			return tnode;
+	}
+	return 0;
+}
+
+/* Finds the deepest mount on the path, and leaves 'cursor' right past its components: */
+FILE * get_mount_point(const char ** cursor) {
 	FILE * last = fs_root;
 	tree_node_t * node = fs_tree->root;
+	const char * at = *cursor;
+	path_comp_t comp;
 
-	char * at = *outpath;
-	int _depth = 1;
-	int _tree_depth = 0;
-
-	while(1) {
-		if(at >= path) break;
-
-		int found = 0;
-		foreach(child, node->children) {
-			tree_node_t * tchild = (tree_node_t*)child->value;
-			struct vfs_entry * ent = (struct vfs_entry*)tchild->value;
-			if(!strcmp(ent->name, at)) {
-				found = 1;
-				node = tchild;
-				at = at + strlen(at) + 1;
-				if(ent->file) {
-					_tree_depth = _depth;
-					last = ent->file;
-					*outpath = at;
-				}
-				break;
-			}
+	while(path_next(&at, &comp)) {
+		node = vfs_mount_child(node, &comp);
+		if(!node)
+			break;
+		struct vfs_entry * ent = (struct vfs_entry*)node->value;
+		if(ent->file) {
+			last = ent->file;
+			*cursor = at;
 		}
-		if(!found) break;
-		_depth++;
 	}
 
-	*outdepth = _tree_depth;
-	if(last) {
-		FILE * last_clone = (FILE *)malloc(sizeof(FILE));
-		memcpy(last_clone, last, sizeof(FILE));
-		return last_clone;
+	return last; /* The mounted node itself. Mounts are never freed, so it can be handed out as is */
+}
+
+/* Who the node the path walk is holding on to belongs to: */
+#define KOPEN_BORROWED 0 /* A mount's or the filesystem's own (like initrd's). Left alone */
+#define KOPEN_PRIVATE  1 /* A copy of the walk's own, never opened */
+#define KOPEN_SHARED   2 /* A shared node (FS_INODE), with a reference taken */
+#define KOPEN_OPENED   3 /* What a symlink resolved to, opened by kopen_recur */
+
+static void kopen_release(FILE * node, char owner) {
+	switch(owner) {
+	case KOPEN_PRIVATE: free(node); break;
+	case KOPEN_SHARED:
+	case KOPEN_OPENED:  fclose(node); break;
 	}
-	return last;
 }
 
 FILE * kopen_recur(char * filename, uint32_t flags, uint32_t symlink_depth, char * relative_to) {
 	if(!filename) return 0;
 
 	char * path = canonicalize_path(relative_to, filename);
-	size_t path_len = strlen(path);
 
-	if(path_len == 1) {
+	if(!path[1]) {
 		/* Return the node at '/' */
-		FILE * root_clone = (FILE*)malloc(sizeof(FILE));
-		memcpy(root_clone, fs_root, sizeof(FILE));
 		free(path);
-		fopen(root_clone, flags);
-		return root_clone;
+		fopen(fs_root, flags);
+		return fs_root;
 	}
 
-	/* Otherwise, we need to break the path up and start searching */
-	char * path_offset = path;
-	uint32_t path_depth = 0;
-	while(path_offset < path + path_len) {
-		/* Find each PATH_SEPARATOR */
-		if(*path_offset == PATH_SEPARATOR) {
-			*path_offset = '\0';
-			path_depth++;
-		}
-		path_offset++;
+	/* Otherwise, find the mountpoint for this file. 'cursor' is left at what's inside of it: */
+	const char * cursor = path;
+	FILE * node_ptr = get_mount_point(&cursor);
+	if(!node_ptr) {
+		free(path);
+		return 0;
 	}
-	/* Clean up */
-	path[path_len] = '\0';
-	path_offset = path + 1;
-
-	/*
-	 * At this point, the path is tokenized and path_offset points
-	 * to the first token (directory) and path_depth is the number
-	 * of directories in the path
-	 */
-
-	/*
-	 * Dig through the (real) tree to find the file
-	 */
-	unsigned int depth = 0;
-	/* Find the mountpoint for this file */
-	FILE * node_ptr = get_mount_point(path, path_depth, &path_offset, &depth);
-	if(!node_ptr) return 0;
 
-	if(path_offset >= path + path_len) {
+	if(!*cursor) {
+		/* It's the mountpoint itself: */
 		free(path);
 		fopen(node_ptr, flags);
 		return node_ptr;
 	}
 
-	/* Look for it: */
+	/*
+	 * Look for it. What cached directories (ext2, tmpfs...) hold is shared, all the way to the file at the end,
+	 * which is opened as is. Only the end of a path through any other directory gets copied:
+	 */
 	FILE * node_next = 0;
-	for(; depth < path_depth; ++depth) {
-		node_next = fs_finddir(node_ptr, path_offset);
-		fclose(node_ptr);
+	char owner = KOPEN_BORROWED, next_owner;
+	path_comp_t comp;
+	char name[MAX_NAME_SIZE];
+	while(path_next(&cursor, &comp)) {
+		char last = !*cursor; /* The path is canonical, there are no trailing separators */
+		if(comp.len >= MAX_NAME_SIZE) {
+			kopen_release(node_ptr, owner);
+			free(path);
+			return 0;
+		}
+		memcpy(name, comp.name, comp.len);
+		name[comp.len] = '\0';
+
+		/* Only what comes out of a cached directory was allocated for us: */
+		char cached = (node_ptr->flags & FS_DCACHE) != 0;
+		node_next = dcache_get(node_ptr, name);
+		if(node_next && last && !cached) {
+			/* The caller closes (and frees) what it gets, so it can't be the filesystem's own: */
+			FILE * copy = (FILE*)malloc(sizeof(FILE));
+			memcpy(copy, node_next, sizeof(FILE));
+			copy->refcount = 0;
+			node_next = copy;
+		}
+		if(!cached && !last)
+			next_owner = KOPEN_BORROWED;
+		else
+			next_owner = node_next && (node_next->flags & FS_INODE) ? KOPEN_SHARED : KOPEN_PRIVATE;
+		kopen_release(node_ptr, owner);
 		node_ptr = node_next;
+		owner = next_owner;
 		if(!node_ptr) {
 			/* We failed to find the requested directory */
 			free((void*)path);
@@ -648,18 +736,18 @@ FILE * kopen_recur(char * filename, uint32_t flags, uint32_t symlink_depth, char
 		 * on the leaf of the path then we will look at those flags and act accordingly
 		 */
 		if ((node_ptr->flags & FS_SYMLINK) &&
-				!((flags & O_NOFOLLOW) && (flags & O_PATH) && depth == path_depth - 1)) {
+				!((flags & O_NOFOLLOW) && (flags & O_PATH) && last)) {
 			/* This ensures we don't return a path when NOFOLLOW is requested but PATH
 			 * isn't passed.
 			 */
-			if ((flags & O_NOFOLLOW) && depth == path_depth - 1) {
+			if ((flags & O_NOFOLLOW) && last) {
 				free((void*)path);
-				fclose(node_ptr);
+				kopen_release(node_ptr, owner);
 				return (FILE*)-1;
 			}
 			if (symlink_depth >= MAX_SYMLINK_DEPTH) {
 				free((void*)path);
-				fclose(node_ptr);
+				kopen_release(node_ptr, owner);
 				return (FILE*)-2;
 			}
 
@@ -671,41 +759,43 @@ FILE * kopen_recur(char * filename, uint32_t flags, uint32_t symlink_depth, char
 			int len = node_ptr->readlink(node_ptr, symlink_buf, sizeof(symlink_buf));
 			if(len < 0) {
 				free((void*)path);
-				fclose(node_ptr);
+				kopen_release(node_ptr, owner);
 				return (FILE*)-3;
 			}
 			if (symlink_buf[len] != '\0') {
 				free((void*)path);
-				fclose(node_ptr);
+				kopen_release(node_ptr, owner);
 				return (FILE*)-4;
 			}
 
+			/* The link is relative to the directory it's in, which is our path up to this component: */
 			FILE * old_node_ptr = node_ptr;
-			/* Rebuild our path up to this point. This is hella hacky. */
-			char * relpath = (char*)malloc(path_len + 1);
-			char * ptr = relpath;
-			memcpy(relpath, path, path_len + 1);
-			for (unsigned int i = 0; i < depth; i++) {
-				while(*ptr != '\0')
-					ptr++;
-				*ptr = PATH_SEPARATOR;
-			}
-			node_ptr = kopen_recur(symlink_buf, 0, symlink_depth + 1, relpath);
+			size_t dir_len = comp.name - 1 - path;
+			char * relpath = (char*)malloc(dir_len + 2);
+			memcpy(relpath, path, dir_len);
+			relpath[dir_len] = '\0';
+			if(!dir_len)
+				strcpy(relpath, PATH_SEPARATOR_STRING);
+			/* At the end of the path, it's what we're opening: */
+			node_ptr = kopen_recur(symlink_buf, last ? flags : 0, symlink_depth + 1, relpath);
 			free(relpath);
-			fclose(old_node_ptr);
+			kopen_release(old_node_ptr, owner);
+			owner = KOPEN_OPENED;
 			if(!node_ptr) {
 				free((void*)path);
 				return (FILE*)-5;
 			}
 		}
-		if(depth == path_depth - 1) {
-			/* We found the file and are done, open the node */
-			fopen(node_ptr, flags);
+		if(last) {
+			/* We found the file and are done, open the node. The walk's reference (if any) becomes the open's: */
+			if(owner != KOPEN_OPENED) {
+				fopen(node_ptr, flags);
+				if(owner == KOPEN_SHARED)
+					fclose(node_ptr);
+			}
 			free((void *)path);
 			return node_ptr;
 		}
-		/* We are still searching... */
-		path_offset += strlen(path_offset) + 1;
 	}
 
 	/* The file was not found */